@@ -6,6 +6,7 @@
 
 #include "db/filename.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
@@ -19,29 +20,51 @@ Status BuildTable(const std::string& dbname,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
+                  Iterator* range_del_iter,
                   FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
   iter->SeekToFirst();
+  range_del_iter->SeekToFirst();
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || range_del_iter->Valid()) {
     WritableFile* file;
-    s = env->NewWritableFile(fname, &file);
+    if (options.use_direct_io_for_flush_and_compaction) {
+      s = env->NewDirectWritableFile(fname, &file);
+    } else {
+      s = env->NewWritableFile(fname, &file);
+    }
     if (!s.ok()) {
       return s;
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    bool has_range = iter->Valid();
+    if (has_range) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
       builder->Add(key, iter->value());
     }
+    if (range_del_iter->Valid()) {
+      std::vector<RangeTombstone> tombstones;
+      s = CollectRangeTombstones(range_del_iter, &tombstones);
+      for (size_t i = 0; i < tombstones.size(); i++) {
+        AddRangeTombstoneToTable(options.comparator, tombstones[i], builder,
+                                 &meta->smallest, &meta->largest, &has_range);
+      }
+      meta->has_range_deletions = true;
+    }
 
     // Finish and check for builder errors
-    s = builder->Finish();
+    if (s.ok()) {
+      s = builder->Finish();
+    } else {
+      builder->Abandon();
+    }
     if (s.ok()) {
       meta->file_size = builder->FileSize();
       assert(meta->file_size > 0);
@@ -59,10 +82,12 @@ Status BuildTable(const std::string& dbname,
     file = nullptr;
 
     if (s.ok()) {
-      // Verify that the table is usable
+      // Verify that the table is usable.  Memtables are usually flushed
+      // to level-0, so open it as a level-0 table.
       Iterator* it = table_cache->NewIterator(ReadOptions(),
                                               meta->number,
-                                              meta->file_size);
+                                              meta->file_size,
+                                              nullptr, 0);
       s = it->status();
       delete it;
     }
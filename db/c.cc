@@ -12,6 +12,7 @@
 #include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 #include "leveldb/status.h"
 #include "leveldb/write_batch.h"
 
@@ -29,6 +30,7 @@ using leveldb::Logger;
 using leveldb::NewBloomFilterPolicy;
 using leveldb::NewLRUCache;
 using leveldb::Options;
+using leveldb::PinnableSlice;
 using leveldb::RandomAccessFile;
 using leveldb::Range;
 using leveldb::ReadOptions;
@@ -55,6 +57,7 @@ struct leveldb_randomfile_t   { RandomAccessFile* rep; };
 struct leveldb_writablefile_t { WritableFile*     rep; };
 struct leveldb_logger_t       { Logger*           rep; };
 struct leveldb_filelock_t     { FileLock*         rep; };
+struct leveldb_pinnableslice_t { PinnableSlice    rep; };
 
 struct leveldb_comparator_t : public Comparator {
   void* state_;
@@ -214,6 +217,64 @@ char* leveldb_get(
   return result;
 }
 
+leveldb_pinnableslice_t* leveldb_get_pinned(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    const char* key, size_t keylen,
+    char** errptr) {
+  leveldb_pinnableslice_t* v = new leveldb_pinnableslice_t;
+  Status s = db->rep->GetPinned(options->rep, Slice(key, keylen), &v->rep);
+  if (!s.ok()) {
+    delete v;
+    if (!s.IsNotFound()) {
+      SaveError(errptr, s);
+    }
+    return nullptr;
+  }
+  return v;
+}
+
+void leveldb_pinnableslice_destroy(leveldb_pinnableslice_t* v) {
+  delete v;
+}
+
+const char* leveldb_pinnableslice_value(const leveldb_pinnableslice_t* v,
+                                        size_t* vallen) {
+  *vallen = v->rep.size();
+  return v->rep.data();
+}
+
+void leveldb_multi_get(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    size_t num_keys,
+    const char* const* keys_list,
+    const size_t* keys_list_sizes,
+    char** values_list,
+    size_t* values_list_sizes,
+    char** errs) {
+  std::vector<Slice> keys(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    keys[i] = Slice(keys_list[i], keys_list_sizes[i]);
+  }
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db->rep->MultiGet(options->rep, keys, &values, &statuses);
+  for (size_t i = 0; i < num_keys; i++) {
+    errs[i] = nullptr;
+    if (statuses[i].ok()) {
+      values_list[i] = CopyString(values[i]);
+      values_list_sizes[i] = values[i].size();
+    } else {
+      values_list[i] = nullptr;
+      values_list_sizes[i] = 0;
+      if (!statuses[i].IsNotFound()) {
+        SaveError(&errs[i], statuses[i]);
+      }
+    }
+  }
+}
+
 leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db,
     const leveldb_readoptions_t* options) {
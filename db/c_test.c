@@ -59,10 +59,21 @@ static void CheckGet(
   char* err = NULL;
   size_t val_len;
   char* val;
+  leveldb_pinnableslice_t* pinned;
   val = leveldb_get(db, options, key, strlen(key), &val_len, &err);
   CheckNoError(err);
   CheckEqual(expected, val, val_len);
   Free(&val);
+
+  pinned = leveldb_get_pinned(db, options, key, strlen(key), &err);
+  CheckNoError(err);
+  if (pinned == NULL) {
+    CheckEqual(expected, NULL, 0);
+  } else {
+    const char* pinned_val = leveldb_pinnableslice_value(pinned, &val_len);
+    CheckEqual(expected, pinned_val, val_len);
+    leveldb_pinnableslice_destroy(pinned);
+  }
 }
 
 static void CheckIter(leveldb_iterator_t* iter,
@@ -240,6 +251,25 @@ int main(int argc, char** argv) {
     leveldb_writebatch_destroy(wb);
   }
 
+  StartPhase("multiget");
+  {
+    const char* keys[3] = { "box", "foo", "bar" };
+    size_t keys_sizes[3] = { 3, 3, 3 };
+    char* vals[3];
+    size_t vals_sizes[3];
+    char* errs[3];
+    int i;
+    leveldb_multi_get(db, roptions, 3, keys, keys_sizes, vals, vals_sizes,
+                      errs);
+    CheckEqual("c", vals[0], vals_sizes[0]);
+    CheckEqual("hello", vals[1], vals_sizes[1]);
+    CheckEqual(NULL, vals[2], vals_sizes[2]);
+    for (i = 0; i < 3; i++) {
+      CheckNoError(errs[i]);
+      Free(&vals[i]);
+    }
+  }
+
   StartPhase("iter");
   {
     leveldb_iterator_t* iter = leveldb_create_iterator(db, roptions);
@@ -5,12 +5,16 @@
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "db/dbformat.h"
+#include "db/memtable.h"
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "table/merger.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -30,8 +34,13 @@
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
+//      multireadrandom -- read N times in random order, 100 keys per MultiGet
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
+//      mergescan     -- scan N entries spread over --merge_inputs sorted
+//                       inputs through a merging iterator, as reads and
+//                       compactions do when there are many level-0 files
+//      mergescanreverse -- same as mergescan, scanning in reverse order
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
 //      acquireload   -- load N*1000 times
@@ -95,21 +104,89 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// If true, keep the index and filter blocks of tables in the block cache,
+// where they are charged against --cache_size, instead of on the heap
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// If true, never evict the cached index and filter blocks of level-0 files
+static bool FLAGS_pin_l0_filter_and_index_blocks_in_cache = false;
+
+// Fraction of --cache_size reserved for index and filter blocks
+static double FLAGS_cache_high_pri_pool_ratio = 0.0;
+
+// Number of bytes to use as a cache of the entries found by reads.
+// Zero means no row cache.
+static int FLAGS_row_cache_size = 0;
+
+// Number of bytes iterators read ahead of each data block they read.
+// Zero means start small once reads turn out to be sequential.
+static int FLAGS_readahead_size = 0;
+
+// Number of data blocks that iterators and compactions read in the
+// background ahead of the one they are at (no prefetching if == 0)
+static int FLAGS_prefetch_blocks = 0;
+
+// If true, read table files with direct I/O, bypassing the page cache
+static bool FLAGS_use_direct_reads = false;
+
+// If true, compactions read and flushes and compactions write table files
+// with direct I/O
+static bool FLAGS_use_direct_io_for_flush_and_compaction = false;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
+// Number of sorted inputs merged by the mergescan benchmarks.  The
+// default matches a DB with a full level-0 plus the other levels.
+static int FLAGS_merge_inputs = 18;
+
+// Number of concurrent background compactions
+static int FLAGS_max_background_compactions = 1;
+
+// Number of threads a single compaction may be split across
+static int FLAGS_max_subcompactions = 1;
+
 // Bloom filter bits per key.
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Kind of filter built with --bloom_bits: "bloom" for
+// NewBloomFilterPolicy(), "blocked_bloom" for NewBlockedBloomFilterPolicy(),
+// "ribbon" for NewRibbonFilterPolicy().
+static const char* FLAGS_filter = "bloom";
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
 static bool FLAGS_use_existing_db = false;
 
+// If true, build a single bloom filter per table instead of one per 2KB
+// of data blocks
+static bool FLAGS_full_file_filter = false;
+
+// If positive, split the index of each table into partitions of about
+// this many bytes
+static int FLAGS_index_partition_size = 0;
+
+// If true, add a hash index for point lookups to each data block
+static bool FLAGS_data_block_hash_index = false;
+
+// If positive, index the first prefix_size bytes of each key in the
+// filters, and confine the seeks of seekrandom to the prefix of their
+// target
+static int FLAGS_prefix_size = 0;
+
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, overlap the log write of a writer group with the memtable
+// insert of the previous one
+static bool FLAGS_enable_pipelined_write = false;
+
+// If true, the writers of a group insert their batches into the memtable
+// in parallel
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -314,10 +391,27 @@ struct ThreadState {
 
 }  // namespace
 
+static const FilterPolicy* NewFilterPolicy() {
+  if (FLAGS_bloom_bits < 0) {
+    return nullptr;
+  } else if (strcmp(FLAGS_filter, "bloom") == 0) {
+    return NewBloomFilterPolicy(FLAGS_bloom_bits);
+  } else if (strcmp(FLAGS_filter, "blocked_bloom") == 0) {
+    return NewBlockedBloomFilterPolicy(FLAGS_bloom_bits);
+  } else if (strcmp(FLAGS_filter, "ribbon") == 0) {
+    return NewRibbonFilterPolicy(FLAGS_bloom_bits);
+  } else {
+    fprintf(stderr, "unknown filter %s\n", FLAGS_filter);
+    exit(1);
+  }
+}
+
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* row_cache_;
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
   DB* db_;
   int num_;
   int value_size_;
@@ -402,10 +496,15 @@ class Benchmark {
 
  public:
   Benchmark()
-  : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-    filter_policy_(FLAGS_bloom_bits >= 0
-                   ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                   : nullptr),
+  : cache_(FLAGS_cache_size >= 0
+             ? NewLRUCache(FLAGS_cache_size, FLAGS_cache_high_pri_pool_ratio)
+             : nullptr),
+    row_cache_(FLAGS_row_cache_size > 0 ? NewLRUCache(FLAGS_row_cache_size)
+                                        : nullptr),
+    filter_policy_(NewFilterPolicy()),
+    prefix_extractor_(FLAGS_prefix_size > 0
+                      ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                      : nullptr),
     db_(nullptr),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
@@ -427,7 +526,9 @@ class Benchmark {
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete row_cache_;
     delete filter_policy_;
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -490,10 +591,17 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        entries_per_batch_ = 100;
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
         method = &Benchmark::SeekRandom;
+      } else if (name == Slice("mergescan")) {
+        method = &Benchmark::MergeScan;
+      } else if (name == Slice("mergescanreverse")) {
+        method = &Benchmark::MergeScanReverse;
       } else if (name == Slice("readhot")) {
         method = &Benchmark::ReadHot;
       } else if (name == Slice("readrandomsmall")) {
@@ -708,12 +816,31 @@ class Benchmark {
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.row_cache = row_cache_;
+    options.cache_index_and_filter_blocks = FLAGS_cache_index_and_filter_blocks;
+    options.pin_l0_filter_and_index_blocks_in_cache =
+        FLAGS_pin_l0_filter_and_index_blocks_in_cache;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
+    options.index_partition_size = FLAGS_index_partition_size;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
     options.max_open_files = FLAGS_open_files;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    options.compaction_prefetch_blocks = FLAGS_prefetch_blocks;
+    options.use_direct_reads = FLAGS_use_direct_reads;
+    options.use_direct_compaction_reads =
+        FLAGS_use_direct_io_for_flush_and_compaction;
+    options.use_direct_io_for_flush_and_compaction =
+        FLAGS_use_direct_io_for_flush_and_compaction;
     options.filter_policy = filter_policy_;
+    options.full_file_filter = FLAGS_full_file_filter;
+    options.prefix_extractor = prefix_extractor_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -767,8 +894,35 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  uint64_t IntProperty(const char* name) {
+    std::string value;
+    db_->GetProperty(name, &value);
+    return strtoull(value.c_str(), nullptr, 10);
+  }
+
+  // Reports the readahead of the scans that ran since the
+  // "leveldb.readahead-bytes-read" property was "read_before" and the
+  // "leveldb.readahead-bytes-used" property was "used_before".
+  void AddReadaheadMessage(ThreadState* thread, uint64_t read_before,
+                           uint64_t used_before) {
+    const uint64_t read = IntProperty("leveldb.readahead-bytes-read");
+    const uint64_t used = IntProperty("leveldb.readahead-bytes-used");
+    if (read > read_before) {
+      char msg[100];
+      snprintf(msg, sizeof(msg), "(readahead %.1f MB, %.1f MB used)",
+               (read - read_before) / 1048576.0,
+               (used - used_before) / 1048576.0);
+      thread->stats.AddMessage(msg);
+    }
+  }
+
   void ReadSequential(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    options.prefetch_blocks = FLAGS_prefetch_blocks;
+    const uint64_t read_before = IntProperty("leveldb.readahead-bytes-read");
+    const uint64_t used_before = IntProperty("leveldb.readahead-bytes-used");
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
@@ -778,10 +932,14 @@ class Benchmark {
     }
     delete iter;
     thread->stats.AddBytes(bytes);
+    AddReadaheadMessage(thread, read_before, used_before);
   }
 
   void ReadReverse(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    options.prefetch_blocks = FLAGS_prefetch_blocks;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToLast(); i < reads_ && iter->Valid(); iter->Prev()) {
@@ -811,6 +969,34 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<std::string> key_storage(entries_per_batch_);
+    std::vector<Slice> keys(entries_per_batch_);
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    int found = 0;
+    for (int i = 0; i < reads_; i += entries_per_batch_) {
+      for (int j = 0; j < entries_per_batch_; j++) {
+        char key[100];
+        const int k = thread->rand.Next() % FLAGS_num;
+        snprintf(key, sizeof(key), "%016d", k);
+        key_storage[j] = key;
+        keys[j] = key_storage[j];
+      }
+      db_->MultiGet(options, keys, &values, &statuses);
+      for (int j = 0; j < entries_per_batch_; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -838,6 +1024,7 @@ class Benchmark {
 
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
+    options.prefix_same_as_start = (prefix_extractor_ != nullptr);
     int found = 0;
     for (int i = 0; i < reads_; i++) {
       Iterator* iter = db_->NewIterator(options);
@@ -854,6 +1041,65 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MergeScan(ThreadState* thread) {
+    DoMergeScan(thread, false);
+  }
+
+  void MergeScanReverse(ThreadState* thread) {
+    DoMergeScan(thread, true);
+  }
+
+  void DoMergeScan(ThreadState* thread, bool reverse) {
+    // Spread num_ entries randomly over the inputs so that consecutive
+    // keys come from different inputs, like overlapping level-0 files.
+    InternalKeyComparator icmp(BytewiseComparator());
+    const int num_inputs = std::max(FLAGS_merge_inputs, 1);
+    std::vector<MemTable*> mems;
+    for (int i = 0; i < num_inputs; i++) {
+      mems.push_back(new MemTable(icmp));
+      mems.back()->Ref();
+    }
+    RandomGenerator gen;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%016d", i);
+      mems[thread->rand.Next() % num_inputs]->Add(
+          i + 1, kTypeValue, key, gen.Generate(value_size_));
+    }
+    std::vector<Iterator*> children;
+    for (int i = 0; i < num_inputs; i++) {
+      children.push_back(mems[i]->NewIterator());
+    }
+    Iterator* iter = NewMergingIterator(&icmp, &children[0], num_inputs);
+
+    // Do not count the time spent building the inputs
+    thread->stats.Start();
+    int64_t bytes = 0;
+    for (int i = 0; i < reads_; i++) {
+      if (!iter->Valid()) {
+        if (reverse) {
+          iter->SeekToLast();
+        } else {
+          iter->SeekToFirst();
+        }
+        if (!iter->Valid()) break;
+      }
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+      if (reverse) {
+        iter->Prev();
+      } else {
+        iter->Next();
+      }
+    }
+    thread->stats.AddBytes(bytes);
+
+    delete iter;
+    for (int i = 0; i < num_inputs; i++) {
+      mems[i]->Unref();
+    }
+  }
+
   void DoDelete(ThreadState* thread, bool seq) {
     RandomGenerator gen;
     WriteBatch batch;
@@ -954,6 +1200,9 @@ int main(int argc, char** argv) {
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_max_background_compactions =
+      leveldb::Options().max_background_compactions;
+  FLAGS_max_subcompactions = leveldb::Options().max_subcompactions;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
@@ -973,6 +1222,12 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -989,10 +1244,52 @@ int main(int argc, char** argv) {
       FLAGS_block_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--row_cache_size=%d%c", &n, &junk) == 1) {
+      FLAGS_row_cache_size = n;
+    } else if (sscanf(argv[i], "--readahead_size=%d%c", &n, &junk) == 1) {
+      FLAGS_readahead_size = n;
+    } else if (sscanf(argv[i], "--prefetch_blocks=%d%c", &n, &junk) == 1) {
+      FLAGS_prefetch_blocks = n;
+    } else if (sscanf(argv[i], "--use_direct_reads=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_direct_reads = n;
+    } else if (sscanf(argv[i], "--use_direct_io_for_flush_and_compaction=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_use_direct_io_for_flush_and_compaction = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i],
+                      "--pin_l0_filter_and_index_blocks_in_cache=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_pin_l0_filter_and_index_blocks_in_cache = n;
+    } else if (sscanf(argv[i], "--cache_high_pri_pool_ratio=%lf%c",
+                      &d, &junk) == 1 && d >= 0 && d <= 1) {
+      FLAGS_cache_high_pri_pool_ratio = d;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--full_file_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_file_filter = n;
+    } else if (sscanf(argv[i], "--index_partition_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_index_partition_size = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--merge_inputs=%d%c", &n, &junk) == 1) {
+      FLAGS_merge_inputs = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
+    } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+      FLAGS_filter = argv[i] + 9;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
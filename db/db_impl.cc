@@ -19,6 +19,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -34,6 +35,7 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/thread_local.h"
 
 namespace leveldb {
 
@@ -47,9 +49,75 @@ struct DBImpl::Writer {
   bool done;
   port::CondVar cv;
 
-  explicit Writer(port::Mutex* mu) : cv(mu) { }
+  // Set by the leader of the group when this writer should apply its
+  // own batch to parallel->mem (options_.allow_concurrent_memtable_write)
+  bool insert_own_batch;
+  ParallelInsert* parallel;
+
+  explicit Writer(port::Mutex* mu)
+      : cv(mu), insert_own_batch(false), parallel(nullptr) { }
+};
+
+// State shared by the writers of a group that apply their batches to the
+// memtable in parallel
+struct DBImpl::ParallelInsert {
+  MemTable* mem;
+  Writer* leader;
+  int pending;    // Number of writers other than the leader still inserting
+  Status status;  // First error of those writers
+};
+
+// A group of writers that has been appended to the log and still has to
+// be applied to the memtable
+struct DBImpl::MemTableGroup {
+  std::vector<Writer*> writers;  // In log order; the first one is the leader
+  SequenceNumber last_sequence;  // Of the last write in the group
+  Status status;                 // Result of the log write
 };
 
+// The memtables and version a read has to consult.  Readers hold a
+// reference to the SuperVersion instead of to its parts, so that they do
+// not need mutex_ to take or drop one.  Each SuperVersion holds a
+// reference to mem, imm and current, which are only released with
+// mutex_ held.
+struct DBImpl::SuperVersion {
+  MemTable* const mem;
+  MemTable* const imm;  // May be nullptr
+  Version* const current;
+
+  SuperVersion(MemTable* m, MemTable* i, Version* v)
+      : mem(m), imm(i), current(v), refs_(1) { }
+
+  void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Returns true iff the last reference was dropped
+  bool Unref() { return refs_.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+ private:
+  std::atomic<int> refs_;
+};
+
+namespace {
+
+// Stored in the thread-local cache while its SuperVersion is being used
+// by the owning thread.  A nullptr entry means there is nothing cached.
+char sv_in_use_marker;
+void* const kSVInUse = &sv_in_use_marker;
+
+}  // anonymous namespace
+
+// Runs when a thread that still caches a SuperVersion exits.  The cached
+// SuperVersion is always the DB's current one, which the DB holds a
+// reference to as well, so this is never the last reference.
+void DBImpl::ReleaseCachedSuperVersion(void* ptr) {
+  if (ptr != kSVInUse) {
+    SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+    const bool last = sv->Unref();
+    assert(!last);
+    (void)last;
+  }
+}
+
 struct DBImpl::CompactionState {
   Compaction* const compaction;
 
@@ -64,6 +132,7 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_deletions;
   };
   std::vector<Output> outputs;
 
@@ -73,16 +142,57 @@ struct DBImpl::CompactionState {
 
   uint64_t total_bytes;
 
+  // Only input keys with user keys in [begin,end) are compacted using
+  // this state; an unset bound means the range is unbounded on that
+  // side.  Each subcompaction has a state of its own.
+  bool has_begin, has_end;
+  std::string begin, end;
+
+  // Position of this state's pass over the compaction input
+  Compaction::Cursor cursor;
+
+  // Range tombstones of the inputs, shared by all subcompactions.  The
+  // entries deleted by a tombstone in "range_del", which holds the ones
+  // visible to every snapshot, are dropped.  "range_tombstones" are the
+  // tombstones that are still needed, sorted by begin key; each output
+  // gets the parts of them that fall into its key range.
+  const RangeDelMap* range_del;
+  const std::vector<RangeTombstone>* range_tombstones;
+
+  // User key at which the key range of the next output starts; unset if
+  // the range is unbounded.  Ranges of consecutive outputs meet, so no
+  // part of a tombstone gets lost between them.
+  bool has_output_begin;
+  std::string output_begin;
+
   Output* current_output() { return &outputs[outputs.size()-1]; }
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
         outfile(nullptr),
         builder(nullptr),
-        total_bytes(0) {
+        total_bytes(0),
+        has_begin(false),
+        has_end(false),
+        range_del(nullptr),
+        range_tombstones(nullptr),
+        has_output_begin(false) {
   }
 };
 
+// A subcompaction run on a thread of its own
+struct DBImpl::SubcompactionJob {
+  DBImpl* db;
+  CompactionState* compact;
+  Status status;
+  int64_t imm_micros;  // Micros spent doing imm_ compactions
+
+  // Shared by all jobs of a compaction to wait for their completion
+  port::Mutex* mu;
+  port::CondVar* cv;
+  int* remaining GUARDED_BY(mu);
+};
+
 // Fix user-supplied options to be reasonable
 template <class T, class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -100,6 +210,14 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
   ClipToRange(&result.max_file_size,     1<<20,                       1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.max_background_compactions, 1,                  64);
+  ClipToRange(&result.max_subcompactions, 1,                          64);
+  ClipToRange(&result.compaction_prefetch_blocks, 0,                  64);
+  ClipToRange(&result.delayed_write_rate, 16<<10,                     1<<30);
+  if (src.comparator != BytewiseComparator()) {
+    // The hash index of data blocks compares user keys by their bytes
+    result.data_block_hash_index = false;
+  }
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -124,7 +242,8 @@ static int TableCacheSize(const Options& sanitized_options) {
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
@@ -140,23 +259,42 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
+      super_version_(nullptr),
+      local_sv_(new ThreadLocalPtr(&DBImpl::ReleaseCachedSuperVersion)),
+      memtable_writers_signal_(&mutex_),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      background_compactions_scheduled_(0),
+      background_flush_scheduled_(false),
+      compacting_memtable_(false),
+      write_controller_(options_.delayed_write_rate),
+      stall_micros_(0),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
                                &internal_comparator_)) {
   has_imm_.Release_Store(nullptr);
+  env_->SetBackgroundThreads(options_.max_background_compactions, Env::LOW);
+  env_->SetBackgroundThreads(1, Env::HIGH);
 }
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-null value is ok
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 ||
+         background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
 
+  // Drop the references cached by other threads before the last one
+  delete local_sv_;
+  mutex_.Lock();
+  if (super_version_ != nullptr && super_version_->Unref()) {
+    CleanupSuperVersion(super_version_);
+  }
+  super_version_ = nullptr;
+  mutex_.Unlock();
+
   if (db_lock_ != nullptr) {
     env_->UnlockFile(db_lock_);
   }
@@ -491,20 +629,22 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t* pending_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                   range_del_iter, &meta);
     mutex_.Lock();
   }
 
@@ -513,8 +653,14 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
-
+  delete range_del_iter;
+  if (base == nullptr) {
+    pending_outputs_.erase(meta.number);
+  } else {
+    // Another background thread may run DeleteObsoleteFiles() before the
+    // caller has installed the new table, so keep it protected until then.
+    *pending_number = meta.number;
+  }
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -526,7 +672,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
     edit->AddFile(level, meta.number, meta.file_size,
-                  meta.smallest, meta.largest);
+                  meta.smallest, meta.largest, meta.has_range_deletions);
   }
 
   CompactionStats stats;
@@ -539,12 +685,15 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != nullptr);
+  assert(!compacting_memtable_);
+  compacting_memtable_ = true;
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t pending_number = 0;
+  Status s = WriteLevel0Table(imm_, &edit, base, &pending_number);
   base->Unref();
 
   if (s.ok() && shutting_down_.Acquire_Load()) {
@@ -557,12 +706,15 @@ void DBImpl::CompactMemTable() {
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
     s = versions_->LogAndApply(&edit, &mutex_);
   }
+  pending_outputs_.erase(pending_number);
+  compacting_memtable_ = false;
 
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
     imm_ = nullptr;
     has_imm_.Release_Store(nullptr);
+    InstallSuperVersion();
     DeleteObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -586,6 +738,72 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
+Status DBImpl::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  InternalKey begin_storage, end_storage;
+  const InternalKey* begin_key = nullptr;
+  const InternalKey* end_key = nullptr;
+  if (begin != nullptr) {
+    begin_storage = InternalKey(*begin, kMaxSequenceNumber, kValueTypeForSeek);
+    begin_key = &begin_storage;
+  }
+  if (end != nullptr) {
+    end_storage = InternalKey(*end, 0, static_cast<ValueType>(0));
+    end_key = &end_storage;
+  }
+
+  MutexLock l(&mutex_);
+  if (!bg_error_.ok()) {
+    return bg_error_;
+  }
+
+  // Level-0 files hold the most recent writes, which live snapshots are
+  // the most likely to read, so they are only deleted if there are none.
+  const int first_level = snapshots_.empty() ? 0 : 1;
+  Version* base = versions_->current();
+  VersionEdit edit;
+  std::vector<FileMetaData*> deleted;
+  for (int level = first_level; level < config::kNumLevels; level++) {
+    std::vector<FileMetaData*> files;
+    base->GetOverlappingInputs(level, begin_key, end_key, &files);
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      if (f->being_compacted ||
+          (begin != nullptr &&
+           user_comparator()->Compare(f->smallest.user_key(), *begin) < 0) ||
+          (end != nullptr &&
+           user_comparator()->Compare(f->largest.user_key(), *end) > 0)) {
+        continue;
+      }
+      edit.DeleteFile(level, f->number);
+      deleted.push_back(f);
+    }
+  }
+  if (deleted.empty()) {
+    return Status::OK();
+  }
+
+  // LogAndApply() releases the mutex; keep compactions from picking the
+  // files in the meantime.
+  for (size_t i = 0; i < deleted.size(); i++) {
+    deleted[i]->being_compacted = true;
+  }
+  base->Ref();
+  Status s = versions_->LogAndApply(&edit, &mutex_);
+  for (size_t i = 0; i < deleted.size(); i++) {
+    deleted[i]->being_compacted = false;
+  }
+  base->Unref();
+  if (s.ok()) {
+    Log(options_.info_log, "Deleted %d files in range",
+        static_cast<int>(deleted.size()));
+    InstallSuperVersion();
+    DeleteObsoleteFiles();
+  } else {
+    RecordBackgroundError(s);
+  }
+  return s;
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
                                const Slice* end) {
   assert(level >= 0);
@@ -596,6 +814,7 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
   ManualCompaction manual;
   manual.level = level;
   manual.done = false;
+  manual.in_progress = false;
   if (begin == nullptr) {
     manual.begin = nullptr;
   } else {
@@ -650,20 +869,54 @@ void DBImpl::RecordBackgroundError(const Status& s) {
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.Acquire_Load()) {
+  if (shutting_down_.Acquire_Load()) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr &&
-             manual_compaction_ == nullptr &&
+    return;
+  }
+
+  // Memtable flushes go to the HIGH priority pool so that writers waiting
+  // in MakeRoomForWrite() never queue behind a long running compaction.
+  if (imm_ != nullptr && !background_flush_scheduled_) {
+    background_flush_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGWorkFlush, this, Env::HIGH);
+  }
+
+  if (background_compactions_scheduled_ >=
+      options_.max_background_compactions) {
+    // Already scheduled as many as allowed
+  } else if (manual_compaction_ == nullptr &&
              !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    background_compactions_scheduled_++;
+    env_->Schedule(&DBImpl::BGWork, this, Env::LOW);
+  }
+}
+
+void DBImpl::BGWorkFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.Acquire_Load()) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr && !compacting_memtable_) {
+    CompactMemTable();
   }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a compaction, and a writer may
+  // have switched to a new memtable while this flush was running.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
 }
 
 void DBImpl::BGWork(void* db) {
@@ -672,36 +925,43 @@ void DBImpl::BGWork(void* db) {
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool did_work = false;
   if (shutting_down_.Acquire_Load()) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    did_work = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  If this call found
+  // nothing to do, whatever it was waiting on is held by some other
+  // background compaction, which will reschedule when it finishes.
+  if (did_work) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
-  }
-
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
+    if (m->in_progress || versions_->NumRunningCompactions() > 0) {
+      // Manual compactions run by themselves.  Do not start anything new
+      // so that running compactions drain; the last one to finish will
+      // schedule the manual compaction.
+      return false;
+    }
+    m->in_progress = true;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
     if (c != nullptr) {
@@ -718,6 +978,7 @@ void DBImpl::BackgroundCompaction() {
   }
 
   Status status;
+  const bool did_work = (c != nullptr || is_manual);
   if (c == nullptr) {
     // Nothing to do
   } else if (!is_manual && c->IsTrivialMove()) {
@@ -726,9 +987,11 @@ void DBImpl::BackgroundCompaction() {
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
+                       f->smallest, f->largest, f->has_range_deletions);
     status = versions_->LogAndApply(c->edit(), &mutex_);
-    if (!status.ok()) {
+    if (status.ok()) {
+      InstallSuperVersion();
+    } else {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
@@ -770,8 +1033,10 @@ void DBImpl::BackgroundCompaction() {
       m->tmp_storage = manual_end;
       m->begin = &m->tmp_storage;
     }
+    m->in_progress = false;
     manual_compaction_ = nullptr;
   }
+  return did_work;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -803,38 +1068,96 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_deletions = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s;
+  if (options_.use_direct_io_for_flush_and_compaction) {
+    s = env_->NewDirectWritableFile(fname, &compact->outfile);
+  } else {
+    s = env_->NewWritableFile(fname, &compact->outfile);
+  }
   if (s.ok()) {
     compact->builder = new TableBuilder(options_, compact->outfile);
   }
   return s;
 }
 
+// Store in *result the parts of "tombstones" that fall into the user key
+// range [*begin,*end); a null bound means the range is unbounded on that
+// side.  The result is sorted by internal key.
+static void ClipRangeTombstones(const Comparator* ucmp,
+                                const std::vector<RangeTombstone>& tombstones,
+                                const std::string* begin, const Slice* end,
+                                std::vector<RangeTombstone>* result) {
+  result->clear();
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    const RangeTombstone& t = tombstones[i];
+    if (end != nullptr && ucmp->Compare(t.begin, *end) >= 0) {
+      break;  // This and all later tombstones start after the range
+    }
+    Slice b = t.begin;
+    Slice e = t.end;
+    if (begin != nullptr && ucmp->Compare(b, *begin) < 0) {
+      b = *begin;
+    }
+    if (end != nullptr && ucmp->Compare(e, *end) > 0) {
+      e = *end;
+    }
+    if (ucmp->Compare(b, e) < 0) {
+      result->push_back(RangeTombstone(b, e, t.seq));
+    }
+  }
+  RangeTombstoneLess less = { ucmp };
+  std::sort(result->begin(), result->end(), less);
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* output_end) {
   assert(compact != nullptr);
   assert(compact->outfile != nullptr);
   assert(compact->builder != nullptr);
 
-  const uint64_t output_number = compact->current_output()->number;
+  CompactionState::Output* out = compact->current_output();
+  const uint64_t output_number = out->number;
   assert(output_number != 0);
 
+  // Add the tombstones that cover keys of this output
+  if (compact->range_tombstones != nullptr) {
+    std::vector<RangeTombstone> tombstones;
+    ClipRangeTombstones(
+        user_comparator(), *compact->range_tombstones,
+        compact->has_output_begin ? &compact->output_begin : nullptr,
+        output_end, &tombstones);
+    bool has_range = (compact->builder->NumEntries() > 0);
+    for (size_t i = 0; i < tombstones.size(); i++) {
+      AddRangeTombstoneToTable(&internal_comparator_, tombstones[i],
+                               compact->builder, &out->smallest,
+                               &out->largest, &has_range);
+      out->has_range_deletions = true;
+    }
+  }
+  if (output_end != nullptr) {
+    compact->has_output_begin = true;
+    compact->output_begin = output_end->ToString();
+  }
+
   // Check for iterator errors
   Status s = input->status();
-  const uint64_t current_entries = compact->builder->NumEntries();
+  const uint64_t current_entries = compact->builder->NumEntries() +
+                                   compact->builder->NumRangeDeletions();
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
     compact->builder->Abandon();
   }
   const uint64_t current_bytes = compact->builder->FileSize();
-  compact->current_output()->file_size = current_bytes;
+  out->file_size = current_bytes;
   compact->total_bytes += current_bytes;
   delete compact->builder;
   compact->builder = nullptr;
@@ -885,9 +1208,87 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(
         level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
+        out.number, out.file_size, out.smallest, out.largest,
+        out.has_range_deletions);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  Status s = versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  if (s.ok()) {
+    InstallSuperVersion();
+  }
+  return s;
+}
+
+// Append the range tombstones of the "which" inputs of "c" to *list.
+static Status CollectInputTombstones(TableCache* table_cache, Compaction* c,
+                                     int which,
+                                     std::vector<RangeTombstone>* list) {
+  Status s;
+  for (int i = 0; s.ok() && i < c->num_input_files(which); i++) {
+    const FileMetaData* f = c->input(which, i);
+    if (f->has_range_deletions) {
+      Iterator* iter = table_cache->NewRangeDeletionIterator(f->number,
+                                                             f->file_size);
+      s = CollectRangeTombstones(iter, list);
+      delete iter;
+    }
+  }
+  return s;
+}
+
+Status DBImpl::PrepareRangeTombstones(CompactionState* compact,
+                                      RangeDelMap* range_del,
+                                      std::vector<RangeTombstone>* tombstones) {
+  Compaction* c = compact->compaction;
+  Status s = CollectInputTombstones(table_cache_, c, 0, tombstones);
+  if (!s.ok()) {
+    return s;
+  }
+
+  if (!tombstones->empty() && c->num_input_files(1) > 0) {
+    // "level+1" inputs that are entirely covered by tombstones from
+    // "level" hold nothing any snapshot can see, so there is no need to
+    // read them.
+    RangeDelMap covering(user_comparator());
+    for (size_t i = 0; i < tombstones->size(); i++) {
+      const RangeTombstone& t = (*tombstones)[i];
+      if (t.seq <= compact->smallest_snapshot) {
+        covering.Add(t.begin, t.end, t.seq);
+      }
+    }
+    covering.Finish();
+    if (!covering.empty()) {
+      mutex_.Lock();
+      const int dropped = c->DropCoveredInputs(covering);
+      mutex_.Unlock();
+      if (dropped > 0) {
+        Log(options_.info_log, "Dropping %d files deleted by range tombstones",
+            dropped);
+      }
+    }
+  }
+
+  s = CollectInputTombstones(table_cache_, c, 1, tombstones);
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::vector<RangeTombstone> kept;
+  for (size_t i = 0; i < tombstones->size(); i++) {
+    const RangeTombstone& t = (*tombstones)[i];
+    if (t.seq <= compact->smallest_snapshot) {
+      range_del->Add(t.begin, t.end, t.seq);
+      if (c->IsBaseLevelForRange(t.begin, t.end)) {
+        // No entry in the levels below can be covered by the tombstone
+        continue;
+      }
+    }
+    kept.push_back(t);
+  }
+  range_del->Finish();
+  RangeTombstoneLess less = { user_comparator() };
+  std::sort(kept.begin(), kept.end(), less);
+  tombstones->swap(kept);
+  return s;
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
@@ -912,31 +1313,179 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
+  RangeDelMap range_del(user_comparator());
+  std::vector<RangeTombstone> range_tombstones;
+  Status status = PrepareRangeTombstones(compact, &range_del,
+                                         &range_tombstones);
+  if (!range_del.empty()) {
+    compact->range_del = &range_del;
+  }
+  if (!range_tombstones.empty()) {
+    compact->range_tombstones = &range_tombstones;
+  }
+
+  std::vector<std::string> boundaries;
+  versions_->GetSubcompactionBoundaries(
+      compact->compaction, options_.max_subcompactions, &boundaries);
+  if (!status.ok()) {
+    // Skip the compaction
+  } else if (boundaries.empty()) {
+    status = DoCompactionRange(compact, &imm_micros);
+  } else {
+    status = DoSubcompactions(compact, boundaries, &imm_micros);
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  mutex_.Lock();
+  stats_[compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log,
+      "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+Status DBImpl::DoSubcompactions(CompactionState* compact,
+                                const std::vector<std::string>& boundaries,
+                                int64_t* imm_micros) {
+  const size_t n = boundaries.size() + 1;
+  Log(options_.info_log, "Splitting compaction into %d subcompactions",
+      static_cast<int>(n));
+
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  int remaining = n - 1;
+  std::vector<SubcompactionJob> jobs(n);
+  for (size_t i = 0; i < n; i++) {
+    CompactionState* sub = new CompactionState(compact->compaction);
+    sub->smallest_snapshot = compact->smallest_snapshot;
+    sub->range_del = compact->range_del;
+    sub->range_tombstones = compact->range_tombstones;
+    if (i > 0) {
+      sub->has_begin = true;
+      sub->begin = boundaries[i - 1];
+    }
+    if (i + 1 < n) {
+      sub->has_end = true;
+      sub->end = boundaries[i];
+    }
+    jobs[i].db = this;
+    jobs[i].compact = sub;
+    jobs[i].imm_micros = 0;
+    jobs[i].mu = &mu;
+    jobs[i].cv = &cv;
+    jobs[i].remaining = &remaining;
+  }
+
+  // The first range is compacted by this thread, the others each get a
+  // new thread.  Threads from the Env's pool are not used since they may
+  // all be busy running the compactions that are waiting on these.
+  for (size_t i = 1; i < n; i++) {
+    env_->StartThread(&DBImpl::BGWorkSubcompaction, &jobs[i]);
+  }
+  jobs[0].status = DoCompactionRange(jobs[0].compact, &jobs[0].imm_micros);
+  {
+    MutexLock l(&mu);
+    while (remaining > 0) {
+      cv.Wait();
+    }
+  }
+
+  // The ranges are disjoint and ordered, so appending their outputs in
+  // order keeps compact->outputs sorted.
+  Status status;
+  for (size_t i = 0; i < n; i++) {
+    CompactionState* sub = jobs[i].compact;
+    if (status.ok()) {
+      status = jobs[i].status;
+    }
+    if (sub->builder != nullptr) {
+      sub->builder->Abandon();
+      delete sub->builder;
+    }
+    delete sub->outfile;
+    compact->outputs.insert(compact->outputs.end(),
+                            sub->outputs.begin(), sub->outputs.end());
+    compact->total_bytes += sub->total_bytes;
+    *imm_micros = std::max(*imm_micros, jobs[i].imm_micros);
+    delete sub;
+  }
+  return status;
+}
+
+void DBImpl::BGWorkSubcompaction(void* arg) {
+  SubcompactionJob* job = reinterpret_cast<SubcompactionJob*>(arg);
+  job->status = job->db->DoCompactionRange(job->compact, &job->imm_micros);
+  MutexLock l(job->mu);
+  (*job->remaining)--;
+  job->cv->SignalAll();
+}
+
+Status DBImpl::DoCompactionRange(CompactionState* compact,
+                                 int64_t* imm_micros) {
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
+  if (compact->has_begin) {
+    InternalKey begin(compact->begin, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(begin.Encode());
+  } else {
+    input->SeekToFirst();
+  }
+  compact->has_output_begin = compact->has_begin;
+  compact->output_begin = compact->begin;
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
-    // Prioritize immutable compaction work
+    // Prioritize immutable compaction work, in case the flush is still
+    // queued behind other work in an Env without separate priorities.
     if (has_imm_.NoBarrier_Load() != nullptr) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (imm_ != nullptr && !compacting_memtable_) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      *imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
+    if (compact->has_end && key.size() >= 8 &&
+        user_comparator()->Compare(ExtractUserKey(key),
+                                   Slice(compact->end)) >= 0) {
+      // Reached the part of the input handled by the next subcompaction
+      break;
+    }
+    // Close the current output before "key" if it is big enough or would
+    // overlap too many grandparent files.  This is decided here rather
+    // than right after the last key was added so that the output's range
+    // tombstones can be cut at "key".
+    const bool stop =
+        compact->compaction->ShouldStopBefore(key, &compact->cursor);
+    if (compact->builder != nullptr &&
+        (stop || compact->builder->FileSize() >=
+                     compact->compaction->MaxOutputFileSize())) {
+      const Slice output_end = (key.size() >= 8) ? ExtractUserKey(key) : key;
+      status = FinishCompactionOutputFile(compact, input, &output_end);
       if (!status.ok()) {
         break;
       }
@@ -962,9 +1511,14 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;    // (A)
+      } else if (compact->range_del != nullptr &&
+                 compact->range_del->ShouldDelete(ikey)) {
+        // Deleted by a range tombstone that every snapshot can see
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -983,7 +1537,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -1000,15 +1555,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       }
       compact->current_output()->largest.DecodeFrom(key);
       compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
-      }
     }
 
     input->Next();
@@ -1017,96 +1563,199 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.Acquire_Load()) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  const Slice end(compact->end);
+  const Slice* output_end = compact->has_end ? &end : nullptr;
+  if (status.ok() && compact->builder == nullptr &&
+      compact->range_tombstones != nullptr) {
+    // The remaining tombstones still need an output even if no entry
+    // after them survived.
+    std::vector<RangeTombstone> tombstones;
+    ClipRangeTombstones(
+        user_comparator(), *compact->range_tombstones,
+        compact->has_output_begin ? &compact->output_begin : nullptr,
+        output_end, &tombstones);
+    if (!tombstones.empty()) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, output_end);
   }
   if (status.ok()) {
     status = input->status();
   }
   delete input;
   input = nullptr;
+  return status;
+}
 
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
+void DBImpl::CleanupSuperVersion(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  sv->mem->Unref();
+  if (sv->imm != nullptr) sv->imm->Unref();
+  sv->current->Unref();
+  delete sv;
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+  if (sv->Unref()) {
+    MutexLock l(&mutex_);
+    CleanupSuperVersion(sv);
   }
+}
 
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+void DBImpl::UnrefSuperVersionIterator(void* db, void* sv) {
+  reinterpret_cast<DBImpl*>(db)->UnrefSuperVersion(
+      reinterpret_cast<SuperVersion*>(sv));
+}
 
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  mem_->Ref();
+  if (imm_ != nullptr) imm_->Ref();
+  versions_->current()->Ref();
+  SuperVersion* old = super_version_;
+  super_version_ = new SuperVersion(mem_, imm_, versions_->current());
+
+  // Invalidate the thread-local caches while "old" is still referenced
+  // by us, so that a thread exiting concurrently never drops the last
+  // reference.  Threads using their cached SuperVersion right now keep
+  // it and release it themselves.
+  std::vector<void*> cached;
+  local_sv_->Scrape(&cached, nullptr);
+  for (size_t i = 0; i < cached.size(); i++) {
+    if (cached[i] != kSVInUse) {
+      SuperVersion* sv = reinterpret_cast<SuperVersion*>(cached[i]);
+      if (sv->Unref()) {
+        CleanupSuperVersion(sv);
+      }
+    }
   }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
+  if (old != nullptr && old->Unref()) {
+    CleanupSuperVersion(old);
   }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log,
-      "compacted to: %s", versions_->LevelSummary(&tmp));
-  return status;
 }
 
-namespace {
+DBImpl::SuperVersion* DBImpl::GetAndRefSuperVersion() {
+  // The cached SuperVersion, if any, carries a reference of its own that
+  // is lent to the caller until ReturnAndCleanupSuperVersion().
+  void* ptr = local_sv_->Swap(kSVInUse);
+  assert(ptr != kSVInUse);
+  SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+  if (sv == nullptr) {
+    MutexLock l(&mutex_);
+    sv = super_version_;
+    sv->Ref();
+  }
+  return sv;
+}
 
-struct IterState {
-  port::Mutex* const mu;
-  Version* const version GUARDED_BY(mu);
-  MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+void DBImpl::ReturnAndCleanupSuperVersion(SuperVersion* sv) {
+  // Keep "sv" cached unless InstallSuperVersion() has scraped the cache
+  // while it was in use.
+  if (!local_sv_->CompareAndSwap(kSVInUse, sv)) {
+    UnrefSuperVersion(sv);
+  }
+}
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) { }
+// The iterate bounds of a ReadOptions as internal keys, which is how the
+// iterators below the DBIter compare them.  Each bound is the first
+// internal key of its user key.
+namespace {
+struct InternalBounds {
+  InternalKey lower;
+  InternalKey upper;
+  Slice lower_slice;
+  Slice upper_slice;
 };
+}  // anonymous namespace
 
-static void CleanupIteratorState(void* arg1, void* arg2) {
-  IterState* state = reinterpret_cast<IterState*>(arg1);
-  state->mu->Lock();
-  state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
-  state->version->Unref();
-  state->mu->Unlock();
-  delete state;
+static void DeleteInternalBounds(void* arg, void* ignored) {
+  delete reinterpret_cast<InternalBounds*>(arg);
 }
 
-}  // anonymous namespace
-
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
-  mutex_.Lock();
+                                      uint32_t* seed,
+                                      RangeDelMap** range_del) {
+  SuperVersion* sv = GetAndRefSuperVersion();
   *latest_snapshot = versions_->LastSequence();
 
+  ReadOptions version_options = options;
+  InternalBounds* bounds = nullptr;
+  if (options.iterate_lower_bound != nullptr ||
+      options.iterate_upper_bound != nullptr) {
+    bounds = new InternalBounds;
+    if (options.iterate_lower_bound != nullptr) {
+      bounds->lower = InternalKey(*options.iterate_lower_bound,
+                                  kMaxSequenceNumber, kValueTypeForSeek);
+      bounds->lower_slice = bounds->lower.Encode();
+      version_options.iterate_lower_bound = &bounds->lower_slice;
+    }
+    if (options.iterate_upper_bound != nullptr) {
+      bounds->upper = InternalKey(*options.iterate_upper_bound,
+                                  kMaxSequenceNumber, kValueTypeForSeek);
+      bounds->upper_slice = bounds->upper.Encode();
+      version_options.iterate_upper_bound = &bounds->upper_slice;
+    }
+  }
+
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  list.push_back(sv->mem->NewIterator());
+  if (sv->imm != nullptr) {
+    list.push_back(sv->imm->NewIterator());
   }
-  versions_->current()->AddIterators(options, &list);
+  sv->current->AddIterators(version_options, &list);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
-
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
-  internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
-
-  *seed = ++seed_;
-  mutex_.Unlock();
+  sv->Ref();
+  internal_iter->RegisterCleanup(&DBImpl::UnrefSuperVersionIterator, this, sv);
+  if (bounds != nullptr) {
+    // The table iterators keep pointing at the bounds
+    internal_iter->RegisterCleanup(&DeleteInternalBounds, bounds, nullptr);
+  }
+
+  *seed = seed_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+  if (range_del != nullptr) {
+    const SequenceNumber snapshot =
+        (options.snapshot != nullptr
+         ? static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number()
+         : *latest_snapshot);
+    RangeDelMap* map = new RangeDelMap(user_comparator());
+    Status s;
+    MemTable* tables[2] = { sv->mem, sv->imm };
+    for (int i = 0; i < 2 && s.ok(); i++) {
+      if (tables[i] != nullptr && tables[i]->HasRangeTombstones()) {
+        Iterator* iter = tables[i]->NewRangeTombstoneIterator();
+        s = map->AddTombstones(iter, snapshot);
+        delete iter;
+      }
+    }
+    if (s.ok()) {
+      s = sv->current->AddRangeTombstones(snapshot, map);
+    }
+    map->Finish();
+    if (!s.ok() || map->empty()) {
+      delete map;
+      map = nullptr;
+    }
+    if (!s.ok()) {
+      delete internal_iter;
+      ReturnAndCleanupSuperVersion(sv);
+      return NewErrorIterator(s);
+    }
+    *range_del = map;
+  }
+  ReturnAndCleanupSuperVersion(sv);
   return internal_iter;
 }
 
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
   uint32_t ignored_seed;
-  return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed);
+  return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed, nullptr);
 }
 
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
@@ -1117,8 +1766,20 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
+  PinnableSlice pinned;
+  Status s = GetPinned(options, key, &pinned);
+  if (s.ok()) {
+    value->assign(pinned.data(), pinned.size());
+  }
+  return s;
+}
+
+Status DBImpl::GetPinned(const ReadOptions& options,
+                         const Slice& key,
+                         PinnableSlice* value) {
   Status s;
-  MutexLock l(&mutex_);
+  value->Reset();
+  SuperVersion* sv = GetAndRefSuperVersion();
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
@@ -1127,51 +1788,151 @@ Status DBImpl::Get(const ReadOptions& options,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
-
-  bool have_stat_update = false;
   Version::GetStats stats;
+  stats.seek_file = nullptr;
+
+  // First look in the memtable, then in the immutable memtable (if any).
+  // A value found in either is pinned along with a reference to "sv",
+  // which keeps the memtable alive.
+  LookupKey lkey(key, snapshot);
+  Slice v;
+  if (sv->mem->Get(lkey, &v, &s) ||
+      (sv->imm != nullptr && sv->imm->Get(lkey, &v, &s))) {
+    if (s.ok()) {
+      sv->Ref();
+      value->PinSlice(v, &DBImpl::UnrefSuperVersionIterator, this, sv);
+    }
+  } else {
+    s = sv->current->Get(options, lkey, value, &stats);
+  }
+
+  // Only lookups that had to seek through more than one file need mutex_
+  if (stats.seek_file != nullptr) {
+    MutexLock l(&mutex_);
+    if (sv->current->UpdateStats(stats)) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnAndCleanupSuperVersion(sv);
+  return s;
+}
+
+namespace {
+// Orders indexes into a vector of keys by the keys they refer to
+struct KeyIndexLess {
+  const Comparator* user_comparator;
+  const std::vector<Slice>* keys;
+
+  bool operator()(size_t a, size_t b) const {
+    return user_comparator->Compare((*keys)[a], (*keys)[b]) < 0;
+  }
+};
+}  // namespace
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  const size_t n = keys.size();
+  values->resize(n);
+  statuses->resize(n);
+
+  SuperVersion* sv = GetAndRefSuperVersion();
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  // Keys that have to be looked up in the current version
+  std::vector<size_t> pending;
+  std::vector<Version::GetStats> stats;
 
-  // Unlock while reading from files and memtables
   {
-    mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
+    // Visit the keys in sorted order so that neighbouring lookups touch
+    // the same parts of the memtables and tables.
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    KeyIndexLess less = { user_comparator(), &keys };
+    std::stable_sort(order.begin(), order.end(), less);
+
+    std::vector<LookupKey*> lkeys(n);
+    for (size_t j = 0; j < n; j++) {
+      const size_t i = order[j];
+      lkeys[i] = new LookupKey(keys[i], snapshot);
+      Status s;
+      std::string* value = &(*values)[i];
+      // First look in the memtable, then in the immutable memtable (if any).
+      if (sv->mem->Get(*lkeys[i], value, &s)) {
+        // Done
+      } else if (sv->imm != nullptr && sv->imm->Get(*lkeys[i], value, &s)) {
+        // Done
+      } else {
+        pending.push_back(i);
+      }
+      (*statuses)[i] = s;
+    }
+
+    if (!pending.empty()) {
+      const size_t m = pending.size();
+      std::vector<const LookupKey*> pending_keys(m);
+      std::vector<std::string*> pending_values(m);
+      std::vector<Status> pending_statuses(m);
+      stats.resize(m);
+      for (size_t j = 0; j < m; j++) {
+        pending_keys[j] = lkeys[pending[j]];
+        pending_values[j] = &(*values)[pending[j]];
+      }
+      sv->current->MultiGet(options, m, &pending_keys[0], &pending_values[0],
+                            &pending_statuses[0], &stats[0]);
+      for (size_t j = 0; j < m; j++) {
+        (*statuses)[pending[j]] = pending_statuses[j];
+      }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      delete lkeys[i];
     }
-    mutex_.Lock();
   }
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  // Only lookups that had to seek through more than one file need mutex_
+  size_t first_seek = 0;
+  while (first_seek < stats.size() && stats[first_seek].seek_file == nullptr) {
+    first_seek++;
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
-  return s;
+  if (first_seek < stats.size()) {
+    MutexLock l(&mutex_);
+    bool need_compaction = false;
+    for (size_t j = first_seek; j < stats.size(); j++) {
+      if (sv->current->UpdateStats(stats[j])) {
+        need_compaction = true;
+      }
+    }
+    if (need_compaction) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnAndCleanupSuperVersion(sv);
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeDelMap* range_del = nullptr;
+  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed,
+                                       &range_del);
   return NewDBIterator(
       this, user_comparator(), iter,
       (options.snapshot != nullptr
        ? static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number()
        : latest_snapshot),
-      seed);
+      seed, range_del,
+      (options.prefix_same_as_start ? options_.prefix_extractor : nullptr),
+      options.iterate_lower_bound, options.iterate_upper_bound);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1201,6 +1962,10 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 }
 
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(options, my_batch);
+  }
+
   Writer w(&mutex_);
   w.batch = my_batch;
   w.sync = options.sync;
@@ -1208,9 +1973,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
-    w.cv.Wait();
-  }
+  AwaitWriter(&w);
   if (w.done) {
     return w.status;
   }
@@ -1221,8 +1984,11 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   Writer* last_writer = &w;
   if (status.ok() && my_batch != nullptr) {  // nullptr batch is for compactions
     WriteBatch* updates = BuildBatchGroup(&last_writer);
+    DelayWrite(WriteBatchInternal::ByteSize(updates));
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(updates);
+    const bool parallel =
+        options_.allow_concurrent_memtable_write && last_writer != &w;
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1238,7 +2004,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !parallel) {
         status = WriteBatchInternal::InsertInto(updates, mem_);
       }
       mutex_.Lock();
@@ -1251,6 +2017,22 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     }
     if (updates == tmp_batch_) tmp_batch_->Clear();
 
+    if (status.ok() && parallel) {
+      std::vector<Writer*> group;
+      SequenceNumber sequence = versions_->LastSequence();
+      for (std::deque<Writer*>::iterator iter = writers_.begin(); ;
+           ++iter) {
+        Writer* writer = *iter;
+        group.push_back(writer);
+        if (writer->batch != nullptr) {
+          WriteBatchInternal::SetSequence(writer->batch, sequence + 1);
+          sequence += WriteBatchInternal::Count(writer->batch);
+        }
+        if (writer == last_writer) break;
+      }
+      status = InsertGroupConcurrently(group);
+    }
+
     versions_->SetLastSequence(last_sequence);
   }
 
@@ -1273,6 +2055,182 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   return status;
 }
 
+// The write path is split into two stages that different writer groups
+// can be in at the same time: the leader of a group at the front of
+// writers_ appends the group to the log, then hands the group over to
+// memtable_writers_ and applies it to the memtable once all groups logged
+// before it have been applied.  The sequence numbers of a group are only
+// published after that, so readers never see a write whose predecessors
+// are missing from the memtable.
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* my_batch) {
+  Writer w(&mutex_);
+  w.batch = my_batch;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  AwaitWriter(&w);
+  if (w.done) {
+    return w.status;
+  }
+
+  // May temporarily unlock and wait.
+  Status status = MakeRoomForWrite(my_batch == nullptr);
+  if (!status.ok() || my_batch == nullptr) {
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+    return status;
+  }
+
+  // Sequence numbers of earlier groups that are still being applied to
+  // the memtable have not been published yet.
+  SequenceNumber last_sequence = memtable_writers_.empty()
+      ? versions_->LastSequence()
+      : memtable_writers_.back()->last_sequence;
+  Writer* last_writer = &w;
+  WriteBatch* updates = BuildBatchGroup(&last_writer);
+  DelayWrite(WriteBatchInternal::ByteSize(updates));
+  WriteBatchInternal::SetSequence(updates, last_sequence + 1);
+
+  {
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+    bool sync_error = false;
+    if (status.ok() && options.sync) {
+      status = logfile_->Sync();
+      if (!status.ok()) {
+        sync_error = true;
+      }
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
+  }
+
+  // The memtable stage applies the callers' batches one by one, so the
+  // combined batch can be reused by the next group right away.
+  if (updates == tmp_batch_) tmp_batch_->Clear();
+
+  MemTableGroup group;
+  group.status = status;
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    group.writers.push_back(ready);
+    if (ready->batch != nullptr) {
+      WriteBatchInternal::SetSequence(ready->batch, last_sequence + 1);
+      last_sequence += WriteBatchInternal::Count(ready->batch);
+    }
+    if (ready == last_writer) break;
+  }
+  group.last_sequence = last_sequence;
+  memtable_writers_.push_back(&group);
+
+  // Let the next group start logging
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  while (&group != memtable_writers_.front()) {
+    memtable_writers_signal_.Wait();
+  }
+  // mem_ is not replaced while groups are waiting to be applied (see
+  // MakeRoomForWrite()), and groups are applied one at a time.
+  if (status.ok() && options_.allow_concurrent_memtable_write &&
+      group.writers.size() > 1) {
+    status = InsertGroupConcurrently(group.writers);
+  } else if (status.ok()) {
+    mutex_.Unlock();
+    for (size_t i = 0; i < group.writers.size() && status.ok(); i++) {
+      if (group.writers[i]->batch != nullptr) {
+        status = WriteBatchInternal::InsertInto(group.writers[i]->batch, mem_);
+      }
+    }
+    mutex_.Lock();
+  }
+  versions_->SetLastSequence(group.last_sequence);
+  memtable_writers_.pop_front();
+  memtable_writers_signal_.SignalAll();
+
+  for (size_t i = 1; i < group.writers.size(); i++) {
+    Writer* ready = group.writers[i];
+    ready->status = status;
+    ready->done = true;
+    ready->cv.Signal();
+  }
+  return status;
+}
+
+// REQUIRES: mutex_ is held
+void DBImpl::AwaitWriter(Writer* w) {
+  mutex_.AssertHeld();
+  while (true) {
+    while (!w->done && !w->insert_own_batch && w != writers_.front()) {
+      w->cv.Wait();
+    }
+    if (!w->insert_own_batch) {
+      break;
+    }
+
+    // The leader of our group asks us to apply our batch to the memtable
+    w->insert_own_batch = false;
+    ParallelInsert* parallel = w->parallel;
+    mutex_.Unlock();
+    Status s = WriteBatchInternal::InsertInto(w->batch, parallel->mem, true);
+    mutex_.Lock();
+    if (!s.ok() && parallel->status.ok()) {
+      parallel->status = s;
+    }
+    parallel->pending--;
+    if (parallel->pending == 0) {
+      parallel->leader->cv.Signal();
+    }
+    w->parallel = nullptr;
+  }
+}
+
+// REQUIRES: mutex_ is held
+// REQUIRES: group[0] is the calling thread's writer
+Status DBImpl::InsertGroupConcurrently(const std::vector<Writer*>& group) {
+  mutex_.AssertHeld();
+  ParallelInsert parallel;
+  parallel.mem = mem_;
+  parallel.leader = group[0];
+  parallel.pending = 0;
+  for (size_t i = 1; i < group.size(); i++) {
+    Writer* w = group[i];
+    if (w->batch != nullptr) {
+      w->parallel = &parallel;
+      w->insert_own_batch = true;
+      parallel.pending++;
+      w->cv.Signal();
+    }
+  }
+
+  Status status;
+  mutex_.Unlock();
+  if (group[0]->batch != nullptr) {
+    status = WriteBatchInternal::InsertInto(group[0]->batch, parallel.mem,
+                                            true);
+  }
+  mutex_.Lock();
+  while (parallel.pending > 0) {
+    group[0]->cv.Wait();
+  }
+  if (status.ok()) {
+    status = parallel.status;
+  }
+  return status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1323,31 +2281,53 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   return result;
 }
 
+// REQUIRES: mutex_ is held
+// REQUIRES: this thread is currently at the front of the writer queue
+void DBImpl::DelayWrite(uint64_t num_bytes) {
+  mutex_.AssertHeld();
+  // We are getting close to hitting a hard limit on the number of L0
+  // files, or compactions have a lot of work queued up.  Rather than
+  // stopping writes for several seconds once the hard limit is hit,
+  // spread the delay over all writes by limiting their rate.  Also,
+  // this delay hands over some CPU to the compaction threads in case
+  // they are sharing the same cores as the writers.
+  const uint64_t pending_bytes = versions_->PendingCompactionBytes();
+  write_controller_.Update(
+      versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger ||
+      pending_bytes >= options_.soft_pending_compaction_bytes_limit,
+      pending_bytes);
+  uint64_t delay = write_controller_.GetDelay(env_->NowMicros(), num_bytes);
+
+  // Sleep in slices so that the delay ends early once compactions have
+  // caught up.
+  const uint64_t kMaxSleepMicros = 100000;
+  while (delay > 0 && bg_error_.ok() && !shutting_down_.Acquire_Load()) {
+    const uint64_t micros = std::min(delay, kMaxSleepMicros);
+    mutex_.Unlock();
+    env_->SleepForMicroseconds(static_cast<int>(micros));
+    mutex_.Lock();
+    stall_micros_ += micros;
+    delay -= micros;
+    if (versions_->NumLevelFiles(0) < config::kL0_SlowdownWritesTrigger &&
+        versions_->PendingCompactionBytes() <
+            options_.soft_pending_compaction_bytes_limit) {
+      write_controller_.Update(false, 0);
+      break;
+    }
+  }
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
-  bool allow_delay = !force;
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (
-        allow_delay &&
-        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
-      allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1356,11 +2336,19 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
       background_work_finished_signal_.Wait();
+      stall_micros_ += env_->NowMicros() - start_micros;
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
       background_work_finished_signal_.Wait();
+      stall_micros_ += env_->NowMicros() - start_micros;
+    } else if (!memtable_writers_.empty()) {
+      // Earlier writes are still being applied to the current memtable
+      // (options_.enable_pipelined_write), so it cannot be replaced yet.
+      memtable_writers_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1381,6 +2369,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       has_imm_.Release_Store(imm_);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
+      InstallSuperVersion();
       force = false;   // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1450,6 +2439,57 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
              static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "num-running-compactions") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%d", versions_->NumRunningCompactions());
+    value->append(buf);
+    return true;
+  } else if (in == "delayed-write-rate") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(
+                 write_controller_.delayed_write_rate()));
+    value->append(buf);
+    return true;
+  } else if (in == "write-stall-micros") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(stall_micros_));
+    value->append(buf);
+    return true;
+  } else if (in == "row-cache-hits") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(table_cache_->RowCacheHits()));
+    value->append(buf);
+    return true;
+  } else if (in == "row-cache-misses") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(table_cache_->RowCacheMisses()));
+    value->append(buf);
+    return true;
+  } else if (in == "readahead-bytes-read") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(
+                 table_cache_->ReadaheadBytesRead()));
+    value->append(buf);
+    return true;
+  } else if (in == "readahead-bytes-used") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(
+                 table_cache_->ReadaheadBytesUsed()));
+    value->append(buf);
+    return true;
+  } else if (in == "estimate-pending-compaction-bytes") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(
+                 versions_->PendingCompactionBytes()));
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -1495,6 +2535,49 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::GetPinned(const ReadOptions& options, const Slice& key,
+                     PinnableSlice* value) {
+  std::string buf;
+  Status s = Get(options, key, &buf);
+  if (s.ok()) {
+    value->PinSelf(buf);
+  } else {
+    value->Reset();
+  }
+  return s;
+}
+
+Status DB::DeleteRange(const WriteOptions& opt,
+                       const Slice& begin, const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  return Status::NotSupported("DeleteFilesInRange");
+}
+
+void DB::MultiGet(const ReadOptions& options,
+                  const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  ReadOptions opts = options;
+  const Snapshot* snapshot = nullptr;
+  if (opts.snapshot == nullptr) {
+    snapshot = GetSnapshot();
+    opts.snapshot = snapshot;
+  }
+  values->resize(keys.size());
+  statuses->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(opts, keys[i], &(*values)[i]);
+  }
+  if (snapshot != nullptr) {
+    ReleaseSnapshot(snapshot);
+  }
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
@@ -1528,6 +2611,7 @@ Status DB::Open(const Options& options, const std::string& dbname,
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
   if (s.ok()) {
+    impl->InstallSuperVersion();
     impl->DeleteObsoleteFiles();
     impl->MaybeScheduleCompaction();
   }
@@ -5,11 +5,15 @@
 #ifndef STORAGE_LEVELDB_DB_DB_IMPL_H_
 #define STORAGE_LEVELDB_DB_DB_IMPL_H_
 
+#include <atomic>
 #include <deque>
 #include <set>
+#include <string>
+#include <vector>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -18,7 +22,10 @@
 namespace leveldb {
 
 class MemTable;
+class RangeDelMap;
+struct RangeTombstone;
 class TableCache;
+class ThreadLocalPtr;
 class Version;
 class VersionEdit;
 class VersionSet;
@@ -35,12 +42,20 @@ class DBImpl : public DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
+  virtual Status GetPinned(const ReadOptions& options,
+                           const Slice& key,
+                           PinnableSlice* value);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -68,10 +83,32 @@ class DBImpl : public DB {
   friend class DB;
   struct CompactionState;
   struct Writer;
+  struct MemTableGroup;
+  struct ParallelInsert;
+  struct SuperVersion;
 
+  // If "range_del" is not nullptr, stores in *range_del the range
+  // tombstones visible to the read, or nullptr if there are none.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeDelMap** range_del);
+
+  // Return a referenced SuperVersion describing the current mem_, imm_
+  // and version, normally without acquiring mutex_.  The result must be
+  // handed back to ReturnAndCleanupSuperVersion() by the same thread.
+  SuperVersion* GetAndRefSuperVersion();
+  void ReturnAndCleanupSuperVersion(SuperVersion* sv);
+
+  // Drop a reference to "sv", deleting it if it was the last one.
+  void UnrefSuperVersion(SuperVersion* sv);
+  void CleanupSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void UnrefSuperVersionIterator(void* db, void* sv);
+  static void ReleaseCachedSuperVersion(void* sv);
+
+  // Publish the current mem_, imm_ and version to readers.  Must be
+  // called whenever one of them changes.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status NewDB();
 
@@ -95,27 +132,73 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // When "base" is non-null the new file number is left in pending_outputs_
+  // and stored in *pending_number; the caller must erase it once the edit
+  // has been applied.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t* pending_number = nullptr)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Wait as long as the write controller asks for before writing a
+  // group of "num_bytes" bytes.
+  void DelayWrite(uint64_t num_bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Implementation of Write() for options_.enable_pipelined_write
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates);
+
+  // Wait until "w" is done or has become the leader of a group.  Applies
+  // the batch of "w" to the memtable when its leader asks for it.
+  void AwaitWriter(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Let every writer of "group" apply its batch to mem_ in parallel, and
+  // wait for all of them.  The batches must already carry their sequence
+  // numbers.
+  Status InsertGroupConcurrently(const std::vector<Writer*>& group)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGWorkFlush(void* db);
+  void BackgroundFlushCall();
   static void BGWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns true iff some work was found and done.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Split the work of DoCompactionWork() at "boundaries" and compact the
+  // resulting key ranges in parallel, collecting all outputs in *compact.
+  struct SubcompactionJob;
+  Status DoSubcompactions(CompactionState* compact,
+                          const std::vector<std::string>& boundaries,
+                          int64_t* imm_micros);
+  static void BGWorkSubcompaction(void* arg);
+
+  // Merge the part of the compaction input selected by *compact into new
+  // output files.  Adds the time spent flushing imm_ to *imm_micros.
+  Status DoCompactionRange(CompactionState* compact, int64_t* imm_micros);
+
+  // Read the range tombstones of the compaction inputs into *range_del
+  // and *tombstones (see CompactionState), and drop the "level+1" inputs
+  // that are entirely deleted by them.
+  Status PrepareRangeTombstones(CompactionState* compact,
+                                RangeDelMap* range_del,
+                                std::vector<RangeTombstone>* tombstones);
+
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+
+  // Finish the current output, which covers the user keys before
+  // *output_end, or all remaining user keys if output_end is nullptr.
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* output_end);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -144,10 +227,22 @@ class DBImpl : public DB {
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
-  uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
+  std::atomic<uint32_t> seed_;  // For sampling.
+
+  // Snapshot of mem_, imm_ and the current version handed out to readers
+  SuperVersion* super_version_ GUARDED_BY(mutex_);
+
+  // Per-thread cache of super_version_ (see GetAndRefSuperVersion())
+  ThreadLocalPtr* const local_sv_;
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
+
+  // Queue of writer groups that have been logged and are waiting to be
+  // applied to mem_ (options_.enable_pipelined_write only).  Signalled
+  // whenever a group has been applied.
+  std::deque<MemTableGroup*> memtable_writers_ GUARDED_BY(mutex_);
+  port::CondVar memtable_writers_signal_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
   SnapshotList snapshots_ GUARDED_BY(mutex_);
@@ -156,13 +251,26 @@ class DBImpl : public DB {
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compactions scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Has a memtable flush been scheduled in the HIGH priority pool?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Is some background thread compacting imm_?
+  bool compacting_memtable_ GUARDED_BY(mutex_);
+
+  // Limits the rate of writes while compactions are falling behind
+  WriteController write_controller_ GUARDED_BY(mutex_);
+
+  // Total time writes have been delayed or stopped for
+  uint64_t stall_micros_ GUARDED_BY(mutex_);
 
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
     bool done;
+    bool in_progress;           // Is a background thread working on it?
     const InternalKey* begin;   // null means beginning of key range
     const InternalKey* end;     // null means end of key range
     InternalKey tmp_storage;    // Used to keep track of compaction progress
@@ -7,6 +7,7 @@
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -49,18 +50,32 @@ class DBIter: public Iterator {
   };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, RangeDelMap* range_del,
+         const SliceTransform* prefix_extractor,
+         const Slice* lower_bound, const Slice* upper_bound)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        range_del_(range_del),
+        prefix_extractor_(prefix_extractor),
+        has_lower_bound_(lower_bound != nullptr),
+        has_upper_bound_(upper_bound != nullptr),
         direction_(kForward),
         valid_(false),
+        prefix_bounded_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()) {
+    if (has_lower_bound_) {
+      lower_bound_ = lower_bound->ToString();
+    }
+    if (has_upper_bound_) {
+      upper_bound_ = upper_bound->ToString();
+    }
   }
   virtual ~DBIter() {
     delete iter_;
+    delete range_del_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
@@ -90,6 +105,31 @@ class DBIter: public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Returns true iff the last Seek() confined the iterator to prefix_ and
+  // "user_key" does not have that prefix
+  bool OutsidePrefix(const Slice& user_key) const {
+    return prefix_bounded_ &&
+           (!prefix_extractor_->InDomain(user_key) ||
+            prefix_extractor_->Transform(user_key) != Slice(prefix_));
+  }
+
+  // Returns true iff "user_key" comes before the lower bound
+  bool BeforeLowerBound(const Slice& user_key) const {
+    return has_lower_bound_ &&
+           user_comparator_->Compare(user_key, lower_bound_) < 0;
+  }
+
+  // Returns true iff "user_key" is at or after the upper bound
+  bool AtOrAfterUpperBound(const Slice& user_key) const {
+    return has_upper_bound_ &&
+           user_comparator_->Compare(user_key, upper_bound_) >= 0;
+  }
+
+  // Returns true iff "ikey" is deleted by a range tombstone
+  bool RangeDeleted(const ParsedInternalKey& ikey) const {
+    return range_del_ != nullptr && range_del_->ShouldDelete(ikey);
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -112,12 +152,20 @@ class DBIter: public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  RangeDelMap* const range_del_;
+  const SliceTransform* const prefix_extractor_;
+  const bool has_lower_bound_;
+  const bool has_upper_bound_;
+  std::string lower_bound_;  // User key; set if has_lower_bound_
+  std::string upper_bound_;  // User key; set if has_upper_bound_
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool prefix_bounded_;  // Whether the last Seek() set prefix_
+  std::string prefix_;   // Prefix of the target of the last Seek()
 
   Random rnd_;
   ssize_t bytes_counter_;
@@ -176,7 +224,16 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    const bool parsed = ParseKey(&ikey);
+    if (parsed && OutsidePrefix(ikey.user_key)) {
+      // Past all keys with the prefix of the Seek() target
+      break;
+    }
+    if (parsed && AtOrAfterUpperBound(ikey.user_key)) {
+      // Past the end of the range, including any deletions there
+      break;
+    }
+    if (parsed && ikey.sequence <= sequence_) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -188,12 +245,19 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+          } else if (RangeDeleted(ikey)) {
+            // Older entries for this key are deleted by the same tombstone
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
           } else {
             valid_ = true;
             saved_key_.clear();
             return;
           }
           break;
+        case kTypeRangeDeletion:
+          // Range tombstones are not yielded by iter_
+          break;
       }
     }
     iter_->Next();
@@ -205,6 +269,16 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
 void DBIter::Prev() {
   assert(valid_);
 
+  if (prefix_bounded_) {
+    // The iterators below may have skipped the keys before the Seek()
+    // target, so they cannot be walked backwards.
+    status_ = Status::NotSupported("Prev() after a prefix-scoped Seek()");
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    return;
+  }
+
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
@@ -236,13 +310,26 @@ void DBIter::FindPrevUserEntry() {
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      const bool parsed = ParseKey(&ikey);
+      if (parsed && BeforeLowerBound(ikey.user_key)) {
+        // Past the start of the range
+        break;
+      }
+      if (parsed && AtOrAfterUpperBound(ikey.user_key)) {
+        // Not yet in the range: SeekToLast() may start past its end
+        iter_->Prev();
+        continue;
+      }
+      if (parsed && ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
         value_type = ikey.type;
+        if (value_type == kTypeValue && RangeDeleted(ikey)) {
+          value_type = kTypeDeletion;
+        }
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
@@ -274,9 +361,21 @@ void DBIter::FindPrevUserEntry() {
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
   ClearSavedValue();
+  prefix_bounded_ = false;
   saved_key_.clear();
+  if (AtOrAfterUpperBound(target)) {
+    valid_ = false;
+    return;
+  }
+  if (prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target)) {
+    const Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+    prefix_bounded_ = true;
+  }
   AppendInternalKey(
-      &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+      &saved_key_,
+      ParsedInternalKey(BeforeLowerBound(target) ? Slice(lower_bound_) : target,
+                        sequence_, kValueTypeForSeek));
   iter_->Seek(saved_key_);
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -288,7 +387,15 @@ void DBIter::Seek(const Slice& target) {
 void DBIter::SeekToFirst() {
   direction_ = kForward;
   ClearSavedValue();
-  iter_->SeekToFirst();
+  prefix_bounded_ = false;
+  if (has_lower_bound_) {
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(lower_bound_, sequence_,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+  } else {
+    iter_->SeekToFirst();
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -299,7 +406,22 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  prefix_bounded_ = false;
+  if (has_upper_bound_) {
+    // Position at the last entry before the upper bound
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_,
+                      ParsedInternalKey(upper_bound_, kMaxSequenceNumber,
+                                        kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -310,8 +432,13 @@ Iterator* NewDBIterator(
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+    uint32_t seed,
+    RangeDelMap* range_del,
+    const SliceTransform* prefix_extractor,
+    const Slice* lower_bound,
+    const Slice* upper_bound) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    range_del, prefix_extractor, lower_bound, upper_bound);
 }
 
 }  // namespace leveldb
@@ -12,15 +12,27 @@
 namespace leveldb {
 
 class DBImpl;
+class RangeDelMap;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Entries deleted by the range tombstones in
+// "*range_del" are skipped; "range_del" may be nullptr if there are no
+// tombstones.  The result takes ownership of "range_del".  If
+// "prefix_extractor" is non-null, a Seek() is confined to the keys with
+// the prefix of its target (see ReadOptions::prefix_same_as_start).
+// Non-null "lower_bound" and "upper_bound" are user keys that confine the
+// iterator as ReadOptions::iterate_lower_bound and iterate_upper_bound
+// describe; they are copied.
 Iterator* NewDBIterator(DBImpl* db,
                         const Comparator* user_key_comparator,
                         Iterator* internal_iter,
                         SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed,
+                        RangeDelMap* range_del,
+                        const SliceTransform* prefix_extractor,
+                        const Slice* lower_bound = nullptr,
+                        const Slice* upper_bound = nullptr);
 
 }  // namespace leveldb
 
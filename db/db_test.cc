@@ -2,8 +2,12 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
+#include <atomic>
+
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
 #include "db/version_set.h"
@@ -117,6 +121,10 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // LOW priority background work is held back instead of being scheduled
+  // while this pointer is non-null.  See ReleaseHeldWork().
+  port::AtomicPointer hold_low_priority_work_;
+
   explicit SpecialEnv(Env* base) : EnvWrapper(base) {
     delay_data_sync_.Release_Store(nullptr);
     data_sync_error_.Release_Store(nullptr);
@@ -125,9 +133,60 @@ class SpecialEnv : public EnvWrapper {
     count_random_reads_ = false;
     manifest_sync_error_.Release_Store(nullptr);
     manifest_write_error_.Release_Store(nullptr);
+    hold_low_priority_work_.Release_Store(nullptr);
+  }
+
+  void Schedule(void (*function)(void*), void* arg) {
+    Schedule(function, arg, LOW);
+  }
+
+  void Schedule(void (*function)(void*), void* arg, Priority pri) {
+    if (pri == LOW && hold_low_priority_work_.Acquire_Load() != nullptr) {
+      MutexLock l(&held_mu_);
+      held_work_.push_back(std::make_pair(function, arg));
+    } else {
+      target()->Schedule(function, arg, pri);
+    }
+  }
+
+  int HeldWorkCount() {
+    MutexLock l(&held_mu_);
+    return held_work_.size();
+  }
+
+  // Stop holding LOW priority work and schedule everything held so far.
+  void ReleaseHeldWork() {
+    hold_low_priority_work_.Release_Store(nullptr);
+    std::vector<std::pair<void (*)(void*), void*> > work;
+    {
+      MutexLock l(&held_mu_);
+      work.swap(held_work_);
+    }
+    for (size_t i = 0; i < work.size(); i++) {
+      target()->Schedule(work[i].first, work[i].second, LOW);
+    }
   }
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
+    return OpenWritableFile(f, r, false);
+  }
+
+  Status NewDirectWritableFile(const std::string& f, WritableFile** r) {
+    return OpenWritableFile(f, r, true);
+  }
+
+  Status NewRandomAccessFile(const std::string& f, RandomAccessFile** r) {
+    return OpenRandomAccessFile(f, r, false);
+  }
+
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) {
+    return OpenRandomAccessFile(f, r, true);
+  }
+
+ private:
+  Status OpenWritableFile(const std::string& f, WritableFile** r,
+                          bool direct) {
     class DataFile : public WritableFile {
      private:
       SpecialEnv* env_;
@@ -188,7 +247,8 @@ class SpecialEnv : public EnvWrapper {
       return Status::IOError("simulated write error");
     }
 
-    Status s = target()->NewWritableFile(f, r);
+    Status s = direct ? target()->NewDirectWritableFile(f, r)
+                      : target()->NewWritableFile(f, r);
     if (s.ok()) {
       if (strstr(f.c_str(), ".ldb") != nullptr ||
           strstr(f.c_str(), ".log") != nullptr) {
@@ -200,7 +260,8 @@ class SpecialEnv : public EnvWrapper {
     return s;
   }
 
-  Status NewRandomAccessFile(const std::string& f, RandomAccessFile** r) {
+  Status OpenRandomAccessFile(const std::string& f, RandomAccessFile** r,
+                              bool direct) {
     class CountingFile : public RandomAccessFile {
      private:
       RandomAccessFile* target_;
@@ -217,24 +278,38 @@ class SpecialEnv : public EnvWrapper {
       }
     };
 
-    Status s = target()->NewRandomAccessFile(f, r);
+    Status s = direct ? target()->NewDirectRandomAccessFile(f, r)
+                      : target()->NewRandomAccessFile(f, r);
     if (s.ok() && count_random_reads_) {
       *r = new CountingFile(*r, &random_read_counter_);
     }
     return s;
   }
+
+  port::Mutex held_mu_;
+  std::vector<std::pair<void (*)(void*), void*> > held_work_;
 };
 
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  Cache* row_cache_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
     kDefault,
     kReuse,
     kFilter,
+    kFullFilter,
+    kCacheIndexAndFilter,
+    kPartitionedIndex,
+    kDataBlockHashIndex,
+    kRowCache,
     kUncompressed,
+    kParallelCompactions,
+    kPipelinedWrite,
+    kConcurrentMemtableWrite,
+    kDirectIO,
     kEnd
   };
   int option_config_;
@@ -249,6 +324,7 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    row_cache_ = NewLRUCache(1 << 20);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = nullptr;
@@ -260,6 +336,7 @@ class DBTest {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete row_cache_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -285,9 +362,42 @@ class DBTest {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kFullFilter:
+        options.filter_policy = filter_policy_;
+        options.full_file_filter = true;
+        break;
+      case kCacheIndexAndFilter:
+        options.filter_policy = filter_policy_;
+        options.cache_index_and_filter_blocks = true;
+        options.pin_l0_filter_and_index_blocks_in_cache = true;
+        break;
+      case kPartitionedIndex:
+        options.filter_policy = filter_policy_;
+        options.index_partition_size = 128;
+        break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kRowCache:
+        options.row_cache = row_cache_;
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kParallelCompactions:
+        options.max_background_compactions = 4;
+        options.max_subcompactions = 4;
+        break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemtableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kDirectIO:
+        options.use_direct_compaction_reads = true;
+        options.use_direct_io_for_flush_and_compaction = true;
+        break;
       default:
         break;
     }
@@ -337,6 +447,10 @@ class DBTest {
     return db_->Delete(WriteOptions(), k);
   }
 
+  Status DeleteRange(const std::string& begin, const std::string& end) {
+    return db_->DeleteRange(WriteOptions(), begin, end);
+  }
+
   std::string Get(const std::string& k, const Snapshot* snapshot = nullptr) {
     ReadOptions options;
     options.snapshot = snapshot;
@@ -404,6 +518,7 @@ class DBTest {
               result += iter->value().ToString();
               break;
             case kTypeDeletion:
+            case kTypeRangeDeletion:
               result += "DEL";
               break;
           }
@@ -602,6 +717,36 @@ TEST(DBTest, GetFromVersions) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, GetPinned) {
+  do {
+    ASSERT_OK(Put("foo", "v1"));
+    PinnableSlice from_mem;
+    ASSERT_OK(db_->GetPinned(ReadOptions(), "foo", &from_mem));
+    ASSERT_TRUE(from_mem.IsPinned());
+    ASSERT_EQ("v1", from_mem.ToString());
+
+    // The value stays valid after its memtable has been flushed
+    ASSERT_OK(Put("foo", "v2"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("v1", from_mem.ToString());
+
+    // ... and after its table has been compacted away
+    PinnableSlice from_table;
+    ASSERT_OK(db_->GetPinned(ReadOptions(), "foo", &from_table));
+    ASSERT_TRUE(from_table.IsPinned());
+    ASSERT_EQ("v2", from_table.ToString());
+    ASSERT_OK(Delete("foo"));
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    ASSERT_EQ("v2", from_table.ToString());
+    ASSERT_EQ("v1", from_mem.ToString());
+
+    ASSERT_TRUE(db_->GetPinned(ReadOptions(), "foo", &from_table).IsNotFound());
+    ASSERT_TRUE(!from_table.IsPinned());
+    ASSERT_TRUE(from_table.empty());
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, GetMemUsage) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -761,6 +906,64 @@ TEST(DBTest, GetEncountersEmptyLevel) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, MultiGet) {
+  do {
+    // Spread the keys over several levels, level-0 files and the memtable.
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("c", "vc"));
+    Compact("a", "c");
+    ASSERT_OK(Put("x", "vx"));
+    Compact("x", "y");
+    ASSERT_OK(Put("c", "vc2"));
+    ASSERT_OK(Put("m", "vm"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("n", "vn"));
+    ASSERT_OK(Delete("x"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(Put("a", "va2"));
+    ASSERT_OK(Delete("m"));
+
+    std::vector<Slice> keys;
+    keys.push_back("x");
+    keys.push_back("a");
+    keys.push_back("missing");
+    keys.push_back("n");
+    keys.push_back("c");
+    keys.push_back("m");
+    keys.push_back("a");
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), statuses.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      const std::string expected = Get(keys[i].ToString());
+      if (expected == "NOT_FOUND") {
+        ASSERT_TRUE(statuses[i].IsNotFound());
+      } else {
+        ASSERT_OK(statuses[i]);
+        ASSERT_EQ(expected, values[i]);
+      }
+    }
+    ASSERT_EQ("va2", values[1]);
+    ASSERT_EQ("vc2", values[4]);
+    ASSERT_EQ("va2", values[6]);
+
+    ReadOptions options;
+    options.snapshot = snapshot;
+    db_->MultiGet(options, keys, &values, &statuses);
+    ASSERT_TRUE(statuses[0].IsNotFound());
+    ASSERT_EQ("va", values[1]);
+    ASSERT_TRUE(statuses[2].IsNotFound());
+    ASSERT_EQ("vn", values[3]);
+    ASSERT_EQ("vc2", values[4]);
+    ASSERT_EQ("vm", values[5]);
+    ASSERT_EQ("va", values[6]);
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, IterEmpty) {
   Iterator* iter = db_->NewIterator(ReadOptions());
 
@@ -1090,6 +1293,509 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, MultiGetManyKeys) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+
+  Random rnd(301);
+  const int kNumKeys = 2000;
+  for (int i = 0; i < 3 * kNumKeys; i++) {
+    const int k = rnd.Uniform(kNumKeys);
+    if (rnd.OneIn(10)) {
+      ASSERT_OK(Delete(Key(k)));
+    } else {
+      ASSERT_OK(Put(Key(k), RandomString(&rnd, 100)));
+    }
+  }
+
+  std::vector<std::string> key_storage;
+  for (int i = 0; i < 200; i++) {
+    key_storage.push_back(Key(rnd.Uniform(kNumKeys + 100)));
+  }
+  std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  for (size_t i = 0; i < keys.size(); i++) {
+    const std::string expected = Get(key_storage[i]);
+    if (expected == "NOT_FOUND") {
+      ASSERT_TRUE(statuses[i].IsNotFound());
+    } else {
+      ASSERT_OK(statuses[i]);
+      ASSERT_EQ(expected, values[i]);
+    }
+  }
+}
+
+TEST(DBTest, MultiGetManyBlocks) {
+  // One batch that needs several chunks of blocks from the same table
+  const int kNumKeys = 10000;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+  }
+  db_->CompactRange(nullptr, nullptr);
+
+  std::vector<std::string> key_storage;
+  for (int i = 0; i < kNumKeys + 10; i += 3) {
+    key_storage.push_back(Key(i));
+  }
+  std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (3 * i < static_cast<size_t>(kNumKeys)) {
+      ASSERT_OK(statuses[i]);
+      ASSERT_EQ(key_storage[i] + std::string(100, 'v'), values[i]);
+    } else {
+      ASSERT_TRUE(statuses[i].IsNotFound());
+    }
+  }
+}
+
+TEST(DBTest, DeleteRange) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+    ASSERT_OK(DeleteRange("b", "d"));
+    ASSERT_OK(DeleteRange("x", "a"));  // Empty range
+    ASSERT_OK(Put("c", "vc2"));
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ("va", Get("a"));
+      ASSERT_EQ("NOT_FOUND", Get("b"));
+      ASSERT_EQ("vc2", Get("c"));
+      ASSERT_EQ("vd", Get("d"));
+      ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+      if (i == 0) {
+        dbfull()->TEST_CompactMemTable();
+      } else if (i == 1) {
+        db_->CompactRange(nullptr, nullptr);
+      }
+    }
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, DeleteRangeManyTombstones) {
+  // Lookups between tombstone writes see every tombstone written so far,
+  // and no tombstone newer than their snapshot
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(Put(Key(2 * i), "v"));
+  }
+  std::vector<const Snapshot*> snapshots;
+  for (int i = 0; i < 100; i++) {
+    snapshots.push_back(db_->GetSnapshot());
+    ASSERT_OK(DeleteRange(Key(2 * i), Key(2 * i + 3)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(2 * i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(2 * i + 2)));
+    ASSERT_EQ("v", Get(Key(2 * i + 4)));
+  }
+  // The same holds once the tombstones are in a table
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_EQ("v", Get(Key(2 * i + 2), snapshots[i]));
+      ASSERT_EQ(i == 0 ? "v" : "NOT_FOUND", Get(Key(2 * i), snapshots[i]));
+      ASSERT_EQ("NOT_FOUND", Get(Key(2 * i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  for (int i = 0; i < 100; i++) {
+    db_->ReleaseSnapshot(snapshots[i]);
+  }
+}
+
+TEST(DBTest, DeleteRangeAcrossLevels) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+
+  const int kNumKeys = 1000;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_OK(Put(Key(300), "new300"));
+  ASSERT_OK(DeleteRange(Key(200), Key(600)));
+  ASSERT_OK(Put(Key(500), "new500"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(DeleteRange(Key(450), Key(800)));
+
+  // The memtable holds the tombstones, then level-0, then the last level
+  for (int pass = 0; pass < 3; pass++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      std::string expected = Key(i) + std::string(100, 'v');
+      if (i >= 200 && i < 800) {
+        expected = "NOT_FOUND";
+      }
+      ASSERT_EQ(expected, Get(Key(i)));
+    }
+    ASSERT_EQ("NOT_FOUND", Get(Key(300), snapshot));
+    ASSERT_EQ("new500", Get(Key(500), snapshot));
+    ASSERT_EQ(Key(700) + std::string(100, 'v'), Get(Key(700), snapshot));
+
+    std::vector<std::string> key_storage;
+    for (int i = 150; i < 850; i += 50) {
+      key_storage.push_back(Key(i));
+    }
+    std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_EQ(Get(key_storage[i]), statuses[i].ok() ? values[i]
+                                                      : "NOT_FOUND");
+    }
+
+    int count = 0;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->Seek(Key(150));
+    for (; iter->Valid() && iter->key().ToString() < Key(850); iter->Next()) {
+      count++;
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(100, count);
+
+    if (pass == 0) {
+      dbfull()->TEST_CompactMemTable();
+    } else if (pass == 1) {
+      db_->CompactRange(nullptr, nullptr);
+    }
+  }
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST(DBTest, DeleteRangeDropsCoveredFiles) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.max_file_size = 100000;
+  Reopen(&options);
+
+  for (int i = 0; i < 2000; i++) {
+    ASSERT_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  // No snapshot needs the deleted entries, so compacting the tombstone
+  // leaves nothing behind.
+  ASSERT_OK(DeleteRange("", Key(2000)));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ("", Contents());
+
+  Reopen(&options);
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_OK(Put(Key(5), "v5"));
+  ASSERT_EQ("v5", Get(Key(5)));
+}
+
+TEST(DBTest, DeleteFilesInRange) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.max_file_size = 100000;
+  Reopen(&options);
+
+  const int kNumKeys = 5000;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  const int files_before = TotalTableFiles();
+  ASSERT_GT(files_before, 4);
+
+  // A range that holds no complete file deletes nothing
+  std::string begin = Key(1000);
+  std::string end = Key(1001);
+  Slice b(begin), e(end);
+  ASSERT_OK(db_->DeleteFilesInRange(&b, &e));
+  ASSERT_EQ(files_before, TotalTableFiles());
+
+  end = Key(4000);
+  e = end;
+  ASSERT_OK(db_->DeleteFilesInRange(&b, &e));
+  const int files_after = TotalTableFiles();
+  ASSERT_LT(files_after, files_before);
+
+  // Keys outside the range survive; inside it only keys from the
+  // partly covered files at its edges do.
+  int found = 0;
+  for (int i = 0; i < kNumKeys; i++) {
+    const std::string value = Get(Key(i));
+    if (i < 1000 || i > 4000) {
+      ASSERT_EQ(Key(i) + std::string(100, 'v'), value);
+    } else if (value != "NOT_FOUND") {
+      ASSERT_EQ(Key(i) + std::string(100, 'v'), value);
+      found++;
+    }
+  }
+  ASSERT_LT(found, 3001);
+
+  Reopen(&options);
+  ASSERT_EQ(files_after, TotalTableFiles());
+
+  // Level-0 files are kept while a snapshot exists.  The second flush
+  // overlaps the first one and so stays at level-0.
+  ASSERT_OK(Put(Key(700), "new"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put(Key(700), "new2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, NumTableFilesAtLevel(0));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteFilesInRange(nullptr, nullptr));
+  ASSERT_EQ(1, NumTableFilesAtLevel(0));
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_EQ("new2", Get(Key(700)));
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_OK(db_->DeleteFilesInRange(nullptr, nullptr));
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("", Contents());
+}
+
+TEST(DBTest, WriteStallProperties) {
+  std::string rate, stall, pending;
+  ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &rate));
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-micros", &stall));
+  ASSERT_TRUE(db_->GetProperty("leveldb.estimate-pending-compaction-bytes",
+                               &pending));
+  ASSERT_EQ("0", rate);
+  ASSERT_EQ("0", stall);
+  ASSERT_EQ("0", pending);
+
+  // Level-0 files beyond the compaction trigger count as pending work
+  for (int i = 0; i < config::kL0_CompactionTrigger; i++) {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("z", "vz"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_TRUE(db_->GetProperty("leveldb.estimate-pending-compaction-bytes",
+                                 &pending));
+    if (NumTableFilesAtLevel(0) < config::kL0_CompactionTrigger) {
+      ASSERT_EQ("0", pending);
+    }
+  }
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_TRUE(db_->GetProperty("leveldb.estimate-pending-compaction-bytes",
+                               &pending));
+  ASSERT_EQ("0", pending);
+}
+
+static uint64_t NumericProperty(DB* db, const std::string& name) {
+  std::string property;
+  ASSERT_TRUE(db->GetProperty(name, &property));
+  return std::stoull(property);
+}
+
+TEST(DBTest, DelayedWrites) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.delayed_write_rate = 64 << 10;
+  options.soft_pending_compaction_bytes_limit = 1;
+  Reopen(&options);
+
+  // Hold back compactions until level-0 has more files than the
+  // compaction trigger, which makes its whole size pending work.  The
+  // first tables go to level-2 and level-1.
+  env_->hold_low_priority_work_.Release_Store(env_);
+  for (int i = 0; i < config::kL0_CompactionTrigger + 2; i++) {
+    ASSERT_OK(Put("a", std::string(1, 'a' + i)));
+    ASSERT_OK(Put("z", std::string(1, 'a' + i)));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(config::kL0_CompactionTrigger, NumTableFilesAtLevel(0));
+  ASSERT_GT(NumericProperty(db_, "leveldb.estimate-pending-compaction-bytes"),
+            0);
+
+  // Writes go through at about options.delayed_write_rate while the
+  // pending work stays the same
+  const int kNumWrites = 64;
+  const int kValueSize = 1000;
+  const uint64_t stall_before =
+      NumericProperty(db_, "leveldb.write-stall-micros");
+  const uint64_t start_micros = env_->NowMicros();
+  for (int i = 0; i < kNumWrites; i++) {
+    ASSERT_OK(Put(Key(i), std::string(kValueSize, 'v')));
+  }
+  const uint64_t elapsed_micros = env_->NowMicros() - start_micros;
+  ASSERT_EQ(options.delayed_write_rate,
+            NumericProperty(db_, "leveldb.delayed-write-rate"));
+  const uint64_t expected_micros =
+      uint64_t(kNumWrites) * kValueSize * 1000000 / options.delayed_write_rate;
+  fprintf(stderr, "%d delayed writes took %llu micros, expected %llu\n",
+          kNumWrites, static_cast<unsigned long long>(elapsed_micros),
+          static_cast<unsigned long long>(expected_micros));
+  ASSERT_GE(elapsed_micros, expected_micros - 1000);
+  ASSERT_LE(elapsed_micros, 3 * expected_micros);
+  ASSERT_GE(NumericProperty(db_, "leveldb.write-stall-micros") - stall_before,
+            expected_micros / 2);
+
+  // Writes are no longer delayed once compactions have caught up
+  env_->ReleaseHeldWork();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_EQ(0, NumericProperty(db_, "leveldb.delayed-write-rate"));
+  for (int i = 0; i < kNumWrites; i++) {
+    ASSERT_EQ(std::string(kValueSize, 'v'), Get(Key(i)));
+  }
+}
+
+static uint64_t RowCacheProperty(DB* db, const std::string& name) {
+  std::string property;
+  ASSERT_TRUE(db->GetProperty("leveldb.row-cache-" + name, &property));
+  return std::stoull(property);
+}
+
+TEST(DBTest, RowCache) {
+  Options options = CurrentOptions();
+  options.row_cache = NewLRUCache(1 << 20);
+  Reopen(&options);
+
+  ASSERT_OK(Put("foo", "v1"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("foo", "v2"));
+  dbfull()->TEST_CompactMemTable();
+
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ(0, RowCacheProperty(db_, "hits"));
+  ASSERT_EQ(1, RowCacheProperty(db_, "misses"));
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ(1, RowCacheProperty(db_, "hits"));
+
+  // Reads at a snapshot do not share rows with other reads
+  ASSERT_EQ("v1", Get("foo", snapshot));
+  ASSERT_EQ(2, RowCacheProperty(db_, "misses"));
+  ASSERT_EQ("v1", Get("foo", snapshot));
+  ASSERT_EQ(2, RowCacheProperty(db_, "hits"));
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ(3, RowCacheProperty(db_, "hits"));
+
+  // Deletions in newer files hide the rows of older files
+  ASSERT_OK(Delete("foo"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("v1", Get("foo", snapshot));
+  ASSERT_EQ(5, RowCacheProperty(db_, "hits"));
+  ASSERT_EQ(3, RowCacheProperty(db_, "misses"));
+
+  // Lookups that find nothing in a file are cached as well
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("z", "vz"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("NOT_FOUND", Get("m"));
+  ASSERT_EQ("NOT_FOUND", Get("m"));
+  ASSERT_EQ(6, RowCacheProperty(db_, "hits"));
+  ASSERT_EQ(4, RowCacheProperty(db_, "misses"));
+
+  db_->ReleaseSnapshot(snapshot);
+  Close();
+  delete options.row_cache;
+}
+
+TEST(DBTest, ParallelCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.max_file_size = 100000;
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-running-compactions", &property));
+
+  // Write enough data to keep compactions busy on several levels.
+  Random rnd(301);
+  const int kNumKeys = 10000;
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < 2 * kNumKeys; i++) {
+    const int k = rnd.Uniform(kNumKeys);
+    values[k] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(k), values[k]));
+  }
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i].empty() ? "NOT_FOUND" : values[i], Get(Key(i)));
+  }
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i].empty() ? "NOT_FOUND" : values[i], Get(Key(i)));
+  }
+}
+
+TEST(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Overwrite and delete keys so that every subcompaction has to drop
+  // obsolete entries.
+  Random rnd(301);
+  const int kNumKeys = 1000;
+  std::vector<std::string> values(kNumKeys);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      const int k = rnd.Uniform(kNumKeys);
+      values[k] = RandomString(&rnd, 1000);
+      ASSERT_OK(Put(Key(k), values[k]));
+    }
+  }
+  for (int i = 0; i < kNumKeys; i += 7) {
+    values[i].clear();
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+
+  // All data now fits in a single output file, so having several files
+  // means the last compaction was split.
+  ASSERT_GT(TotalTableFiles(), 1);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i].empty() ? "NOT_FOUND" : values[i], Get(Key(i)));
+  }
+
+  Reopen(&options);
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  delete iter;
+  int expected = 0;
+  for (int i = 0; i < kNumKeys; i++) {
+    if (!values[i].empty()) expected++;
+  }
+  ASSERT_EQ(expected, count);
+}
+
+TEST(DBTest, FlushNotBlockedByCompaction) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // Hold back all compactions.  Memtable flushes run in the HIGH priority
+  // pool and must still complete.
+  env_->hold_low_priority_work_.Release_Store(env_);
+  const int kNumFlushes = config::kL0_CompactionTrigger + 2;
+  for (int i = 0; i < kNumFlushes; i++) {
+    ASSERT_OK(Put("a", std::string(1, 'a' + i)));
+    ASSERT_OK(Put("z", std::string(1, 'a' + i)));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), config::kL0_CompactionTrigger);
+  ASSERT_GT(env_->HeldWorkCount(), 0);
+
+  env_->ReleaseHeldWork();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_EQ(std::string(1, 'a' + kNumFlushes - 1), Get("a"));
+  ASSERT_EQ(std::string(1, 'a' + kNumFlushes - 1), Get("z"));
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1514,6 +2220,52 @@ TEST(DBTest, ComparatorCheck) {
       << s.ToString();
 }
 
+TEST(DBTest, DataBlockHashIndexCustomComparator) {
+  // Keys that this comparator considers equal have different bytes
+  class CaseInsensitiveComparator : public Comparator {
+   public:
+    virtual const char* Name() const {
+      return "test.CaseInsensitiveComparator";
+    }
+    virtual int Compare(const Slice& a, const Slice& b) const {
+      const size_t n = std::min(a.size(), b.size());
+      for (size_t i = 0; i < n; i++) {
+        const int ca = tolower(static_cast<unsigned char>(a[i]));
+        const int cb = tolower(static_cast<unsigned char>(b[i]));
+        if (ca != cb) {
+          return ca - cb;
+        }
+      }
+      return static_cast<int>(a.size()) - static_cast<int>(b.size());
+    }
+    virtual void FindShortestSeparator(std::string* s, const Slice& l) const {
+    }
+    virtual void FindShortSuccessor(std::string* key) const { }
+  };
+  CaseInsensitiveComparator cmp;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.comparator = &cmp;
+  options.filter_policy = nullptr;  // Filters hash the key bytes as well
+  options.data_block_hash_index = true;
+  DestroyAndReopen(&options);
+
+  char key[20];
+  for (int i = 0; i < 200; i++) {
+    snprintf(key, sizeof(key), "key%03d", i);
+    ASSERT_OK(Put(key, key));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  for (int i = 0; i < 200; i++) {
+    snprintf(key, sizeof(key), "KEY%03d", i);
+    std::string expected = key;
+    for (size_t j = 0; j < 3; j++) {
+      expected[j] = tolower(expected[j]);
+    }
+    ASSERT_EQ(expected, Get(key));
+  }
+}
+
 TEST(DBTest, CustomComparator) {
   class NumberComparator : public Comparator {
    public:
@@ -1904,6 +2656,407 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+// Counts the entries inserted with a high priority into a cache
+class PriorityCountingCache : public Cache {
+ public:
+  explicit PriorityCountingCache(Cache* base)
+      : base_(base), high_priority_inserts_(0) { }
+  virtual ~PriorityCountingCache() { delete base_; }
+
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value)) {
+    return base_->Insert(key, value, charge, deleter);
+  }
+  virtual Handle* InsertWithPriority(const Slice& key, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value),
+                                     Priority priority) {
+    if (priority == kHighPriority) {
+      high_priority_inserts_++;
+    }
+    return base_->InsertWithPriority(key, value, charge, deleter, priority);
+  }
+  virtual Handle* Lookup(const Slice& key) { return base_->Lookup(key); }
+  virtual void Release(Handle* handle) { base_->Release(handle); }
+  virtual void* Value(Handle* handle) { return base_->Value(handle); }
+  virtual void Erase(const Slice& key) { base_->Erase(key); }
+  virtual uint64_t NewId() { return base_->NewId(); }
+  virtual void Prune() { base_->Prune(); }
+  virtual size_t TotalCharge() const { return base_->TotalCharge(); }
+
+  int high_priority_inserts() const { return high_priority_inserts_.load(); }
+
+ private:
+  Cache* const base_;
+  std::atomic<int> high_priority_inserts_;
+};
+
+TEST(DBTest, DirectCompactionReadsSkipIndexCache) {
+  // Compaction inputs that are opened again to be read with direct I/O
+  // must not put their index and filter blocks in the block cache
+  PriorityCountingCache* cache =
+      new PriorityCountingCache(NewLRUCache(1 << 20));
+  Options options = CurrentOptions();
+  options.block_cache = cache;
+  options.cache_index_and_filter_blocks = true;
+  options.pin_l0_filter_and_index_blocks_in_cache = true;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.use_direct_reads = false;
+  options.use_direct_compaction_reads = true;
+  Reopen(&options);
+
+  // The first tables go to level-2 and level-1, the others overlap them
+  for (int i = 0; i < 4; i++) {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("z", "vz"));
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ("2,1,1", FilesPerLevel());
+
+  // Only the output table, opened by the table cache, caches its index
+  // and its filter
+  const int inserts = cache->high_priority_inserts();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ(inserts + 2, cache->high_priority_inserts());
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vz", Get("z"));
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, FullFileFilterMixedFormats) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.full_file_filter = false;
+  Reopen(&options);
+
+  // One table with per-block filters, one with a full-file filter
+  const int N = 2000;
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  options.full_file_filter = true;
+  Reopen(&options);
+  for (int i = 1; i < N; i += 2) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(2, NumTableFilesAtLevel(0) + NumTableFilesAtLevel(1) +
+               NumTableFilesAtLevel(2));
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 6*N/100);
+
+  env_->delay_data_sync_.Release_Store(nullptr);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+static std::string PrefixKey(int prefix, int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "p%03d/%04d", prefix, i);
+  return std::string(buf);
+}
+
+TEST(DBTest, PrefixScan) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  Reopen(&options);
+
+  // Populate multiple layers with the even prefixes
+  const int kPrefixes = 100;
+  const int kKeysPerPrefix = 20;
+  for (int p = 0; p < kPrefixes; p += 2) {
+    for (int i = 0; i < kKeysPerPrefix; i++) {
+      ASSERT_OK(Put(PrefixKey(p, i), std::string(100, 'v')));
+    }
+  }
+  Compact("a", "z");
+  for (int p = 0; p < kPrefixes; p += 10) {
+    ASSERT_OK(Put(PrefixKey(p, kKeysPerPrefix), "v"));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+
+  ReadOptions ropts;
+  ropts.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(ropts);
+
+  // Only the keys with the prefix of the target are yielded
+  iter->Seek(PrefixKey(10, 5));
+  int count = 0;
+  for (; iter->Valid(); iter->Next()) {
+    ASSERT_EQ(PrefixKey(10, 5 + count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(kKeysPerPrefix + 1 - 5, count);
+
+  // Missing prefixes are ruled out by the filters
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < kPrefixes; p += 2) {
+    iter->Seek(PrefixKey(p, 0).substr(0, 4));
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_OK(iter->status());
+  }
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d missing prefixes => %d reads\n", kPrefixes / 2, reads);
+  ASSERT_LE(reads, kPrefixes / 10);
+
+  // Prev() is not supported after a prefix-scoped Seek()
+  iter->Seek(PrefixKey(20, 0));
+  ASSERT_TRUE(iter->Valid());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+
+  // SeekToFirst() is not confined to a prefix
+  iter = db_->NewIterator(ropts);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(kPrefixes / 2 * kKeysPerPrefix + kPrefixes / 10, count);
+  delete iter;
+
+  // Without prefix_same_as_start the seeks read the data blocks
+  iter = db_->NewIterator(ReadOptions());
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < kPrefixes; p += 2) {
+    iter->Seek(PrefixKey(p, 0).substr(0, 4));
+  }
+  reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d unscoped seeks => %d reads\n", kPrefixes / 2, reads);
+  ASSERT_GE(reads, kPrefixes / 4);
+  delete iter;
+
+  env_->delay_data_sync_.Release_Store(nullptr);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST(DBTest, IterateBounds) {
+  do {
+    // Keys in the memtable, at level 0 and further down, with deletions
+    // on both sides of the range
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), "v" + Key(i)));
+    }
+    Compact(Key(0), Key(100));
+    for (int i = 0; i < 100; i += 3) {
+      ASSERT_OK(Put(Key(i), "w" + Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < 100; i++) {
+      if (i < 20 || i >= 60 || i % 7 == 0) {
+        ASSERT_OK(Delete(Key(i)));
+      }
+    }
+
+    // Expected contents of [Key(10), Key(70))
+    std::vector<std::string> expected;
+    for (int i = 20; i < 60; i++) {
+      if (i % 7 != 0) {
+        expected.push_back(Key(i) + "->" + (i % 3 == 0 ? "w" : "v") + Key(i));
+      }
+    }
+
+    ReadOptions options;
+    const std::string lower_key = Key(10);
+    const std::string upper_key = Key(70);
+    Slice lower(lower_key);
+    Slice upper(upper_key);
+    options.iterate_lower_bound = &lower;
+    options.iterate_upper_bound = &upper;
+    Iterator* iter = db_->NewIterator(options);
+
+    std::vector<std::string> found;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      found.push_back(IterStatus(iter));
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_TRUE(found == expected);
+
+    found.clear();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      found.push_back(IterStatus(iter));
+    }
+    ASSERT_OK(iter->status());
+    std::reverse(found.begin(), found.end());
+    ASSERT_TRUE(found == expected);
+
+    // Seeks are clamped to the range
+    iter->Seek(Key(0));
+    ASSERT_EQ(expected.front(), IterStatus(iter));
+    iter->Seek(Key(70));
+    ASSERT_EQ("(invalid)", IterStatus(iter));
+    iter->Seek(Key(99));
+    ASSERT_EQ("(invalid)", IterStatus(iter));
+    iter->Seek(Key(35));
+    ASSERT_EQ(Key(36) + "->w" + Key(36), IterStatus(iter));
+
+    // Changing direction at the ends of the range
+    iter->SeekToFirst();
+    iter->Prev();
+    ASSERT_EQ("(invalid)", IterStatus(iter));
+    iter->SeekToLast();
+    iter->Next();
+    ASSERT_EQ("(invalid)", IterStatus(iter));
+    iter->SeekToLast();
+    iter->Prev();
+    iter->Next();
+    ASSERT_EQ(expected.back(), IterStatus(iter));
+    delete iter;
+
+    // Only an upper bound
+    options.iterate_lower_bound = nullptr;
+    iter = db_->NewIterator(options);
+    iter->SeekToFirst();
+    ASSERT_EQ(expected.front(), IterStatus(iter));
+    iter->SeekToLast();
+    ASSERT_EQ(expected.back(), IterStatus(iter));
+    delete iter;
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, IterateBoundsBetweenBlocks) {
+  Options options = CurrentOptions();
+  options.compression = kNoCompression;
+  Reopen(&options);
+
+  // Three entries per data block.  The index separator of a block is
+  // shortened to fall between its last key and the first of the next
+  // block, so a bound of the last key plus "5" lies in between.
+  char key[20];
+  for (int i = 0; i < 10000; i += 20) {
+    snprintf(key, sizeof(key), "k%04d", i);
+    ASSERT_OK(Put(key, std::string(1100, 'v')));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_OK(Put("k0001", "m"));  // Something to merge with
+
+  for (int i = 0; i < 1000; i += 20) {
+    snprintf(key, sizeof(key), "k%04d", i);
+    const std::string last = key;
+    snprintf(key, sizeof(key), "k%04d", i - 20);
+    const std::string before = (i == 0) ? "" : (i == 20) ? "k0001" : key;
+    const std::string upper_key = last + "5";
+    Slice upper(upper_key);
+    ReadOptions ropts;
+    ropts.iterate_upper_bound = &upper;
+    Iterator* iter = db_->NewIterator(ropts);
+
+    iter->SeekToLast();
+    ASSERT_TRUE(iter->Valid()) << upper_key;
+    ASSERT_EQ(last, iter->key().ToString());
+    iter->Prev();
+    ASSERT_EQ(before, iter->Valid() ? iter->key().ToString() : "");
+
+    iter->Seek(last);
+    ASSERT_EQ(last, iter->key().ToString());
+    iter->Next();
+    ASSERT_TRUE(!iter->Valid());
+
+    iter->Seek(last);
+    iter->Prev();
+    ASSERT_EQ(before, iter->Valid() ? iter->key().ToString() : "");
+    if (iter->Valid()) {
+      iter->Next();
+      ASSERT_EQ(last, iter->key().ToString());
+      iter->Next();
+      ASSERT_TRUE(!iter->Valid());
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+}
+
+TEST(DBTest, IterateBoundsSkipFiles) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.compression = kNoCompression;
+  Reopen(&options);
+
+  // Three files with disjoint key ranges
+  for (int f = 0; f < 3; f++) {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(Put(Key(f * 100 + i), std::string(100, 'v')));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+
+  ReadOptions ropts;
+  const std::string upper_key = Key(200);
+  Slice upper(upper_key);
+  ropts.iterate_upper_bound = &upper;
+  Iterator* iter = db_->NewIterator(ropts);
+  env_->random_read_counter_.Reset();
+  int count = 0;
+  for (iter->Seek(Key(100)); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(10, count);
+  const int bounded_reads = env_->random_read_counter_.Read();
+  delete iter;
+
+  // Without the bound the file after the range is read as well
+  iter = db_->NewIterator(ReadOptions());
+  env_->random_read_counter_.Reset();
+  count = 0;
+  for (iter->Seek(Key(100));
+       iter->Valid() && iter->key().compare(upper) < 0;
+       iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(10, count);
+  const int unbounded_reads = env_->random_read_counter_.Read();
+  delete iter;
+  fprintf(stderr, "bounded scan => %d reads, unbounded => %d reads\n",
+          bounded_reads, unbounded_reads);
+  ASSERT_EQ(1, bounded_reads);
+  ASSERT_LT(bounded_reads, unbounded_reads);
+
+  env_->delay_data_sync_.Release_Store(nullptr);
+  Close();
+  delete options.block_cache;
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -2056,6 +3209,12 @@ class ModelDB: public DB {
       virtual void Delete(const Slice& key) {
         map_->erase(key.ToString());
       }
+      virtual void DeleteRange(const Slice& begin, const Slice& end) {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2198,6 +3357,8 @@ TEST(DBTest, Randomized) {
           if (rnd.OneIn(2)) {
             v = RandomString(&rnd, rnd.Uniform(10));
             b.Put(k, v);
+          } else if (rnd.OneIn(10)) {
+            b.DeleteRange(k, RandomKey(&rnd));
           } else {
             b.Delete(k);
           }
@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <stdio.h>
+#include <vector>
 #include "db/dbformat.h"
 #include "port/port.h"
 #include "util/coding.h"
@@ -98,20 +99,58 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+InternalFilterPolicy::InternalFilterPolicy(
+    const FilterPolicy* p, const SliceTransform* prefix_extractor)
+    : user_policy_(p),
+      prefix_extractor_(prefix_extractor) {
+  if (p != nullptr) {
+    name_ = p->Name();
+    if (prefix_extractor != nullptr) {
+      // Filters without the prefixes must not be used for prefix lookups
+      name_.append("+");
+      name_.append(prefix_extractor->Name());
+    }
+  }
+}
+
 const char* InternalFilterPolicy::Name() const {
-  return user_policy_->Name();
+  return name_.c_str();
 }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
                                         std::string* dst) const {
-  // We rely on the fact that the code in table.cc does not mind us
-  // adjusting keys[].
-  Slice* mkey = const_cast<Slice*>(keys);
+  if (prefix_extractor_ == nullptr) {
+    // We rely on the fact that the code in table.cc does not mind us
+    // adjusting keys[].
+    Slice* mkey = const_cast<Slice*>(keys);
+    for (int i = 0; i < n; i++) {
+      mkey[i] = ExtractUserKey(keys[i]);
+      // TODO(sanjay): Suppress dups?
+    }
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  // Add each distinct prefix just before the first key that has it,
+  // which keeps the list ordered.
+  std::vector<Slice> user_keys;
+  user_keys.reserve(n + n / 8 + 1);
+  Slice last_prefix;
+  bool have_prefix = false;
   for (int i = 0; i < n; i++) {
-    mkey[i] = ExtractUserKey(keys[i]);
-    // TODO(sanjay): Suppress dups?
+    const Slice user_key = ExtractUserKey(keys[i]);
+    if (prefix_extractor_->InDomain(user_key)) {
+      const Slice prefix = prefix_extractor_->Transform(user_key);
+      if (!have_prefix || prefix != last_prefix) {
+        user_keys.push_back(prefix);
+        last_prefix = prefix;
+        have_prefix = true;
+      }
+    }
+    user_keys.push_back(user_key);
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  user_policy_->CreateFilter(user_keys.data(),
+                             static_cast<int>(user_keys.size()), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
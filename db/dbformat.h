@@ -10,6 +10,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -50,7 +51,8 @@ class InternalKey;
 // data structures.
 enum ValueType {
   kTypeDeletion = 0x0,
-  kTypeValue = 0x1
+  kTypeValue = 0x1,
+  kTypeRangeDeletion = 0x2
 };
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
@@ -58,7 +60,7 @@ enum ValueType {
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeRangeDeletion;
 
 typedef uint64_t SequenceNumber;
 
@@ -117,12 +119,18 @@ class InternalKeyComparator : public Comparator {
   int Compare(const InternalKey& a, const InternalKey& b) const;
 };
 
-// Filter policy wrapper that converts from internal keys to user keys
+// Filter policy wrapper that converts from internal keys to user keys.
+// If "prefix_extractor" is non-null, the filters also hold the prefixes
+// of the user keys, so that KeyMayMatch() of an internal key whose user
+// key is a prefix tells whether some key with that prefix was added.
 class InternalFilterPolicy : public FilterPolicy {
  private:
   const FilterPolicy* const user_policy_;
+  const SliceTransform* const prefix_extractor_;
+  std::string name_;
  public:
-  explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) { }
+  InternalFilterPolicy(const FilterPolicy* p,
+                       const SliceTransform* prefix_extractor);
   virtual const char* Name() const;
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const;
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
@@ -172,7 +180,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<unsigned char>(kTypeValue));
+  return (c <= static_cast<unsigned char>(kTypeRangeDeletion));
 }
 
 // A helper class useful for DBImpl::Get()
@@ -193,6 +201,9 @@ class LookupKey {
   // Return the user key
   Slice user_key() const { return Slice(kstart_, end_ - kstart_ - 8); }
 
+  // Return the sequence number of the snapshot the lookup is done at.
+  SequenceNumber sequence() const { return DecodeFixed64(end_ - 8) >> 8; }
+
  private:
   // We construct a char array of the form:
   //    klength  varint32               <-- start_
@@ -4,10 +4,12 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -21,7 +23,10 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 MemTable::MemTable(const InternalKeyComparator& cmp)
     : comparator_(cmp),
       refs_(0),
-      table_(comparator_, &arena_) {
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      num_range_dels_(0),
+      range_del_index_count_(0) {
 }
 
 MemTable::~MemTable() {
@@ -79,9 +84,25 @@ Iterator* MemTable::NewIterator() {
   return new MemTableIterator(&table_);
 }
 
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
+bool MemTable::HasRangeTombstones() {
+  Table::Iterator iter(&range_del_table_);
+  iter.SeekToFirst();
+  return iter.Valid();
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type,
                    const Slice& key,
-                   const Slice& value) {
+                   const Slice& value,
+                   bool concurrent) {
+  if (type == kTypeRangeDeletion &&
+      comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+    return;  // Empty range
+  }
+
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -93,7 +114,8 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   const size_t encoded_len =
       VarintLength(internal_key_size) + internal_key_size +
       VarintLength(val_size) + val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrent ? arena_.AllocateConcurrently(encoded_len)
+                         : arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   memcpy(p, key.data(), key_size);
   p += key_size;
@@ -102,10 +124,52 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  Table* table = (type == kTypeRangeDeletion) ? &range_del_table_ : &table_;
+  if (concurrent) {
+    table->InsertConcurrently(buf);
+  } else {
+    table->Insert(buf);
+  }
+  if (type == kTypeRangeDeletion) {
+    num_range_dels_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+std::shared_ptr<const FragmentedRangeTombstones>
+MemTable::RangeTombstoneIndex() {
+  const size_t count = num_range_dels_.load(std::memory_order_acquire);
+  MutexLock l(&range_del_mu_);
+  if (range_del_index_ == nullptr || range_del_index_count_ < count) {
+    MemTableIterator iter(&range_del_table_);
+    range_del_index_.reset(new FragmentedRangeTombstones(
+        comparator_.comparator.user_comparator(), &iter));
+    range_del_index_count_ = count;
+  }
+  return range_del_index_;
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+  Slice v;
+  if (!Get(key, &v, s)) {
+    return false;
+  }
+  if (s->ok()) {
+    value->assign(v.data(), v.size());
+  }
+  return true;
+}
+
+bool MemTable::Get(const LookupKey& key, Slice* value, Status* s) {
+  // Entries older than the newest visible tombstone that covers the key
+  // are deleted.  Entries in older memtables and in tables are older than
+  // any tombstone in this memtable, so such a tombstone ends the search
+  // even if the key has no entry here.
+  SequenceNumber tombstone = 0;
+  if (num_range_dels_.load(std::memory_order_acquire) > 0) {
+    tombstone = RangeTombstoneIndex()->MaxCoveringSeq(key.user_key(),
+                                                      key.sequence());
+  }
+
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
@@ -127,18 +191,26 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
             key.user_key()) == 0) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+      if ((tag >> 8) < tombstone) {
+        *s = Status::NotFound(Slice());
+        return true;
+      }
       switch (static_cast<ValueType>(tag & 0xff)) {
         case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
+          *value = GetLengthPrefixedSlice(key_ptr + key_length);
           return true;
         }
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           *s = Status::NotFound(Slice());
           return true;
       }
     }
   }
+  if (tombstone > 0) {
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
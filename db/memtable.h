@@ -5,14 +5,19 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include "leveldb/db.h"
 #include "db/dbformat.h"
 #include "db/skiplist.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
+class FragmentedRangeTombstones;
 class InternalKeyComparator;
 class MemTableIterator;
 
@@ -46,19 +51,39 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator that yields the range tombstones of the memtable
+  // (see db/range_del.h).  The same requirements as for NewIterator()
+  // apply.
+  Iterator* NewRangeTombstoneIterator();
+
+  // Returns true iff the memtable holds some range tombstone.
+  bool HasRangeTombstones();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  If
+  // type==kTypeRangeDeletion, the entry is a range tombstone for
+  // [key,value).
+  //
+  // If "concurrent" is true, several threads may add entries at once;
+  // calls with and without "concurrent" must not overlap.
   void Add(SequenceNumber seq, ValueType type,
            const Slice& key,
-           const Slice& value);
+           const Slice& value,
+           bool concurrent = false);
 
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone that
+  // deletes the newest value for key, store a NotFound() error in *status
+  // and return true.
   // Else, return false.
   bool Get(const LookupKey& key, std::string* value, Status* s);
 
+  // Like Get(key, std::string*, s), but sets *value to the value stored
+  // in the memtable instead of copying it.  *value remains valid as long
+  // as the memtable is.
+  bool Get(const LookupKey& key, Slice* value, Status* s);
+
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
 
@@ -72,10 +97,23 @@ class MemTable {
 
   typedef SkipList<const char*, KeyComparator> Table;
 
+  // Return an index of the range tombstones that includes at least all
+  // those whose Add() has returned.
+  std::shared_ptr<const FragmentedRangeTombstones> RangeTombstoneIndex();
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;  // Range tombstones, keyed like table_
+  std::atomic<size_t> num_range_dels_;  // Tombstones in range_del_table_
+
+  // Index of the first range_del_index_count_ tombstones, rebuilt by the
+  // first lookup after a tombstone is added
+  port::Mutex range_del_mu_;
+  std::shared_ptr<const FragmentedRangeTombstones> range_del_index_
+      GUARDED_BY(range_del_mu_);
+  size_t range_del_index_count_ GUARDED_BY(range_del_mu_);
 
   // No copying allowed
   MemTable(const MemTable&);
@@ -0,0 +1,274 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <functional>
+#include <set>
+#include "leveldb/comparator.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+Status CollectRangeTombstones(Iterator* iter,
+                              std::vector<RangeTombstone>* list) {
+  ParsedInternalKey ikey;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    list->push_back(RangeTombstone(ikey.user_key, iter->value(),
+                                   ikey.sequence));
+  }
+  return iter->status();
+}
+
+void AddRangeTombstoneToTable(const Comparator* icmp,
+                              const RangeTombstone& t,
+                              TableBuilder* builder,
+                              InternalKey* smallest,
+                              InternalKey* largest,
+                              bool* has_range) {
+  InternalKey start(t.begin, t.seq, kTypeRangeDeletion);
+  builder->AddRangeDeletion(start.Encode(), t.end);
+
+  // "end" itself is not deleted, so the largest key claimed by the table
+  // is the one that sorts before all entries for "end".
+  InternalKey limit(t.end, kMaxSequenceNumber, kTypeRangeDeletion);
+  if (!*has_range) {
+    *smallest = start;
+    *largest = limit;
+    *has_range = true;
+  } else {
+    if (icmp->Compare(start.Encode(), smallest->Encode()) < 0) {
+      *smallest = start;
+    }
+    if (icmp->Compare(limit.Encode(), largest->Encode()) > 0) {
+      *largest = limit;
+    }
+  }
+}
+
+RangeDelMap::RangeDelMap(const Comparator* user_comparator)
+    : user_comparator_(user_comparator),
+      finished_(false) {
+}
+
+void RangeDelMap::Add(const Slice& begin, const Slice& end,
+                      SequenceNumber seq) {
+  assert(!finished_);
+  if (user_comparator_->Compare(begin, end) < 0) {
+    tombstones_.push_back(RangeTombstone(begin, end, seq));
+  }
+}
+
+Status RangeDelMap::AddTombstones(Iterator* iter, SequenceNumber snapshot) {
+  ParsedInternalKey ikey;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    if (ikey.sequence <= snapshot) {
+      Add(ikey.user_key, iter->value(), ikey.sequence);
+    }
+  }
+  return iter->status();
+}
+
+namespace {
+// A point at which a tombstone starts or stops covering keys
+struct Boundary {
+  Slice key;
+  SequenceNumber seq;
+  bool start;
+};
+
+struct BoundaryLess {
+  const Comparator* user_comparator;
+
+  bool operator()(const Boundary& a, const Boundary& b) const {
+    return user_comparator->Compare(a.key, b.key) < 0;
+  }
+};
+}  // namespace
+
+void RangeDelMap::Finish() {
+  assert(!finished_);
+  finished_ = true;
+
+  std::vector<Boundary> boundaries;
+  boundaries.reserve(2 * tombstones_.size());
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    Boundary b;
+    b.seq = tombstones_[i].seq;
+    b.key = tombstones_[i].begin;
+    b.start = true;
+    boundaries.push_back(b);
+    b.key = tombstones_[i].end;
+    b.start = false;
+    boundaries.push_back(b);
+  }
+  BoundaryLess less = { user_comparator_ };
+  std::sort(boundaries.begin(), boundaries.end(), less);
+
+  // Sweep over the boundaries, keeping the sequence numbers of the
+  // tombstones that cover the keys between the current boundary and the
+  // next one.
+  std::multiset<SequenceNumber> active;
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    const Boundary& b = boundaries[i];
+    if (b.start) {
+      active.insert(b.seq);
+    } else {
+      active.erase(active.find(b.seq));
+    }
+    if (i + 1 == boundaries.size() ||
+        user_comparator_->Compare(b.key, boundaries[i + 1].key) == 0 ||
+        active.empty()) {
+      continue;
+    }
+    const SequenceNumber seq = *active.rbegin();
+    if (!fragments_.empty() && fragments_.back().seq == seq &&
+        user_comparator_->Compare(fragments_.back().end, b.key) == 0) {
+      // Extend the previous fragment
+      fragments_.back().end = boundaries[i + 1].key;
+    } else {
+      Fragment f;
+      f.begin = b.key;
+      f.end = boundaries[i + 1].key;
+      f.seq = seq;
+      fragments_.push_back(f);
+    }
+  }
+}
+
+size_t RangeDelMap::FindFragment(const Slice& user_key) const {
+  assert(finished_);
+  // Binary search for the last fragment that begins at or before user_key
+  size_t left = 0;
+  size_t right = fragments_.size();
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    if (user_comparator_->Compare(fragments_[mid].begin, user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left > 0 &&
+      user_comparator_->Compare(user_key, fragments_[left - 1].end) < 0) {
+    return left - 1;
+  }
+  return fragments_.size();
+}
+
+SequenceNumber RangeDelMap::MaxCoveringSeq(const Slice& user_key) const {
+  size_t index = FindFragment(user_key);
+  return (index < fragments_.size()) ? fragments_[index].seq : 0;
+}
+
+bool RangeDelMap::CoversRange(const Slice& smallest,
+                              const Slice& largest) const {
+  size_t index = FindFragment(smallest);
+  if (index == fragments_.size()) {
+    return false;
+  }
+  // Walk along adjacent fragments until one of them covers "largest"
+  while (user_comparator_->Compare(largest, fragments_[index].end) >= 0) {
+    if (index + 1 == fragments_.size() ||
+        user_comparator_->Compare(fragments_[index].end,
+                                  fragments_[index + 1].begin) != 0) {
+      return false;
+    }
+    index++;
+  }
+  return true;
+}
+
+FragmentedRangeTombstones::FragmentedRangeTombstones(
+    const Comparator* user_comparator, Iterator* iter)
+    : user_comparator_(user_comparator) {
+  // Copy the keys first: the keys of a block iterator only stay valid
+  // until it moves.  Boundary keys are recorded as offsets into keys_.
+  std::vector<Boundary> boundaries;
+  std::vector<size_t> offsets;
+  ParsedInternalKey ikey;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        user_comparator_->Compare(ikey.user_key, iter->value()) >= 0) {
+      continue;
+    }
+    Boundary b;
+    b.seq = ikey.sequence;
+    b.start = true;
+    offsets.push_back(keys_.size());
+    keys_.append(ikey.user_key.data(), ikey.user_key.size());
+    boundaries.push_back(b);
+    b.start = false;
+    offsets.push_back(keys_.size());
+    keys_.append(iter->value().data(), iter->value().size());
+    boundaries.push_back(b);
+  }
+  offsets.push_back(keys_.size());
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    boundaries[i].key = Slice(keys_.data() + offsets[i],
+                              offsets[i + 1] - offsets[i]);
+  }
+  BoundaryLess less = { user_comparator_ };
+  std::sort(boundaries.begin(), boundaries.end(), less);
+
+  // The same sweep as RangeDelMap::Finish(), keeping every sequence
+  // number of the active tombstones
+  std::multiset<SequenceNumber> active;
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    const Boundary& b = boundaries[i];
+    if (b.start) {
+      active.insert(b.seq);
+    } else {
+      active.erase(active.find(b.seq));
+    }
+    if (i + 1 == boundaries.size() ||
+        user_comparator_->Compare(b.key, boundaries[i + 1].key) == 0 ||
+        active.empty()) {
+      continue;
+    }
+    Fragment f;
+    f.begin = b.key;
+    f.end = boundaries[i + 1].key;
+    f.seqs_begin = seqs_.size();
+    seqs_.insert(seqs_.end(), active.rbegin(), active.rend());
+    f.seqs_end = seqs_.size();
+    fragments_.push_back(f);
+  }
+}
+
+SequenceNumber FragmentedRangeTombstones::MaxCoveringSeq(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  // Binary search for the last fragment that begins at or before user_key
+  size_t left = 0;
+  size_t right = fragments_.size();
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    if (user_comparator_->Compare(fragments_[mid].begin, user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0 ||
+      user_comparator_->Compare(user_key, fragments_[left - 1].end) >= 0) {
+    return 0;
+  }
+  // The first sequence number of the fragment that is visible
+  const Fragment& f = fragments_[left - 1];
+  std::vector<SequenceNumber>::const_iterator it = std::lower_bound(
+      seqs_.begin() + f.seqs_begin, seqs_.begin() + f.seqs_end, snapshot,
+      std::greater<SequenceNumber>());
+  return (it != seqs_.begin() + f.seqs_end) ? *it : 0;
+}
+
+}  // namespace leveldb
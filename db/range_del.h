@@ -0,0 +1,156 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone written by DeleteRange(begin, end) at sequence number
+// "seq" deletes every entry for a user key in [begin,end) whose sequence
+// number is smaller than "seq".
+//
+// Range tombstones are kept apart from the point entries: memtables hold
+// them in a skiplist of their own and tables hold them in a meta block.
+// Both expose them through an Iterator whose keys are the internal keys
+// (begin,seq,kTypeRangeDeletion) and whose values are the end keys, in
+// internal key order.  Tombstones from the same source may overlap.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+class TableBuilder;
+
+struct RangeTombstone {
+  std::string begin;    // Included in the range
+  std::string end;      // Not included in the range
+  SequenceNumber seq;
+
+  RangeTombstone() : seq(0) { }
+  RangeTombstone(const Slice& b, const Slice& e, SequenceNumber s)
+      : begin(b.ToString()), end(e.ToString()), seq(s) { }
+};
+
+// Append the tombstones yielded by "iter" to *list.
+Status CollectRangeTombstones(Iterator* iter,
+                              std::vector<RangeTombstone>* list);
+
+// Add the tombstone to the table being built by "builder", and widen the
+// key range of the table, [*smallest,*largest], so that it includes the
+// tombstone.  If "*has_range" is false, the table has no key range yet;
+// it is then set to the range of the tombstone and *has_range to true.
+// "icmp" is the internal key comparator.  Tombstones must be added in
+// internal key order.
+void AddRangeTombstoneToTable(const Comparator* icmp,
+                              const RangeTombstone& t,
+                              TableBuilder* builder,
+                              InternalKey* smallest,
+                              InternalKey* largest,
+                              bool* has_range);
+
+// Orders tombstones the way their internal keys are ordered.
+struct RangeTombstoneLess {
+  const Comparator* user_comparator;
+
+  bool operator()(const RangeTombstone& a, const RangeTombstone& b) const {
+    int r = user_comparator->Compare(a.begin, b.begin);
+    return (r < 0) || (r == 0 && a.seq > b.seq);
+  }
+};
+
+// A RangeDelMap answers which entries are deleted by a set of range
+// tombstones.  The tombstones are cut into disjoint fragments, each
+// labelled with the largest sequence number of the tombstones covering
+// it, so a lookup is a binary search.  Because of that, only tombstones
+// that are visible to the reader may be added to the map.
+//
+// Add() may only be called before Finish(); the other methods may only
+// be called after it.
+class RangeDelMap {
+ public:
+  explicit RangeDelMap(const Comparator* user_comparator);
+
+  // Add the tombstone [begin,end)@seq.  Empty ranges are ignored.
+  void Add(const Slice& begin, const Slice& end, SequenceNumber seq);
+
+  // Add the tombstones yielded by "iter" with a sequence number that is
+  // at most "snapshot".
+  Status AddTombstones(Iterator* iter, SequenceNumber snapshot);
+
+  void Finish();
+
+  bool empty() const { return fragments_.empty(); }
+
+  // Return the largest sequence number of the tombstones that cover
+  // "user_key", or 0 if no tombstone covers it.
+  SequenceNumber MaxCoveringSeq(const Slice& user_key) const;
+
+  // Returns true iff "key" is deleted by a tombstone.
+  bool ShouldDelete(const ParsedInternalKey& key) const {
+    return key.sequence < MaxCoveringSeq(key.user_key);
+  }
+
+  // Returns true iff every user key in [smallest,largest] is covered by
+  // some tombstone.
+  bool CoversRange(const Slice& smallest, const Slice& largest) const;
+
+ private:
+  struct Fragment {
+    Slice begin;
+    Slice end;
+    SequenceNumber seq;
+  };
+
+  // Index of the fragment that contains "user_key", or fragments_.size()
+  size_t FindFragment(const Slice& user_key) const;
+
+  const Comparator* const user_comparator_;
+  std::vector<RangeTombstone> tombstones_;  // Storage for the fragments
+  std::vector<Fragment> fragments_;         // Disjoint and sorted
+  bool finished_;
+
+  // No copying allowed
+  RangeDelMap(const RangeDelMap&);
+  void operator=(const RangeDelMap&);
+};
+
+// A FragmentedRangeTombstones tells which of the tombstones of a memtable
+// or a table cover a user key with a binary search.  Unlike a RangeDelMap it
+// keeps the sequence numbers of all the tombstones that cover each
+// fragment, so it holds tombstones of every snapshot.
+class FragmentedRangeTombstones {
+ public:
+  // Index the tombstones yielded by "iter".  Corrupted entries are
+  // ignored.
+  FragmentedRangeTombstones(const Comparator* user_comparator,
+                            Iterator* iter);
+
+  // Return the largest sequence number <= "snapshot" of the tombstones
+  // that cover "user_key", or 0 if there is no such tombstone.
+  SequenceNumber MaxCoveringSeq(const Slice& user_key,
+                                SequenceNumber snapshot) const;
+
+ private:
+  struct Fragment {
+    Slice begin;
+    Slice end;
+    size_t seqs_begin;  // seqs_[seqs_begin, seqs_end) cover the fragment,
+    size_t seqs_end;    // in decreasing order
+  };
+
+  const Comparator* const user_comparator_;
+  std::string keys_;                 // Storage for the fragment keys
+  std::vector<Fragment> fragments_;  // Disjoint and sorted
+  std::vector<SequenceNumber> seqs_;
+
+  // No copying allowed
+  FragmentedRangeTombstones(const FragmentedRangeTombstones&);
+  void operator=(const FragmentedRangeTombstones&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
@@ -31,6 +31,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -48,7 +49,7 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
+        ipolicy_(options.filter_policy, options.prefix_extractor),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
@@ -224,8 +225,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = nullptr;
     if (status.ok()) {
@@ -306,6 +310,31 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // The key range of the table also has to cover its range tombstones
+    std::vector<RangeTombstone> tombstones;
+    if (status.ok()) {
+      iter = table_cache_->NewRangeDeletionIterator(t.meta.number,
+                                                    t.meta.file_size);
+      status = CollectRangeTombstones(iter, &tombstones);
+      delete iter;
+    }
+    for (size_t i = 0; i < tombstones.size(); i++) {
+      const RangeTombstone& rt = tombstones[i];
+      InternalKey start(rt.begin, rt.seq, kTypeRangeDeletion);
+      InternalKey limit(rt.end, kMaxSequenceNumber, kTypeRangeDeletion);
+      if (empty || icmp_.Compare(start, t.meta.smallest) < 0) {
+        t.meta.smallest = start;
+      }
+      if (empty || icmp_.Compare(limit, t.meta.largest) > 0) {
+        t.meta.largest = limit;
+      }
+      empty = false;
+      if (rt.seq > t.max_sequence) {
+        t.max_sequence = rt.seq;
+      }
+      t.meta.has_range_deletions = true;
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long) t.meta.number,
         counter,
@@ -339,6 +368,13 @@ class Repairer {
       counter++;
     }
     delete iter;
+    iter = table_cache_->NewRangeDeletionIterator(t.meta.number,
+                                                  t.meta.file_size);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      builder->AddRangeDeletion(iter->key(), iter->value());
+      counter++;
+    }
+    delete iter;
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -396,7 +432,8 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+                    t.meta.smallest, t.meta.largest,
+                    t.meta.has_range_deletions);
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
@@ -8,7 +8,10 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
+// Writes require external synchronization, most likely a mutex.  The
+// exception is InsertConcurrently(), which links in nodes with
+// compare-and-swap operations and may be called by several threads at
+// once, as long as no Insert() runs at the same time.
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
@@ -28,7 +31,9 @@
 // ... prev vs. next pointer ordering ...
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <algorithm>
 #include "port/port.h"
 #include "util/arena.h"
 #include "util/random.h"
@@ -52,6 +57,11 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but may be called by several threads at once.  Calls
+  // to Insert() must not overlap with calls to InsertConcurrently().
+  // Allocates through Arena::AllocateAlignedConcurrently().
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -103,8 +113,8 @@ class SkipList {
 
   Node* const head_;
 
-  // Modified only by Insert().  Read racily by readers, but stale
-  // values are ok.
+  // Modified only by Insert() and InsertConcurrently().  Read racily by
+  // readers, but stale values are ok.
   port::AtomicPointer max_height_;   // Height of the entire list
 
   inline int GetMaxHeight() const {
@@ -115,8 +125,10 @@ class SkipList {
   // Read/written only by Insert().
   Random rnd_;
 
-  Node* NewNode(const Key& key, int height);
+  Node* NewNode(const Key& key, int height, bool concurrent = false);
   int RandomHeight();
+  // Like RandomHeight(), but with a random generator per thread
+  static int RandomHeightConcurrently();
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -129,6 +141,11 @@ class SkipList {
   // node at "level" for every level in [0..max_height_-1].
   Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
 
+  // Starting at node "before", which is before "key", find the nodes
+  // between which "key" belongs at the specified level.
+  void FindSpliceForLevel(const Key& key, Node* before, int level,
+                          Node** out_prev, Node** out_next) const;
+
   // Return the latest node with a key < key.
   // Return head_ if there is no such node.
   Node* FindLessThan(const Key& key) const;
@@ -174,6 +191,13 @@ struct SkipList<Key,Comparator>::Node {
     next_[n].NoBarrier_Store(x);
   }
 
+  // Link in "x" at level "n" if the link still points to "expected".
+  // Acts as a full memory barrier, like SetNext().
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].CompareAndSwap(expected, x);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   port::AtomicPointer next_[1];
@@ -181,9 +205,12 @@ struct SkipList<Key,Comparator>::Node {
 
 template<typename Key, class Comparator>
 typename SkipList<Key,Comparator>::Node*
-SkipList<Key,Comparator>::NewNode(const Key& key, int height) {
-  char* mem = arena_->AllocateAligned(
-      sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1));
+SkipList<Key,Comparator>::NewNode(const Key& key, int height,
+                                  bool concurrent) {
+  const size_t bytes =
+      sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1);
+  char* mem = concurrent ? arena_->AllocateAlignedConcurrently(bytes)
+                         : arena_->AllocateAligned(bytes);
   return new (mem) Node(key);
 }
 
@@ -252,6 +279,21 @@ int SkipList<Key,Comparator>::RandomHeight() {
   return height;
 }
 
+template<typename Key, class Comparator>
+int SkipList<Key,Comparator>::RandomHeightConcurrently() {
+  // Seeded from the address of a thread-local variable, which differs
+  // between threads that are alive at the same time
+  static thread_local char seed;
+  static thread_local Random rnd(
+      static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&seed) >> 4));
+  static const unsigned int kBranching = 4;
+  int height = 1;
+  while (height < kMaxHeight && ((rnd.Next() % kBranching) == 0)) {
+    height++;
+  }
+  return height;
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
   // null n is considered infinite
@@ -280,6 +322,23 @@ typename SkipList<Key,Comparator>::Node* SkipList<Key,Comparator>::FindGreaterOr
   }
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key,Comparator>::FindSpliceForLevel(const Key& key,
+                                                  Node* before, int level,
+                                                  Node** out_prev,
+                                                  Node** out_next) const {
+  while (true) {
+    Node* next = before->Next(level);
+    if (KeyIsAfterNode(key, next)) {
+      before = next;
+    } else {
+      *out_prev = before;
+      *out_next = next;
+      return;
+    }
+  }
+}
+
 template<typename Key, class Comparator>
 typename SkipList<Key,Comparator>::Node*
 SkipList<Key,Comparator>::FindLessThan(const Key& key) const {
@@ -369,6 +428,56 @@ void SkipList<Key,Comparator>::Insert(const Key& key) {
   }
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key,Comparator>::InsertConcurrently(const Key& key) {
+  const int height = RandomHeightConcurrently();
+
+  // Raise max_height_ if needed.  Readers handle a max_height_ that is
+  // ahead of the links as described in Insert().
+  int max_height = GetMaxHeight();
+  while (height > max_height) {
+    if (max_height_.CompareAndSwap(reinterpret_cast<void*>(max_height),
+                                   reinterpret_cast<void*>(height))) {
+      break;
+    }
+    max_height = GetMaxHeight();
+  }
+
+  // Find the position of key at every level of the new node
+  Node* prev[kMaxHeight];
+  Node* next[kMaxHeight];
+  Node* before = head_;
+  for (int level = std::max(height, GetMaxHeight()) - 1; level >= 0;
+       level--) {
+    Node* level_prev;
+    Node* level_next;
+    FindSpliceForLevel(key, before, level, &level_prev, &level_next);
+    if (level < height) {
+      prev[level] = level_prev;
+      next[level] = level_next;
+    }
+    before = level_prev;
+  }
+
+  // Our data structure does not allow duplicate insertion
+  assert(next[0] == nullptr || !Equal(key, next[0]->key));
+
+  // Link in the node from the bottom up, so that it is reachable at
+  // level 0 before anything points to it from above.  If another thread
+  // changed a link in the meantime, search for the position again,
+  // starting from the node that is still known to be before key.
+  Node* x = NewNode(key, height, true);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      x->NoBarrier_SetNext(i, next[i]);
+      if (prev[i]->CASNext(i, next[i], x)) {
+        break;
+      }
+      FindSpliceForLevel(key, prev[i], i, &prev[i], &next[i]);
+    }
+  }
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, nullptr);
@@ -9,6 +9,7 @@
 #include "port/thread_annotations.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -373,6 +374,92 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads insert into the same list with InsertConcurrently()
+// while a reader checks that the list stays sorted.
+namespace {
+struct ConcurrentInsertState {
+  static const int kThreads = 4;
+  static const int kPerThread = 20000;
+
+  SkipList<Key, Comparator>* list;
+  port::Mutex mu;
+  port::CondVar cv GUARDED_BY(mu);
+  int next_thread GUARDED_BY(mu);
+  int running GUARDED_BY(mu);
+
+  ConcurrentInsertState() : cv(&mu), next_thread(0), running(0) { }
+};
+}  // namespace
+
+static void ConcurrentInserter(void* arg) {
+  ConcurrentInsertState* state = reinterpret_cast<ConcurrentInsertState*>(arg);
+  int id;
+  {
+    MutexLock l(&state->mu);
+    id = state->next_thread++;
+  }
+  Random rnd(id + 1);
+  for (int i = 0; i < ConcurrentInsertState::kPerThread; i++) {
+    // Keys of different threads interleave but never collide
+    Key k = (static_cast<Key>(rnd.Next()) << 8) |
+            static_cast<Key>(i % 64) << 2 | id;
+    if (!state->list->Contains(k)) {
+      state->list->InsertConcurrently(k);
+    }
+  }
+  MutexLock l(&state->mu);
+  state->running--;
+  state->cv.Signal();
+}
+
+TEST(SkipTest, InsertConcurrently) {
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+  ConcurrentInsertState state;
+  state.list = &list;
+  state.running = ConcurrentInsertState::kThreads;
+  for (int i = 0; i < ConcurrentInsertState::kThreads; i++) {
+    Env::Default()->StartThread(ConcurrentInserter, &state);
+  }
+
+  bool done = false;
+  while (!done) {
+    {
+      MutexLock l(&state.mu);
+      done = (state.running == 0);
+    }
+    SkipList<Key, Comparator>::Iterator iter(&list);
+    iter.SeekToFirst();
+    Key last = 0;
+    bool first = true;
+    for (; iter.Valid(); iter.Next()) {
+      ASSERT_TRUE(first || iter.key() > last);
+      last = iter.key();
+      first = false;
+    }
+  }
+
+  // Replay the inserts to check that none of them got lost
+  std::set<Key> expected;
+  for (int id = 0; id < ConcurrentInsertState::kThreads; id++) {
+    Random rnd(id + 1);
+    for (int i = 0; i < ConcurrentInsertState::kPerThread; i++) {
+      expected.insert((static_cast<Key>(rnd.Next()) << 8) |
+                      static_cast<Key>(i % 64) << 2 | id);
+    }
+  }
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (std::set<Key>::iterator it = expected.begin(); it != expected.end();
+       ++it) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(*it, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,8 +4,11 @@
 
 #include "db/table_cache.h"
 
+#include <vector>
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
+#include "leveldb/pinnable_slice.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
 
@@ -14,65 +17,192 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  // Index of the range tombstones of the table, or nullptr if it has none
+  FragmentedRangeTombstones* range_dels;
+  Status range_del_status;  // Error hit while reading the range tombstones
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->range_dels;
   delete tf->table;
   delete tf->file;
   delete tf;
 }
 
+static void DeleteTableAndFile(void* arg1, void* arg2) {
+  DeleteEntry(Slice(), arg1);
+}
+
 static void UnrefEntry(void* arg1, void* arg2) {
   Cache* cache = reinterpret_cast<Cache*>(arg1);
   Cache::Handle* h = reinterpret_cast<Cache::Handle*>(arg2);
   cache->Release(h);
 }
 
+static void DeleteRow(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+// A row cache entry holds the entry that a lookup in a table passed to
+// its handle_result callback, encoded as:
+//    key:   length-prefixed internal key
+//    value: the remaining bytes
+// or is empty if the lookup found no entry.
+struct RowRecorder {
+  void* arg;
+  void (*handle_result)(void*, const Slice&, const Slice&);
+  std::string row;
+};
+
+static void RecordRow(void* arg, const Slice& k, const Slice& v) {
+  RowRecorder* recorder = reinterpret_cast<RowRecorder*>(arg);
+  PutLengthPrefixedSlice(&recorder->row, k);
+  recorder->row.append(v.data(), v.size());
+  (*recorder->handle_result)(recorder->arg, k, v);
+}
+
+namespace {
+
+// Iterator over a table for a read with ReadOptions::prefix_same_as_start.
+// A Seek() to a target whose prefix the filters of the table rule out
+// leaves the iterator invalid without reading any data block.
+class PrefixFilteringIterator : public Iterator {
+ public:
+  PrefixFilteringIterator(Iterator* iter, const Table* table,
+                          const SliceTransform* prefix_extractor)
+      : iter_(iter),
+        table_(table),
+        prefix_extractor_(prefix_extractor),
+        filtered_(false) {
+  }
+  virtual ~PrefixFilteringIterator() {
+    delete iter_;
+  }
+  virtual bool Valid() const { return !filtered_ && iter_->Valid(); }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+  virtual void SeekToFirst() {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  virtual void SeekToLast() {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  virtual void Seek(const Slice& target) {
+    const Slice user_key = ExtractUserKey(target);
+    filtered_ = false;
+    if (prefix_extractor_->InDomain(user_key)) {
+      InternalKey prefix_key(prefix_extractor_->Transform(user_key),
+                             kMaxSequenceNumber, kValueTypeForSeek);
+      filtered_ = !table_->PrefixMayMatch(target, prefix_key.Encode());
+    }
+    if (!filtered_) {
+      iter_->Seek(target);
+    }
+  }
+
+ private:
+  Iterator* const iter_;
+  const Table* const table_;
+  const SliceTransform* const prefix_extractor_;
+  bool filtered_;  // Whether the last Seek() was ruled out by the filters
+};
+
+}  // anonymous namespace
+
 TableCache::TableCache(const std::string& dbname,
                        const Options& options,
                        int entries)
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {
+      cache_(NewLRUCache(entries)),
+      row_cache_id_(options.row_cache != nullptr ?
+                    options.row_cache->NewId() : 0),
+      row_cache_hits_(0),
+      row_cache_misses_(0) {
 }
 
 TableCache::~TableCache() {
   delete cache_;
 }
 
+Status TableCache::OpenTable(uint64_t file_number, uint64_t file_size,
+                             int level, bool compaction_input,
+                             RandomAccessFile** file, Table** table) {
+  *file = nullptr;
+  *table = nullptr;
+  const bool direct = compaction_input ? options_.use_direct_compaction_reads
+                                       : options_.use_direct_reads;
+  std::string fname = TableFileName(dbname_, file_number);
+  Status s = direct ? env_->NewDirectRandomAccessFile(fname, file)
+                    : env_->NewRandomAccessFile(fname, file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    if ((direct ? env_->NewDirectRandomAccessFile(old_fname, file)
+                : env_->NewRandomAccessFile(old_fname, file)).ok()) {
+      s = Status::OK();
+    }
+  }
+  if (s.ok()) {
+    if (compaction_input) {
+      // The table is read once, from start to end, and then deleted: keep
+      // its index out of the block cache and do not read its filter
+      Options table_options = options_;
+      table_options.cache_index_and_filter_blocks = false;
+      table_options.pin_l0_filter_and_index_blocks_in_cache = false;
+      table_options.filter_policy = nullptr;
+      s = Table::Open(table_options, *file, file_size, table);
+    } else if (level != 0 &&
+               options_.pin_l0_filter_and_index_blocks_in_cache) {
+      Options table_options = options_;
+      table_options.pin_l0_filter_and_index_blocks_in_cache = false;
+      s = Table::Open(table_options, *file, file_size, table);
+    } else {
+      s = Table::Open(options_, *file, file_size, table);
+    }
+  }
+  if (!s.ok()) {
+    assert(*table == nullptr);
+    delete *file;
+    *file = nullptr;
+  }
+  return s;
+}
+
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
-                             Cache::Handle** handle) {
+                             int level, Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   Slice key(buf, sizeof(buf));
   *handle = cache_->Lookup(key);
   if (*handle == nullptr) {
-    std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
     Table* table = nullptr;
-    s = env_->NewRandomAccessFile(fname, &file);
-    if (!s.ok()) {
-      std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
-        s = Status::OK();
-      }
-    }
+    s = OpenTable(file_number, file_size, level, false, &file, &table);
+    // We do not cache error results so that if the error is transient,
+    // or somebody repairs the file, we recover automatically.
     if (s.ok()) {
-      s = Table::Open(options_, file, file_size, &table);
-    }
-
-    if (!s.ok()) {
-      assert(table == nullptr);
-      delete file;
-      // We do not cache error results so that if the error is transient,
-      // or somebody repairs the file, we recover automatically.
-    } else {
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->range_dels = nullptr;
+      Iterator* iter = table->NewRangeDeletionIterator();
+      iter->SeekToFirst();
+      if (iter->Valid()) {
+        // options_.comparator is the internal key comparator of the DB
+        const Comparator* ucmp = static_cast<const InternalKeyComparator*>(
+            options_.comparator)->user_comparator();
+        tf->range_dels = new FragmentedRangeTombstones(ucmp, iter);
+      }
+      tf->range_del_status = iter->status();
+      delete iter;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -82,19 +212,25 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
-                                  Table** tableptr) {
+                                  Table** tableptr,
+                                  int level) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-  Iterator* result = table->NewIterator(options);
+  Iterator* result = table->NewIterator(options, &readahead_stats_);
+  if (options.prefix_same_as_start && options_.prefix_extractor != nullptr &&
+      options_.filter_policy != nullptr) {
+    result = new PrefixFilteringIterator(result, table,
+                                         options_.prefix_extractor);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != nullptr) {
     *tableptr = table;
@@ -102,17 +238,210 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewCompactionInputIterator(const ReadOptions& options,
+                                                 uint64_t file_number,
+                                                 uint64_t file_size,
+                                                 int level) {
+  if (options_.use_direct_compaction_reads == options_.use_direct_reads) {
+    return NewIterator(options, file_number, file_size, nullptr, level);
+  }
+
+  // The cached table reads the file the other way, so open it again
+  RandomAccessFile* file;
+  Table* table;
+  Status s = OpenTable(file_number, file_size, level, true, &file, &table);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  TableAndFile* tf = new TableAndFile;
+  tf->file = file;
+  tf->table = table;
+  tf->range_dels = nullptr;
+  Iterator* result = table->NewIterator(options, &readahead_stats_);
+  result->RegisterCleanup(&DeleteTableAndFile, tf, nullptr);
+  return result;
+}
+
+Iterator* TableCache::NewRangeDeletionIterator(uint64_t file_number,
+                                               uint64_t file_size) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, -1, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewRangeDeletionIterator();
+  result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  return result;
+}
+
+Status TableCache::MaxCoveringTombstones(uint64_t file_number,
+                                         uint64_t file_size,
+                                         int n,
+                                         const Slice* keys,
+                                         SequenceNumber* seqs) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, -1, &handle);
+  if (!s.ok()) {
+    return s;
+  }
+
+  const TableAndFile* tf =
+      reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  for (int i = 0; i < n; i++) {
+    seqs[i] = 0;
+    if (tf->range_dels != nullptr) {
+      const uint64_t tag = DecodeFixed64(keys[i].data() + keys[i].size() - 8);
+      seqs[i] = tf->range_dels->MaxCoveringSeq(ExtractUserKey(keys[i]),
+                                               tag >> 8);
+    }
+  }
+  s = tf->range_del_status;
+  cache_->Release(handle);
+  return s;
+}
+
+void TableCache::RowCacheKey(const ReadOptions& options,
+                             uint64_t file_number, const Slice& k,
+                             std::string* key) const {
+  // Table files never change, so a lookup without a snapshot, which sees
+  // every entry of the file, always finds the same entry.  Lookups at a
+  // snapshot may not, and also key their rows by its sequence number.
+  uint64_t snapshot = 0;
+  if (options.snapshot != nullptr) {
+    snapshot = 1 + (DecodeFixed64(k.data() + k.size() - 8) >> 8);
+  }
+  key->clear();
+  PutFixed64(key, row_cache_id_);
+  PutFixed64(key, file_number);
+  PutVarint64(key, snapshot);
+  const Slice user_key = ExtractUserKey(k);
+  key->append(user_key.data(), user_key.size());
+}
+
+bool TableCache::ReplayRow(
+    const Slice& row_key, void* arg,
+    void (*saver)(void*, const Slice&, const Slice&),
+    PinnableSlice* pinned_value) {
+  Cache* row_cache = options_.row_cache;
+  Cache::Handle* handle = row_cache->Lookup(row_key);
+  if (handle == nullptr) {
+    row_cache_misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  row_cache_hits_.fetch_add(1, std::memory_order_relaxed);
+  Slice row(*reinterpret_cast<std::string*>(row_cache->Value(handle)));
+  Slice found_key;
+  if (GetLengthPrefixedSlice(&row, &found_key)) {
+    (*saver)(arg, found_key, row);
+    if (pinned_value != nullptr) {
+      pinned_value->PinSlice(row, &UnrefEntry, row_cache, handle);
+      return true;
+    }
+  }
+  row_cache->Release(handle);
+  return true;
+}
+
+void TableCache::InsertRow(const Slice& row_key, const std::string& row) {
+  Cache* row_cache = options_.row_cache;
+  std::string* value = new std::string(row);
+  row_cache->Release(row_cache->Insert(row_key, value,
+                                       row_key.size() + value->size(),
+                                       &DeleteRow));
+}
+
 Status TableCache::Get(const ReadOptions& options,
                        uint64_t file_number,
                        uint64_t file_size,
                        const Slice& k,
                        void* arg,
-                       void (*saver)(void*, const Slice&, const Slice&)) {
+                       void (*saver)(void*, const Slice&, const Slice&),
+                       int level,
+                       PinnableSlice* pinned_value) {
+  std::string row_key;
+  if (options_.row_cache != nullptr) {
+    RowCacheKey(options, file_number, k, &row_key);
+    if (ReplayRow(row_key, arg, saver, pinned_value)) {
+      return Status::OK();
+    }
+  }
+
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, saver);
+    if (options_.row_cache != nullptr) {
+      RowRecorder recorder;
+      recorder.arg = arg;
+      recorder.handle_result = saver;
+      s = t->InternalGet(options, k, &recorder, &RecordRow, pinned_value);
+      if (s.ok() && options.fill_cache) {
+        InsertRow(row_key, recorder.row);
+      }
+    } else {
+      s = t->InternalGet(options, k, arg, saver, pinned_value);
+    }
+    if (pinned_value != nullptr && pinned_value->IsPinned()) {
+      // The table owns the file that a pinned block may be mapped from
+      pinned_value->RegisterCleanup(&UnrefEntry, cache_, handle);
+    } else {
+      cache_->Release(handle);
+    }
+  }
+  return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options,
+                            uint64_t file_number,
+                            uint64_t file_size,
+                            int n,
+                            const Slice* keys,
+                            void* const* args,
+                            void (*saver)(void*, const Slice&, const Slice&),
+                            int level) {
+  // Keys whose rows are not in options.row_cache
+  std::vector<Slice> missing_keys;
+  std::vector<std::string> row_keys;
+  std::vector<RowRecorder> recorders;
+  std::vector<void*> recorder_args;
+  if (options_.row_cache != nullptr) {
+    std::string row_key;
+    for (int i = 0; i < n; i++) {
+      RowCacheKey(options, file_number, keys[i], &row_key);
+      if (!ReplayRow(row_key, args[i], saver)) {
+        missing_keys.push_back(keys[i]);
+        row_keys.push_back(row_key);
+        RowRecorder recorder;
+        recorder.arg = args[i];
+        recorder.handle_result = saver;
+        recorders.push_back(recorder);
+      }
+    }
+    if (missing_keys.empty()) {
+      return Status::OK();
+    }
+    for (size_t i = 0; i < recorders.size(); i++) {
+      recorder_args.push_back(&recorders[i]);
+    }
+  }
+
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, level, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    if (options_.row_cache != nullptr) {
+      s = t->InternalMultiGet(options, missing_keys.size(), &missing_keys[0],
+                              &recorder_args[0], &RecordRow);
+      if (s.ok() && options.fill_cache) {
+        for (size_t i = 0; i < recorders.size(); i++) {
+          InsertRow(row_keys[i], recorders[i].row);
+        }
+      }
+    } else {
+      s = t->InternalMultiGet(options, n, keys, args, saver);
+    }
     cache_->Release(handle);
   }
   return s;
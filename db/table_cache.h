@@ -7,11 +7,13 @@
 #ifndef STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 #define STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 
+#include <atomic>
 #include <string>
 #include <stdint.h>
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
+#include "table/readahead_file.h"
 #include "port/port.h"
 
 namespace leveldb {
@@ -30,30 +32,121 @@ class TableCache {
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
+  //
+  // "level" is the level of the file if known, or -1.  Tables of level-0
+  // files pin their index and filter blocks in the block cache if
+  // options.pin_l0_filter_and_index_blocks_in_cache is set.  Since the
+  // table stays open, it keeps doing so after the file moves to another
+  // level.
   Iterator* NewIterator(const ReadOptions& options,
                         uint64_t file_number,
                         uint64_t file_size,
-                        Table** tableptr = nullptr);
+                        Table** tableptr = nullptr,
+                        int level = -1);
+
+  // Like NewIterator(), for reading the file as the input of a
+  // compaction.  If options.use_direct_compaction_reads differs from
+  // options.use_direct_reads, the file is opened anew, outside the cache,
+  // and read the way compactions should read it, without its filter and
+  // without putting its index blocks in the block cache.
+  Iterator* NewCompactionInputIterator(const ReadOptions& options,
+                                       uint64_t file_number,
+                                       uint64_t file_size,
+                                       int level = -1);
+
+  // Return an iterator over the range tombstones of the specified file
+  // (see db/range_del.h).
+  Iterator* NewRangeDeletionIterator(uint64_t file_number,
+                                     uint64_t file_size);
+
+  // For every i in [0,n-1], store in seqs[i] the largest sequence number,
+  // at most that of internal key keys[i], of the range tombstones of the
+  // specified file that cover the user key of keys[i], or 0 if there is
+  // no such tombstone.  The tombstones of a file are indexed once, when
+  // its table is opened.
+  Status MaxCoveringTombstones(uint64_t file_number,
+                               uint64_t file_size,
+                               int n,
+                               const Slice* keys,
+                               SequenceNumber* seqs);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  If
+  // "pinned_value" is non-null, found_value is also pinned in it, along
+  // with the table or row cache entry it lives in.
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t file_size,
              const Slice& k,
              void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             int level = -1,
+             PinnableSlice* pinned_value = nullptr);
+
+  // Like calling Get(options, file_number, file_size, keys[i], args[i],
+  // handle_result) for every i in [0,n-1], but the table is looked up in
+  // the cache once and each of its data blocks is read at most once.
+  // REQUIRES: keys[0,n-1] are sorted in increasing order.
+  Status MultiGet(const ReadOptions& options,
+                  uint64_t file_number,
+                  uint64_t file_size,
+                  int n,
+                  const Slice* keys,
+                  void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&),
+                  int level = -1);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Number of lookups of a key in a file that options.row_cache answered
+  // and could not answer.  Get() and MultiGet() consult it if it is set.
+  uint64_t RowCacheHits() const { return row_cache_hits_.load(); }
+  uint64_t RowCacheMisses() const { return row_cache_misses_.load(); }
+
+  // Bytes that iterators over the tables read ahead of their position,
+  // and of those the bytes they went on to use
+  uint64_t ReadaheadBytesRead() const {
+    return readahead_stats_.bytes_read.load();
+  }
+  uint64_t ReadaheadBytesUsed() const {
+    return readahead_stats_.bytes_used.load();
+  }
+
  private:
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+  const uint64_t row_cache_id_;  // Prefix of our keys in options.row_cache
+  std::atomic<uint64_t> row_cache_hits_;
+  std::atomic<uint64_t> row_cache_misses_;
+  ReadaheadStats readahead_stats_;
+
+  // Stores in *key the options.row_cache key of the result of a lookup
+  // of internal key "k" in file "file_number"
+  void RowCacheKey(const ReadOptions& options, uint64_t file_number,
+                   const Slice& k, std::string* key) const;
+
+  // Looks up "row_key" in options.row_cache.  On a hit, calls
+  // (*handle_result)(arg, ...) if the cached lookup found an entry and
+  // returns true.  The value is pinned in *pinned_value if that is
+  // non-null.
+  bool ReplayRow(const Slice& row_key, void* arg,
+                 void (*handle_result)(void*, const Slice&, const Slice&),
+                 PinnableSlice* pinned_value = nullptr);
+  void InsertRow(const Slice& row_key, const std::string& row);
 
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  // Opens the table of file "file_number", with
+  // Env::NewDirectRandomAccessFile() if options.use_direct_reads, or
+  // options.use_direct_compaction_reads for a "compaction_input", is set.
+  // Tables opened as compaction inputs neither read their filter nor
+  // put their index in the block cache.
+  Status OpenTable(uint64_t file_number, uint64_t file_size, int level,
+                   bool compaction_input, RandomAccessFile** file,
+                   Table** table);
+  Status FindTable(uint64_t file_number, uint64_t file_size, int level,
+                   Cache::Handle**);
 };
 
 }  // namespace leveldb
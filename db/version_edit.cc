@@ -20,7 +20,8 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kNewFileWithRangeDeletions = 10
 };
 
 void VersionEdit::Clear() {
@@ -76,7 +77,10 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // Files without range tombstones keep the old encoding so that the
+    // manifest stays readable by older releases.
+    PutVarint32(dst, f.has_range_deletions ? kNewFileWithRangeDeletions
+                                           : kNewFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
@@ -181,11 +185,13 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileWithRangeDeletions:
         if (GetLevel(&input, &level) &&
             GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.has_range_deletions = (tag == kNewFileWithRangeDeletions);
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
@@ -258,6 +264,9 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.has_range_deletions) {
+      r.append(" (range deletions)");
+    }
   }
   r.append("\n}\n");
   return r;
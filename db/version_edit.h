@@ -21,8 +21,12 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
+  bool being_compacted;       // Input of a running compaction?
+  bool has_range_deletions;   // Table holds range tombstones?
 
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0),
+        being_compacted(false), has_range_deletions(false) { }
 };
 
 class VersionEdit {
@@ -59,15 +63,18 @@ class VersionEdit {
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  //           (including the ranges of its range tombstones, if any)
   void AddFile(int level, uint64_t file,
                uint64_t file_size,
                const InternalKey& smallest,
-               const InternalKey& largest) {
+               const InternalKey& largest,
+               bool has_range_deletions = false) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_deletions = has_range_deletions;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -10,8 +10,10 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/pinnable_slice.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
@@ -160,32 +162,91 @@ bool SomeFileOverlapsRange(
 // is the largest key that occurs in the file, and value() is an
 // 16-byte value containing the file number and file size, both
 // encoded using EncodeFixed64.
+//
+// If "prefix_extractor" is non-null, a Seek() to a target with a prefix
+// only yields the files that may hold keys with that prefix at or after
+// the target, which lets a prefix-scoped read of the level stop without
+// opening the files past the prefix.
+//
+// If "lower_bound" or "upper_bound" is non-null, only the files that
+// hold keys at or after *lower_bound and before *upper_bound (internal
+// keys) are yielded.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
-                       const std::vector<FileMetaData*>* flist)
+                       const std::vector<FileMetaData*>* flist,
+                       const SliceTransform* prefix_extractor,
+                       const Slice* lower_bound = nullptr,
+                       const Slice* upper_bound = nullptr)
       : icmp_(icmp),
         flist_(flist),
-        index_(flist->size()) {        // Marks as invalid
+        prefix_extractor_(prefix_extractor),
+        begin_(0),
+        end_(flist->size()),
+        bounded_(false) {
+    if (lower_bound != nullptr) {
+      begin_ = FindFile(icmp_, *flist_, *lower_bound);
+    }
+    if (upper_bound != nullptr) {
+      // The first file that starts at or after the upper bound
+      uint32_t left = begin_;
+      uint32_t right = end_;
+      while (left < right) {
+        uint32_t mid = (left + right) / 2;
+        if (icmp_.Compare((*flist_)[mid]->smallest.Encode(),
+                          *upper_bound) < 0) {
+          left = mid + 1;
+        } else {
+          right = mid;
+        }
+      }
+      end_ = right;
+    }
+    index_ = end_;  // Marks as invalid
   }
   virtual bool Valid() const {
-    return index_ < flist_->size();
+    return index_ < end_;
   }
   virtual void Seek(const Slice& target) {
-    index_ = FindFile(icmp_, *flist_, target);
+    index_ = std::max<uint32_t>(FindFile(icmp_, *flist_, target), begin_);
+    if (index_ > end_) {
+      index_ = end_;
+    }
+    bounded_ = false;
+    if (prefix_extractor_ != nullptr) {
+      const Slice user_key = ExtractUserKey(target);
+      if (prefix_extractor_->InDomain(user_key)) {
+        const Slice prefix = prefix_extractor_->Transform(user_key);
+        prefix_.assign(prefix.data(), prefix.size());
+        bounded_ = true;
+        // A file that starts after "target" without the prefix is past
+        // all keys with the prefix
+        if (Valid() &&
+            icmp_.Compare((*flist_)[index_]->smallest.Encode(), target) > 0) {
+          CheckSmallestHasPrefix();
+        }
+      }
+    }
+  }
+  virtual void SeekToFirst() {
+    index_ = begin_;
+    bounded_ = false;
   }
-  virtual void SeekToFirst() { index_ = 0; }
   virtual void SeekToLast() {
-    index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    index_ = (end_ == begin_) ? end_ : end_ - 1;
+    bounded_ = false;
   }
   virtual void Next() {
     assert(Valid());
     index_++;
+    if (bounded_ && Valid()) {
+      CheckSmallestHasPrefix();
+    }
   }
   virtual void Prev() {
     assert(Valid());
-    if (index_ == 0) {
-      index_ = flist_->size();  // Marks as invalid
+    if (index_ == begin_) {
+      index_ = end_;  // Marks as invalid
     } else {
       index_--;
     }
@@ -202,9 +263,24 @@ class Version::LevelFileNumIterator : public Iterator {
   }
   virtual Status status() const { return Status::OK(); }
  private:
+  // Marks the iterator as invalid if the current file does not start
+  // with a key that has prefix_.
+  void CheckSmallestHasPrefix() {
+    const Slice smallest = (*flist_)[index_]->smallest.user_key();
+    if (!prefix_extractor_->InDomain(smallest) ||
+        prefix_extractor_->Transform(smallest) != Slice(prefix_)) {
+      index_ = end_;
+    }
+  }
+
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  const SliceTransform* const prefix_extractor_;
+  uint32_t begin_;      // Files [begin_, end_) of flist_ are yielded
+  uint32_t end_;
   uint32_t index_;
+  bool bounded_;        // Whether Seek() set prefix_
+  std::string prefix_;  // Prefix of the target of the last Seek()
 
   // Backing store for value().  Holds the file number and size.
   mutable char value_buf_[16];
@@ -224,10 +300,31 @@ static Iterator* GetFileIterator(void* arg,
   }
 }
 
+// Like GetFileIterator(), for the input files of a compaction
+static Iterator* GetCompactionFileIterator(void* arg,
+                                           const ReadOptions& options,
+                                           const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewCompactionInputIterator(
+        options, DecodeFixed64(file_value.data()),
+        DecodeFixed64(file_value.data() + 8));
+  }
+}
+
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
+  const SliceTransform* prefix_extractor = nullptr;
+  if (options.prefix_same_as_start) {
+    prefix_extractor = vset_->options_->prefix_extractor;
+  }
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]),
+      new LevelFileNumIterator(vset_->icmp_, &files_[level],
+                               prefix_extractor, options.iterate_lower_bound,
+                               options.iterate_upper_bound),
       &GetFileIterator, vset_->table_cache_, options);
 }
 
@@ -235,9 +332,20 @@ void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
+    const FileMetaData* f = files_[0][i];
+    if ((options.iterate_lower_bound != nullptr &&
+         vset_->icmp_.Compare(f->largest.Encode(),
+                              *options.iterate_lower_bound) < 0) ||
+        (options.iterate_upper_bound != nullptr &&
+         vset_->icmp_.Compare(f->smallest.Encode(),
+                              *options.iterate_upper_bound) >= 0)) {
+      // No keys within the bounds
+      continue;
+    }
     iters->push_back(
         vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+            options, files_[0][i]->number, files_[0][i]->file_size,
+            nullptr, 0));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -262,7 +370,8 @@ struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
-  std::string* value;
+  std::string* value;        // Null if the value is pinned instead
+  SequenceNumber tombstone;  // Entries older than this are deleted
 };
 }
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -272,14 +381,34 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
+      if (parsed_key.sequence < s->tombstone) {
+        s->state = kDeleted;
+      } else {
+        s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      }
+      if (s->state == kFound && s->value != nullptr) {
         s->value->assign(v.data(), v.size());
       }
     }
   }
 }
 
+// Stores in *seq the largest sequence number visible to "k" of the range
+// tombstones in "f" that cover the user key of "k", or 0 if there is none.
+// A covering tombstone deletes the older entries in "f" and, as entries
+// never move to a smaller level, all entries in files searched after "f".
+static Status FindCoveringTombstone(TableCache* table_cache,
+                                    FileMetaData* f, const LookupKey& k,
+                                    SequenceNumber* seq) {
+  *seq = 0;
+  if (!f->has_range_deletions) {
+    return Status::OK();
+  }
+  const Slice ikey = k.internal_key();
+  return table_cache->MaxCoveringTombstones(f->number, f->file_size,
+                                            1, &ikey, seq);
+}
+
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
@@ -331,7 +460,7 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
 
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
-                    std::string* value,
+                    PinnableSlice* value,
                     GetStats* stats) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
@@ -404,12 +533,25 @@ Status Version::Get(const ReadOptions& options,
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
-      saver.value = value;
+      saver.value = nullptr;
+      s = FindCoveringTombstone(vset_->table_cache_, f, k,
+                                &saver.tombstone);
+      if (!s.ok()) {
+        return s;
+      }
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
-                                   ikey, &saver, SaveValue);
+                                   ikey, &saver, SaveValue, level, value);
+      if (saver.state != kFound) {
+        // Only the entry found is kept pinned
+        value->Reset();
+      }
       if (!s.ok()) {
         return s;
       }
+      assert(saver.state != kFound || value->IsPinned());
+      if (saver.state == kNotFound && saver.tombstone > 0) {
+        saver.state = kDeleted;
+      }
       switch (saver.state) {
         case kNotFound:
           break;      // Keep searching in other files
@@ -428,6 +570,209 @@ Status Version::Get(const ReadOptions& options,
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+namespace {
+// State of one key looked up by Version::MultiGet()
+struct MultiGetKey {
+  const LookupKey* key;
+  Saver saver;
+  Status* status;
+  Version::GetStats* stats;
+  FileMetaData* last_file_read;
+  int last_file_read_level;
+  bool done;
+};
+}  // namespace
+
+// Searches file "f" at "level" for all keys in "batch", in the same way
+// as the loop body of Version::Get() does for a single key.
+static void MultiGetFromFile(TableCache* table_cache,
+                             const ReadOptions& options,
+                             int level, FileMetaData* f,
+                             const std::vector<MultiGetKey*>& batch,
+                             std::vector<Slice>* ikeys,
+                             std::vector<void*>* args) {
+  ikeys->clear();
+  args->clear();
+  for (size_t i = 0; i < batch.size(); i++) {
+    MultiGetKey* k = batch[i];
+    if (k->last_file_read != nullptr && k->stats->seek_file == nullptr) {
+      // We have had more than one seek for this read.  Charge the 1st file.
+      k->stats->seek_file = k->last_file_read;
+      k->stats->seek_file_level = k->last_file_read_level;
+    }
+    k->last_file_read = f;
+    k->last_file_read_level = level;
+    k->saver.state = kNotFound;
+    k->saver.tombstone = 0;
+    ikeys->push_back(k->key->internal_key());
+    args->push_back(&k->saver);
+  }
+  Status s;
+  if (f->has_range_deletions) {
+    std::vector<SequenceNumber> tombstones(batch.size());
+    s = table_cache->MaxCoveringTombstones(f->number, f->file_size,
+                                           batch.size(), &(*ikeys)[0],
+                                           &tombstones[0]);
+    for (size_t i = 0; i < batch.size(); i++) {
+      batch[i]->saver.tombstone = tombstones[i];
+    }
+  }
+  if (s.ok()) {
+    s = table_cache->MultiGet(options, f->number, f->file_size,
+                              batch.size(), &(*ikeys)[0], &(*args)[0],
+                              SaveValue, level);
+  }
+  for (size_t i = 0; i < batch.size(); i++) {
+    MultiGetKey* k = batch[i];
+    if (!s.ok()) {
+      *k->status = s;
+      k->done = true;
+      continue;
+    }
+    if (k->saver.state == kNotFound && k->saver.tombstone > 0) {
+      k->saver.state = kDeleted;
+    }
+    switch (k->saver.state) {
+      case kNotFound:
+        break;      // Keep searching in other files
+      case kFound:
+        k->done = true;
+        break;
+      case kDeleted:
+        *k->status = Status::NotFound(Slice());
+        k->done = true;
+        break;
+      case kCorrupt:
+        *k->status = Status::Corruption("corrupted key for ",
+                                        k->saver.user_key);
+        k->done = true;
+        break;
+    }
+  }
+}
+
+void Version::MultiGet(const ReadOptions& options, int n,
+                       const LookupKey* const* keys,
+                       std::string* const* values, Status* statuses,
+                       GetStats* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  std::vector<MultiGetKey> state(n);
+  std::vector<MultiGetKey*> pending;
+  pending.reserve(n);
+  for (int i = 0; i < n; i++) {
+    MultiGetKey* k = &state[i];
+    k->key = keys[i];
+    k->saver.ucmp = ucmp;
+    k->saver.user_key = keys[i]->user_key();
+    k->saver.value = values[i];
+    k->status = &statuses[i];
+    k->stats = &stats[i];
+    k->stats->seek_file = nullptr;
+    k->stats->seek_file_level = -1;
+    k->last_file_read = nullptr;
+    k->last_file_read_level = -1;
+    k->done = false;
+    statuses[i] = Status();
+    pending.push_back(k);
+  }
+
+  std::vector<Slice> ikeys;
+  std::vector<void*> args;
+  std::vector<MultiGetKey*> batch;
+
+  // As in Get(), search level-by-level.  Within a level, all keys that
+  // have to look at the same file are handed to it together.
+  for (int level = 0; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    if (level == 0) {
+      // Level-0 files may overlap each other.  Visit them from newest to
+      // oldest, so every key sees the files that overlap it in the same
+      // order as in Get().
+      std::vector<FileMetaData*> tmp(files_[0]);
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+      for (size_t i = 0; i < tmp.size(); i++) {
+        FileMetaData* f = tmp[i];
+        batch.clear();
+        for (size_t j = 0; j < pending.size(); j++) {
+          MultiGetKey* k = pending[j];
+          if (!k->done &&
+              ucmp->Compare(k->saver.user_key, f->smallest.user_key()) >= 0 &&
+              ucmp->Compare(k->saver.user_key, f->largest.user_key()) <= 0) {
+            batch.push_back(k);
+          }
+        }
+        if (!batch.empty()) {
+          MultiGetFromFile(vset_->table_cache_, options, level, f, batch,
+                           &ikeys, &args);
+        }
+      }
+    } else {
+      // Keys are sorted, so the keys that go to the same file are
+      // adjacent in "pending".
+      FileMetaData* batch_file = nullptr;
+      batch.clear();
+      for (size_t j = 0; j <= pending.size(); j++) {
+        FileMetaData* f = nullptr;
+        if (j < pending.size()) {
+          MultiGetKey* k = pending[j];
+          // Binary search to find earliest index whose largest key >= ikey.
+          uint32_t index = FindFile(vset_->icmp_, files_[level],
+                                    k->key->internal_key());
+          if (index < num_files &&
+              ucmp->Compare(k->saver.user_key,
+                            files_[level][index]->smallest.user_key()) >= 0) {
+            f = files_[level][index];
+          }
+        }
+        if (f != batch_file || j == pending.size()) {
+          if (!batch.empty()) {
+            MultiGetFromFile(vset_->table_cache_, options, level,
+                             batch_file, batch, &ikeys, &args);
+          }
+          batch.clear();
+          batch_file = f;
+        }
+        if (f != nullptr) {
+          batch.push_back(pending[j]);
+        }
+      }
+    }
+
+    // Drop the keys that have been resolved at this level
+    size_t remaining = 0;
+    for (size_t j = 0; j < pending.size(); j++) {
+      if (!pending[j]->done) {
+        pending[remaining++] = pending[j];
+      }
+    }
+    pending.resize(remaining);
+  }
+
+  for (size_t j = 0; j < pending.size(); j++) {
+    *pending[j]->status = Status::NotFound(Slice());
+  }
+}
+
+Status Version::AddRangeTombstones(SequenceNumber snapshot,
+                                   RangeDelMap* map) {
+  Status s;
+  for (int level = 0; level < config::kNumLevels && s.ok(); level++) {
+    for (size_t i = 0; i < files_[level].size() && s.ok(); i++) {
+      FileMetaData* f = files_[level][i];
+      if (f->has_range_deletions) {
+        Iterator* iter = vset_->table_cache_->NewRangeDeletionIterator(
+            f->number, f->file_size);
+        s = map->AddTombstones(iter, snapshot);
+        delete iter;
+      }
+    }
+  }
+  return s;
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -513,6 +858,11 @@ int Version::PickLevelForMemTableOutput(
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
+      if (vset_->RangeBeingCompacted(level + 1, smallest_user_key,
+                                     largest_user_key)) {
+        // A running compaction may add overlapping files to "level + 1".
+        break;
+      }
       if (level + 2 < config::kNumLevels) {
         // Check that file does not overlap too many grandparent bytes.
         GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
@@ -773,6 +1123,13 @@ class VersionSet::Builder {
   }
 };
 
+// Information kept for every LogAndApply() caller waiting its turn
+struct VersionSet::ManifestWriter {
+  port::CondVar cv;
+
+  explicit ManifestWriter(port::Mutex* mu) : cv(mu) { }
+};
+
 VersionSet::VersionSet(const std::string& dbname,
                        const Options* options,
                        TableCache* table_cache,
@@ -819,6 +1176,15 @@ void VersionSet::AppendVersion(Version* v) {
 }
 
 Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
+  // Wait until earlier callers have installed their versions.  Several
+  // background compactions may finish at about the same time, and each
+  // new version must be built on top of the one installed before it.
+  ManifestWriter w(mu);
+  manifest_writers_.push_back(&w);
+  while (&w != manifest_writers_.front()) {
+    w.cv.Wait();
+  }
+
   if (edit->has_log_number_) {
     assert(edit->log_number_ >= log_number_);
     assert(edit->log_number_ < next_file_number_);
@@ -831,7 +1197,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  edit->SetLastSequence(LastSequence());
 
   Version* v = new Version(this);
   {
@@ -900,6 +1266,10 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     }
   }
 
+  manifest_writers_.pop_front();
+  if (!manifest_writers_.empty()) {
+    manifest_writers_.front()->cv.Signal();
+  }
   return s;
 }
 
@@ -1014,7 +1384,7 @@ Status VersionSet::Recover(bool *save_manifest) {
     AppendVersion(v);
     manifest_file_number_ = next_file;
     next_file_number_ = next_file + 1;
-    last_sequence_ = last_sequence;
+    SetLastSequence(last_sequence);
     log_number_ = log_number;
     prev_log_number_ = prev_log_number;
 
@@ -1067,9 +1437,9 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
 }
 
 void VersionSet::Finalize(Version* v) {
-  // Precomputed best level for next compaction
-  int best_level = -1;
+  // Precomputed best score for next compaction
   double best_score = -1;
+  uint64_t pending_bytes = 0;
 
   for (int level = 0; level < config::kNumLevels-1; level++) {
     double score;
@@ -1087,21 +1457,29 @@ void VersionSet::Finalize(Version* v) {
       // overwrites/deletions).
       score = v->files_[level].size() /
           static_cast<double>(config::kL0_CompactionTrigger);
+      if (score >= 1) {
+        // All of level-0 gets compacted
+        pending_bytes += TotalFileSize(v->files_[level]);
+      }
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+      const double max_bytes = MaxBytesForLevel(options_, level);
+      score = static_cast<double>(level_bytes) / max_bytes;
+      if (score >= 1) {
+        // The excess has to be pushed into the next level
+        pending_bytes += level_bytes - static_cast<uint64_t>(max_bytes);
+      }
     }
 
+    v->level_scores_[level] = score;
     if (score > best_score) {
-      best_level = level;
       best_score = score;
     }
   }
 
-  v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+  v->pending_compaction_bytes_ = pending_bytes;
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1125,7 +1503,8 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->has_range_deletions);
     }
   }
 
@@ -1264,6 +1643,7 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  options.prefetch_blocks = options_->compaction_prefetch_blocks;
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1276,14 +1656,15 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(
-              options, files[i]->number, files[i]->file_size);
+          list[num++] = table_cache_->NewCompactionInputIterator(
+              options, files[i]->number, files[i]->file_size, 0);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which],
+                                              nullptr),
+            &GetCompactionFileIterator, table_cache_, options);
       }
     }
   }
@@ -1293,41 +1674,160 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
-Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+namespace {
+// Orders user keys by a user comparator
+struct UserKeyLess {
+  const Comparator* user_comparator;
 
-  // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level+1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
+  bool operator()(const Slice& a, const Slice& b) const {
+    return user_comparator->Compare(a, b) < 0;
+  }
+};
+}  // namespace
+
+void VersionSet::GetSubcompactionBoundaries(
+    Compaction* c, int max_ranges, std::vector<std::string>* boundaries) {
+  boundaries->clear();
+  if (max_ranges <= 1) {
+    return;
+  }
+
+  // Candidate split points are the user keys at which input files start
+  // or end.
+  const Comparator* user_cmp = icmp_.user_comparator();
+  std::vector<Slice> keys;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      keys.push_back(c->inputs_[which][i]->smallest.user_key());
+      keys.push_back(c->inputs_[which][i]->largest.user_key());
+    }
+  }
+  UserKeyLess less = { user_cmp };
+  std::sort(keys.begin(), keys.end(), less);
+  size_t num_keys = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (num_keys == 0 || user_cmp->Compare(keys[num_keys - 1], keys[i]) != 0) {
+      keys[num_keys++] = keys[i];
+    }
+  }
+  if (num_keys < 3) {
+    // No key strictly inside the compaction range
+    return;
+  }
+
+  const uint64_t total_bytes =
+      TotalFileSize(c->inputs_[0]) + TotalFileSize(c->inputs_[1]);
+  const uint64_t bytes_per_range = total_bytes / max_ranges;
+  if (bytes_per_range == 0) {
+    return;
+  }
+
+  // Walk the interior candidates and split each time another
+  // bytes_per_range of input has gone by.  Every version of a user key
+  // sorts after the boundary's seek key, so all of them end up in the
+  // same range.
+  for (size_t k = 1; k + 1 < num_keys; k++) {
+    const InternalKey ikey(keys[k], kMaxSequenceNumber, kValueTypeForSeek);
+    uint64_t offset = 0;
+    for (int which = 0; which < 2; which++) {
+      const std::vector<FileMetaData*>& files = c->inputs_[which];
+      for (size_t i = 0; i < files.size(); i++) {
+        if (icmp_.Compare(files[i]->largest, ikey) <= 0) {
+          // Entire file is before "ikey", so just add the file size
+          offset += files[i]->file_size;
+        } else if (icmp_.Compare(files[i]->smallest, ikey) < 0) {
+          // "ikey" falls in the range for this table.  Add the
+          // approximate offset of "ikey" within the table.
+          Table* tableptr;
+          Iterator* iter = table_cache_->NewIterator(
+              ReadOptions(), files[i]->number, files[i]->file_size,
+              &tableptr);
+          if (tableptr != nullptr) {
+            offset += tableptr->ApproximateOffsetOf(ikey.Encode());
+          }
+          delete iter;
+        }
+      }
+    }
+    if (offset >= (boundaries->size() + 1) * bytes_per_range) {
+      boundaries->push_back(keys[k].ToString());
+      if (boundaries->size() + 1 == static_cast<size_t>(max_ranges)) {
         break;
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+}
+
+Compaction* VersionSet::PickCompaction() {
+  // We prefer compactions triggered by too much data in a level over
+  // the compactions triggered by seeks.  Levels are tried in decreasing
+  // order of score so that a level whose files are all busy in running
+  // compactions does not hold up work on the others.
+  int levels[config::kNumLevels - 1];
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    levels[level] = level;
+  }
+  const double* scores = current_->level_scores_;
+  for (int i = 1; i < config::kNumLevels - 1; i++) {
+    for (int j = i; j > 0 && scores[levels[j]] > scores[levels[j - 1]]; j--) {
+      std::swap(levels[j], levels[j - 1]);
+    }
+  }
+
+  for (int i = 0; i < config::kNumLevels - 1; i++) {
+    const int level = levels[i];
+    if (scores[level] < 1) {
+      break;
+    }
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+
+    // Start with the first file that comes after compact_pointer_[level],
+    // and wrap around to the beginning of the key space.
+    size_t start = 0;
+    if (!compact_pointer_[level].empty()) {
+      while (start < files.size() &&
+             icmp_.Compare(files[start]->largest.Encode(),
+                           compact_pointer_[level]) <= 0) {
+        start++;
+      }
+      if (start == files.size()) {
+        start = 0;
+      }
+    }
+    for (size_t n = 0; n < files.size(); n++) {
+      FileMetaData* f = files[(start + n) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = new Compaction(options_, level);
+      c->inputs_[0].push_back(f);
+      if (SetupCompaction(c)) {
+        RegisterCompaction(c);
+        return c;
+      }
+      delete c;
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
 
+  FileMetaData* f = current_->file_to_compact_;
+  if (f != nullptr && !f->being_compacted) {
+    Compaction* c = new Compaction(options_, current_->file_to_compact_level_);
+    c->inputs_[0].push_back(f);
+    if (SetupCompaction(c)) {
+      RegisterCompaction(c);
+      return c;
+    }
+    delete c;
+  }
+
+  return nullptr;
+}
+
+bool VersionSet::SetupCompaction(Compaction* c) {
+  const int level = c->level();
+  assert(level >= 0);
+  assert(level+1 < config::kNumLevels);
+
   c->input_version_ = current_;
   c->input_version_->Ref();
 
@@ -1342,9 +1842,44 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
+  const std::string saved_pointer = compact_pointer_[level];
   SetupOtherInputs(c);
 
-  return c;
+  if (c->InputsBeingCompacted() ||
+      RangeBeingCompacted(level + 1, c->smallest_.user_key(),
+                          c->largest_.user_key())) {
+    compact_pointer_[level] = saved_pointer;
+    return false;
+  }
+  return true;
+}
+
+void VersionSet::RegisterCompaction(Compaction* c) {
+  c->MarkInputsBeingCompacted(true);
+  compactions_in_progress_.insert(c);
+}
+
+bool VersionSet::RangeBeingCompacted(int level,
+                                     const Slice& smallest_user_key,
+                                     const Slice& largest_user_key) const {
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (std::set<Compaction*>::const_iterator it =
+           compactions_in_progress_.begin();
+       it != compactions_in_progress_.end();
+       ++it) {
+    const Compaction* c = *it;
+    if (c->level() + 1 != level) {
+      // "c" does not write into "level"
+    } else if (user_cmp->Compare(largest_user_key,
+                                 c->smallest_.user_key()) < 0 ||
+               user_cmp->Compare(smallest_user_key,
+                                 c->largest_.user_key()) > 0) {
+      // No overlap
+    } else {
+      return true;
+    }
+  }
+  return false;
 }
 
 void VersionSet::SetupOtherInputs(Compaction* c) {
@@ -1393,6 +1928,9 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     }
   }
 
+  c->smallest_ = all_start;
+  c->largest_ = all_limit;
+
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
   if (level + 2 < config::kNumLevels) {
@@ -1440,25 +1978,28 @@ Compaction* VersionSet::CompactRange(
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  assert(!c->InputsBeingCompacted());
+  RegisterCompaction(c);
   return c;
 }
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
-      input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      input_version_(nullptr) {
+}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0),
+      seen_key(false),
+      overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
 Compaction::~Compaction() {
-  if (input_version_ != nullptr) {
-    input_version_->Unref();
-  }
+  ReleaseInputs();
 }
 
 bool Compaction::IsTrivialMove() const {
@@ -1477,15 +2018,46 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
       edit->DeleteFile(level_ + which, inputs_[which][i]->number);
     }
   }
+  for (size_t i = 0; i < covered_inputs_.size(); i++) {
+    edit->DeleteFile(level_ + 1, covered_inputs_[i]->number);
+  }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int Compaction::DropCoveredInputs(const RangeDelMap& tombstones) {
+  std::vector<FileMetaData*> kept;
+  for (size_t i = 0; i < inputs_[1].size(); i++) {
+    FileMetaData* f = inputs_[1][i];
+    if (tombstones.CoversRange(f->smallest.user_key(),
+                               f->largest.user_key())) {
+      covered_inputs_.push_back(f);
+    } else {
+      kept.push_back(f);
+    }
+  }
+  const int dropped = inputs_[1].size() - kept.size();
+  inputs_[1].swap(kept);
+  return dropped;
+}
+
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  size_t* level_ptrs = cursor->level_ptrs;
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size(); ) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    for (; level_ptrs[lvl] < files.size(); ) {
+      FileMetaData* f = files[level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1494,37 +2066,67 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (cursor->grandparent_index < grandparents_.size() &&
       icmp->Compare(internal_key,
-                    grandparents_[grandparent_index_]->largest.Encode()) > 0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                    grandparents_[cursor->grandparent_index]->largest.Encode())
+          > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+bool Compaction::InputsBeingCompacted() const {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      if (inputs_[which][i]->being_compacted) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void Compaction::MarkInputsBeingCompacted(bool value) {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      assert(inputs_[which][i]->being_compacted != value);
+      inputs_[which][i]->being_compacted = value;
+    }
+  }
+  for (size_t i = 0; i < covered_inputs_.size(); i++) {
+    assert(covered_inputs_[i]->being_compacted != value);
+    covered_inputs_[i]->being_compacted = value;
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
+    if (input_version_->vset_->compactions_in_progress_.erase(this) > 0) {
+      MarkInputsBeingCompacted(false);
+    }
     input_version_->Unref();
     input_version_ = nullptr;
   }
@@ -15,6 +15,8 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
+#include <deque>
 #include <map>
 #include <set>
 #include <vector>
@@ -30,6 +32,8 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class PinnableSlice;
+class RangeDelMap;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -58,20 +62,39 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
 class Version {
  public:
   // Append to *iters a sequence of iterators that will
-  // yield the contents of this Version when merged together.
+  // yield the contents of this Version when merged together.  If
+  // options.iterate_lower_bound or options.iterate_upper_bound is set,
+  // it is an internal key here, and the files that hold no keys within
+  // the bounds are left out.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
-  // Lookup the value for key.  If found, store it in *val and
+  // Lookup the value for key.  If found, pin it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
+  Status Get(const ReadOptions&, const LookupKey& key, PinnableSlice* val,
              GetStats* stats);
 
+  // Equivalent to calling Get(options, *keys[i], values[i], &stats[i])
+  // and storing the result in statuses[i] for every i in [0,n-1].  Keys
+  // that are looked up in the same table are handed to it together, so
+  // each table is found in the table cache once and each of its data
+  // blocks is read at most once.
+  // REQUIRES: keys[0,n-1] are sorted by user key in increasing order.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, int n, const LookupKey* const* keys,
+                std::string* const* values, Status* statuses,
+                GetStats* stats);
+
+  // Add to *map the range tombstones of every file in this version whose
+  // sequence number is at most "snapshot".
+  // REQUIRES: lock is not held
+  Status AddRangeTombstones(SequenceNumber snapshot, RangeDelMap* map);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -140,18 +163,27 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
-  // Level that should be compacted next and its compaction score.
+  // Best compaction score over all levels, and the compaction score of
+  // every level that can be compacted.  The best level is compacted first,
+  // but others may be picked while it is busy with a running compaction.
   // Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
   double compaction_score_;
-  int compaction_level_;
+  double level_scores_[config::kNumLevels - 1];
+
+  // Estimated number of bytes that compactions have to process before
+  // every level is back within its limit.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
 
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        pending_compaction_bytes_(0) {
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      level_scores_[level] = -1;
+    }
   }
 
   ~Version();
@@ -172,8 +204,8 @@ class VersionSet {
   // Apply *edit to the current version to form a new descriptor that
   // is both saved to persistent state and installed as the new
   // current version.  Will release *mu while actually writing to the file.
+  // Concurrent calls are queued and applied one at a time.
   // REQUIRES: *mu is held on entry.
-  // REQUIRES: no other thread concurrently calls LogAndApply()
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
@@ -204,13 +236,23 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
-  // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Return the estimated number of bytes that compactions have to
+  // process before every level of the current version is within its
+  // limit.
+  uint64_t PendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
+  // Return the last sequence number.  May be called without holding
+  // the DB mutex.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= LastSequence());
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
@@ -224,7 +266,8 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns nullptr if there is no compaction to be done.
+  // Returns nullptr if there is no compaction to be done, or if every
+  // candidate conflicts with a compaction that is already running.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
   Compaction* PickCompaction();
@@ -233,11 +276,24 @@ class VersionSet {
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  // REQUIRES: no other compaction is running.
   Compaction* CompactRange(
       int level,
       const InternalKey* begin,
       const InternalKey* end);
 
+  // Return the number of compactions returned by PickCompaction() or
+  // CompactRange() whose inputs have not been released yet.
+  int NumRunningCompactions() const {
+    return compactions_in_progress_.size();
+  }
+
+  // Returns true iff a running compaction may write files into "level"
+  // that overlap the user key range [smallest_user_key,largest_user_key].
+  bool RangeBeingCompacted(int level,
+                           const Slice& smallest_user_key,
+                           const Slice& largest_user_key) const;
+
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
@@ -246,6 +302,16 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Split the inputs of "*c" into at most "max_ranges" user key ranges
+  // of roughly equal size, so that they can be compacted in parallel.
+  // Stores the user keys that separate consecutive ranges in increasing
+  // order in *boundaries; leaves it empty if "*c" should not be split.
+  // Split points are taken from the input file boundaries, and range
+  // sizes are estimated from the index blocks of the input tables.
+  // REQUIRES: lock is not held
+  void GetSubcompactionBoundaries(Compaction* c, int max_ranges,
+                                  std::vector<std::string>* boundaries);
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
@@ -288,6 +354,16 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Finish setting up a compaction whose initial "level" inputs have been
+  // chosen.  Returns false, leaving the compaction pointers untouched, if
+  // the compaction would touch files or key ranges that a running
+  // compaction is working on.
+  bool SetupCompaction(Compaction* c);
+
+  // Record that "c" is running so that no other compaction picks the
+  // same files or writes into the same key range.
+  void RegisterCompaction(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -300,7 +376,7 @@ class VersionSet {
   const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
-  uint64_t last_sequence_;
+  std::atomic<uint64_t> last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
@@ -314,6 +390,14 @@ class VersionSet {
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
 
+  // Compactions whose input files are marked as being compacted.
+  std::set<Compaction*> compactions_in_progress_;
+
+  // Queue of LogAndApply() callers.  Only the one at the front may
+  // build and write a new version.
+  struct ManifestWriter;
+  std::deque<ManifestWriter*> manifest_writers_;
+
   // No copying allowed
   VersionSet(const VersionSet&);
   void operator=(const VersionSet&);
@@ -348,17 +432,53 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Position of a pass over the compaction input.  IsBaseLevelForKey() and
+  // ShouldStopBefore() must be called with increasing keys and remember
+  // where they got to in a Cursor; passes that run in parallel over
+  // different key ranges (subcompactions) each use their own Cursor.
+  struct Cursor {
+    Cursor();
+
+    // State used to check for number of of overlapping grandparent files
+    // (parent == level_ + 1, grandparent == level_ + 2)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
+
+  // Returns true if no data exists in levels greater than "level+1" for
+  // any user key in [begin,end].
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
+
+  // Stop reading the "level+1" input files whose whole key range is
+  // covered by "tombstones".  The tombstones must come from the "level"
+  // inputs, which makes them newer than anything in those files, and be
+  // visible to every snapshot.  The files are still deleted by
+  // AddInputDeletions().  Returns the number of files dropped.
+  // REQUIRES: lock is held
+  int DropCoveredInputs(const RangeDelMap& tombstones);
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  Also makes the input files available to other
+  // compactions again.
   void ReleaseInputs();
 
  private:
@@ -367,6 +487,12 @@ class Compaction {
 
   Compaction(const Options* options, int level);
 
+  // Returns true iff some input file is part of a running compaction.
+  bool InputsBeingCompacted() const;
+
+  // Set the being_compacted flag of every input file to "value".
+  void MarkInputsBeingCompacted(bool value);
+
   int level_;
   uint64_t max_output_file_size_;
   Version* input_version_;
@@ -375,21 +501,16 @@ class Compaction {
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];      // The two sets of inputs
 
-  // State used to check for number of of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // Inputs from "level_+1" removed by DropCoveredInputs()
+  std::vector<FileMetaData*> covered_inputs_;
+
+  // Range of internal keys covered by inputs_[0] and inputs_[1]
+  InternalKey smallest_;
+  InternalKey largest_;
+
+  // Files in level_ + 2 that overlap the compaction, used to decide
+  // where to split the output (see ShouldStopBefore()).
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
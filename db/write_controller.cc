@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+namespace leveldb {
+
+// The rate is never lowered below this many bytes per second
+static const uint64_t kMinDelayedWriteRate = 16 << 10;
+
+// Writes may use up to this much unused time at once, so that small
+// writes do not each have to sleep.
+static const uint64_t kMaxBurstMicros = 1000;
+
+WriteController::WriteController(uint64_t max_rate)
+    : max_rate_(max_rate < kMinDelayedWriteRate ? kMinDelayedWriteRate
+                                                : max_rate),
+      rate_(max_rate_),
+      delayed_(false),
+      last_debt_(0),
+      next_write_micros_(0) {
+}
+
+void WriteController::Update(bool delay, uint64_t debt) {
+  if (!delay) {
+    delayed_ = false;
+    rate_ = max_rate_;
+  } else if (!delayed_) {
+    // Start delaying at the full rate
+    delayed_ = true;
+    rate_ = max_rate_;
+    next_write_micros_ = 0;
+  } else if (debt > last_debt_) {
+    // Compactions keep falling behind
+    rate_ -= rate_ / 5;
+    if (rate_ < kMinDelayedWriteRate) {
+      rate_ = kMinDelayedWriteRate;
+    }
+  } else if (debt < last_debt_) {
+    // Compactions are catching up
+    rate_ += rate_ / 4;
+    if (rate_ > max_rate_) {
+      rate_ = max_rate_;
+    }
+  }
+  last_debt_ = debt;
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t num_bytes) {
+  if (!delayed_) {
+    return 0;
+  }
+  uint64_t start = next_write_micros_;
+  if (start + kMaxBurstMicros < now_micros) {
+    start = now_micros - kMaxBurstMicros;
+  }
+  next_write_micros_ = start + num_bytes * 1000000 / rate_;
+  return (next_write_micros_ > now_micros)
+      ? next_write_micros_ - now_micros : 0;
+}
+
+}  // namespace leveldb
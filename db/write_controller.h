@@ -0,0 +1,57 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// WriteController decides how long writes have to wait while compactions
+// are falling behind.  Instead of stopping writes outright, it lets them
+// through at a limited rate (a token bucket), and adjusts that rate to
+// whether the compaction debt keeps growing or shrinks.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+// A WriteController is not thread-safe; DBImpl only uses it while
+// holding its mutex.
+class WriteController {
+ public:
+  // Writes are delayed to at most "max_rate" bytes per second at first.
+  explicit WriteController(uint64_t max_rate);
+
+  // Update the controller after the state of the DB may have changed.
+  // "delay" tells whether writes should be delayed at all.  "debt" is
+  // the amount of work compactions are behind by; while it grows the
+  // rate is lowered, while it shrinks the rate is raised again.
+  void Update(bool delay, uint64_t debt);
+
+  // Returns true iff writes are currently delayed.
+  bool IsDelayed() const { return delayed_; }
+
+  // Return the current rate limit in bytes per second, or 0 if writes
+  // are not delayed.
+  uint64_t delayed_write_rate() const { return delayed_ ? rate_ : 0; }
+
+  // Account for a write of "num_bytes" issued at time "now_micros" and
+  // return the number of microseconds it has to wait for.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t num_bytes);
+
+ private:
+  const uint64_t max_rate_;
+  uint64_t rate_;
+  bool delayed_;
+  uint64_t last_debt_;
+
+  // Time at which all writes admitted so far will have been paid for
+  uint64_t next_write_micros_;
+
+  // No copying allowed
+  WriteController(const WriteController&);
+  void operator=(const WriteController&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
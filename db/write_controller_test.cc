@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class WriteControllerTest { };
+
+TEST(WriteControllerTest, NotDelayed) {
+  WriteController controller(1 << 20);
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_EQ(0, controller.delayed_write_rate());
+  ASSERT_EQ(0, controller.GetDelay(1000000, 1 << 30));
+
+  controller.Update(false, 12345);
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_EQ(0, controller.GetDelay(1000000, 1 << 30));
+}
+
+TEST(WriteControllerTest, TokenBucket) {
+  WriteController controller(1 << 20);
+  controller.Update(true, 100);
+  ASSERT_TRUE(controller.IsDelayed());
+  ASSERT_EQ(1 << 20, controller.delayed_write_rate());
+
+  // Small writes are covered by the burst allowance
+  const uint64_t now = 10000000;
+  ASSERT_EQ(0, controller.GetDelay(now, 100));
+
+  // One second worth of writes has to wait for about a second
+  uint64_t delay = controller.GetDelay(now, 1 << 20);
+  ASSERT_GT(delay, 990000);
+  ASSERT_LT(delay, 1000000);
+
+  // ...and the next write queues up behind it
+  delay = controller.GetDelay(now, 1 << 19);
+  ASSERT_GT(delay, 1490000);
+
+  // Once the time has passed, writes go through again
+  ASSERT_EQ(0, controller.GetDelay(now + 3000000, 100));
+}
+
+TEST(WriteControllerTest, RateFollowsDebt) {
+  WriteController controller(1 << 20);
+  controller.Update(true, 100);
+  const uint64_t initial = controller.delayed_write_rate();
+
+  // Growing debt lowers the rate down to a floor
+  controller.Update(true, 200);
+  const uint64_t lowered = controller.delayed_write_rate();
+  ASSERT_LT(lowered, initial);
+  for (int i = 0; i < 100; i++) {
+    controller.Update(true, 300 + i);
+  }
+  ASSERT_GT(controller.delayed_write_rate(), 0);
+  ASSERT_LT(controller.delayed_write_rate(), lowered);
+
+  // Unchanged debt keeps the rate
+  const uint64_t rate = controller.delayed_write_rate();
+  controller.Update(true, 399);
+  ASSERT_EQ(rate, controller.delayed_write_rate());
+
+  // Shrinking debt raises it up to the maximum
+  controller.Update(true, 300);
+  ASSERT_GT(controller.delayed_write_rate(), rate);
+  for (int i = 0; i < 100; i++) {
+    controller.Update(true, 299 - i);
+  }
+  ASSERT_EQ(initial, controller.delayed_write_rate());
+
+  // Delaying stops once compactions have caught up
+  controller.Update(false, 0);
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_EQ(0, controller.delayed_write_rate());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -60,6 +60,7 @@ typedef struct leveldb_filterpolicy_t  leveldb_filterpolicy_t;
 typedef struct leveldb_iterator_t      leveldb_iterator_t;
 typedef struct leveldb_logger_t        leveldb_logger_t;
 typedef struct leveldb_options_t       leveldb_options_t;
+typedef struct leveldb_pinnableslice_t leveldb_pinnableslice_t;
 typedef struct leveldb_randomfile_t    leveldb_randomfile_t;
 typedef struct leveldb_readoptions_t   leveldb_readoptions_t;
 typedef struct leveldb_seqfile_t       leveldb_seqfile_t;
@@ -96,6 +97,33 @@ LEVELDB_EXPORT char* leveldb_get(leveldb_t* db,
                                  const char* key, size_t keylen, size_t* vallen,
                                  char** errptr);
 
+/* Returns NULL if not found.  Otherwise a handle on the value, which is
+   not copied but kept pinned where it is stored until the handle is
+   released using leveldb_pinnableslice_destroy(). */
+LEVELDB_EXPORT leveldb_pinnableslice_t* leveldb_get_pinned(
+    leveldb_t* db, const leveldb_readoptions_t* options, const char* key,
+    size_t keylen, char** errptr);
+
+/* Looks up num_keys keys at once, all from the same state of the db.
+   For each i, stores a malloc()ed copy of the value of keys_list[i] in
+   values_list[i] and its length in values_list_sizes[i], or NULL and 0
+   if the key is not found.  errs[i] is set to NULL on success and to a
+   malloc()ed error message otherwise. */
+LEVELDB_EXPORT void leveldb_multi_get(leveldb_t* db,
+                                      const leveldb_readoptions_t* options,
+                                      size_t num_keys,
+                                      const char* const* keys_list,
+                                      const size_t* keys_list_sizes,
+                                      char** values_list,
+                                      size_t* values_list_sizes,
+                                      char** errs);
+
+/* Pinnable slice */
+
+LEVELDB_EXPORT void leveldb_pinnableslice_destroy(leveldb_pinnableslice_t* v);
+LEVELDB_EXPORT const char* leveldb_pinnableslice_value(
+    const leveldb_pinnableslice_t* v, size_t* vallen);
+
 LEVELDB_EXPORT leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db, const leveldb_readoptions_t* options);
 
@@ -30,6 +30,12 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but up to high_pri_pool_ratio * capacity of
+// the entries inserted with Cache::kHighPriority are only evicted once
+// all other entries that are not in use have been evicted.  High
+// priority entries beyond that are evicted like the others.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -44,6 +50,13 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle { };
 
+  // Eviction priority of an entry.  Caches may keep entries with a high
+  // priority longer than others.
+  enum Priority {
+    kLowPriority,
+    kHighPriority
+  };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -96,6 +109,17 @@ class LEVELDB_EXPORT Cache {
   // cache.
   virtual size_t TotalCharge() const = 0;
 
+  // Like Insert(), but with the specified eviction priority.  Default
+  // implementation ignores the priority and calls Insert(), so caches
+  // written before priorities existed keep working unchanged.
+  virtual Handle* InsertWithPriority(const Slice& key, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value),
+                                     Priority priority) {
+    return Insert(key, value, charge, deleter);
+  }
+
  private:
   void LRU_Remove(Handle* e);
   void LRU_Append(Handle* e);
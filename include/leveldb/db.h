@@ -7,9 +7,12 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 
 namespace leveldb {
 
@@ -73,6 +76,15 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for all keys in the range
+  // ["begin","end").  Returns OK on success, and a non-OK status on
+  // error.  It is not an error if no key in the range exists.  The
+  // range is recorded as a single tombstone, so the cost of the call does
+  // not depend on the number of keys it deletes.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin, const Slice& end);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -88,6 +100,16 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Look up several keys at once.  On return, (*values)[i] and
+  // (*statuses)[i] hold what Get(options, keys[i], ...) would have
+  // stored and returned; both vectors are resized to keys.size().  All
+  // keys are read from the same state of the DB, which is usually much
+  // cheaper than calling Get() for each of them.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -122,6 +144,23 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.num-running-compactions" - returns the number of compactions
+  //     currently running in the background.
+  //  "leveldb.delayed-write-rate" - returns the rate, in bytes per second,
+  //     that writes are currently limited to, or 0 if they are not delayed.
+  //  "leveldb.write-stall-micros" - returns the total number of
+  //     microseconds writes have been delayed or stopped for so that
+  //     compactions could catch up.
+  //  "leveldb.estimate-pending-compaction-bytes" - returns the estimated
+  //     number of bytes compactions have to process before every level is
+  //     within its size limit.
+  //  "leveldb.row-cache-hits", "leveldb.row-cache-misses" - return the
+  //     number of lookups of a key in a table file that Options::row_cache
+  //     answered and could not answer.
+  //  "leveldb.readahead-bytes-read", "leveldb.readahead-bytes-used" -
+  //     return the number of bytes that iterators read ahead of their
+  //     position in table files (see ReadOptions::readahead_size), and
+  //     how many of those bytes they went on to use.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -146,6 +185,31 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Delete the table files whose keys all fall into [*begin,*end] by
+  // dropping them from the current version, without reading or rewriting
+  // anything.  This reclaims the space of a large key range much faster
+  // than deleting its keys and compacting.  Files that only partly
+  // overlap the range, files in use by a running compaction and, while
+  // snapshots exist, files at level-0 are kept.  Older versions of the
+  // removed keys that are stored in kept files may become visible again,
+  // so callers usually follow up with DeleteRange() and CompactRange()
+  // over the same range.
+  //
+  // begin==nullptr is treated as a key before all keys in the database.
+  // end==nullptr is treated as a key after all keys in the database.
+  // Returns NotSupported if the implementation has no table files.
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
+
+  // Like Get(), but *value is made to refer to the value where it is
+  // stored, in the memtable or in a data block in the block cache,
+  // instead of receiving a copy.  Until *value is Reset() or destroyed it
+  // keeps that memory from being freed, so it should not be held for
+  // long, and it must be released before this db is deleted.
+  //
+  // The default implementation copies the value into *value.
+  virtual Status GetPinned(const ReadOptions& options,
+                           const Slice& key, PinnableSlice* value);
 };
 
 // Destroy the contents of the specified database.
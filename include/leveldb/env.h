@@ -91,6 +91,18 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile() and NewWritableFile(), but the reads and
+  // writes of the file bypass the operating system's page cache where
+  // the platform and file system allow it, e.g. with O_DIRECT.  Used for
+  // table files whose blocks leveldb caches itself, so that they are not
+  // cached twice and do not push more useful pages out of the page cache.
+  //
+  // The default implementations return ordinary files.
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -143,10 +155,40 @@ class LEVELDB_EXPORT Env {
   // added to the same Env may run concurrently in different threads.
   // I.e., the caller may not assume that background work items are
   // serialized.
+  //
+  // Equivalent to Schedule(function, arg, LOW).
   virtual void Schedule(
       void (*function)(void* arg),
       void* arg) = 0;
 
+  // Priorities of background work.  Each priority has its own pool of
+  // threads, so work scheduled at HIGH priority never waits behind LOW
+  // priority work that is already queued or running.  IO is for the
+  // reads that iterators issue ahead of need (see
+  // ReadOptions::prefetch_blocks), which would be useless if they waited
+  // behind compactions.
+  enum Priority { LOW, HIGH, IO };
+  static const int kNumPriorities = 3;
+
+  // Like Schedule(function, arg), but runs "(*function)(arg)" in the
+  // thread pool for "pri".
+  //
+  // The default implementation ignores "pri" and calls
+  // Schedule(function, arg).
+  virtual void Schedule(
+      void (*function)(void* arg),
+      void* arg,
+      Priority pri);
+
+  // Allow up to "number" functions passed to Schedule() with priority
+  // "pri" to run at the same time.  Calls that ask for fewer threads than
+  // are already allowed are ignored, so several databases sharing an Env
+  // each get at least the concurrency they asked for.
+  //
+  // The default implementation does nothing, which is appropriate for
+  // environments whose Schedule() is not limited to a single thread.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -219,6 +261,25 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // One of the reads of a MultiRead() call
+  struct ReadRequest {
+    uint64_t offset;
+    size_t n;
+    char* scratch;   // Room for "n" bytes; must be live while result is used
+    Slice result;    // Set by MultiRead()
+    Status status;   // Set by MultiRead()
+  };
+
+  // Perform the "n" reads of "reqs", each as if by Read(), storing its
+  // result and status in the request.  Implementations may issue the
+  // reads together so the device can work on them in parallel.  Returns
+  // a non-OK status only if the reads could not be attempted at all.
+  //
+  // The default implementation calls Read() for each request in turn.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status MultiRead(ReadRequest* reqs, size_t n) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -305,6 +366,14 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) override {
     return target_->NewAppendableFile(f, r);
   }
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) override {
+    return target_->NewDirectRandomAccessFile(f, r);
+  }
+  Status NewDirectWritableFile(const std::string& f,
+                               WritableFile** r) override {
+    return target_->NewDirectWritableFile(f, r);
+  }
   bool FileExists(const std::string& f) override {
     return target_->FileExists(f);
   }
@@ -334,6 +403,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void Schedule(void (*f)(void*), void* a, Priority pri) override {
+    return target_->Schedule(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri) override {
+    return target_->SetBackgroundThreads(number, pri);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
@@ -66,6 +66,33 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a bloom filter in which all of the
+// bits for a key lie within one 64-byte cache line.  Lookups touch one
+// cache line instead of about 0.69*bits_per_key of them.  Confining the
+// bits of a key to one line raises the false positive rate slightly
+// above that of an ideal bloom filter, but at 10 bits per key it is
+// still below 1%, like that of NewBloomFilterPolicy().
+// When compiled with AVX2 support (e.g. -mavx2) the probes of a lookup
+// are checked eight at a time.
+//
+// The filters are not compatible with those of NewBloomFilterPolicy(),
+// so switching a database between the two makes existing tables lose
+// their filters until they are rewritten by compactions.  The same
+// restrictions on custom comparators apply.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that uses a Ribbon filter with about the
+// same false positive rate as NewBloomFilterPolicy(bits_per_key), but
+// that takes only about 0.73*bits_per_key bits per key for large sets
+// of keys.  Building a filter costs more CPU than building a bloom
+// filter, and filters of a few hundred keys or less are larger than
+// bloom filters.  It is therefore best combined with
+// Options::full_file_filter, which builds one filter per table rather
+// than many small ones.  The same restrictions on custom comparators
+// as for NewBloomFilterPolicy() apply.
+LEVELDB_EXPORT const FilterPolicy* NewRibbonFilterPolicy(int bits_per_key);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
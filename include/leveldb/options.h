@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 #include "leveldb/export.h"
 
 namespace leveldb {
@@ -15,6 +16,8 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -98,6 +101,31 @@ struct LEVELDB_EXPORT Options {
   // Default: nullptr
   Cache* block_cache;
 
+  // If true, the index and filter blocks of tables are kept in block_cache
+  // with Cache::kHighPriority, where they count against its capacity and
+  // may be evicted, instead of being held in memory for as long as their
+  // table is open.  Use NewLRUCache(capacity, high_pri_pool_ratio) to have
+  // them evicted after the data blocks.
+  //
+  // Default: false
+  bool cache_index_and_filter_blocks;
+
+  // If true and cache_index_and_filter_blocks is true, the index and
+  // filter blocks of level-0 tables are not evicted from block_cache while
+  // the tables are open.
+  //
+  // Default: false
+  bool pin_l0_filter_and_index_blocks_in_cache;
+
+  // If non-null, use the specified cache for the entries that Get() finds
+  // in each table file, keyed by file and user key.  Repeated reads of hot
+  // keys are then served without consulting the filter, index and data
+  // blocks of the tables.  Entries are charged their key and value size.
+  // Reads at an explicit snapshot only share entries with reads at the
+  // same snapshot.
+  // Default: nullptr
+  Cache* row_cache;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -113,6 +141,31 @@ struct LEVELDB_EXPORT Options {
   // Default: 16
   int block_restart_interval;
 
+  // If non-zero, the index of each table is split into partitions of
+  // about this many bytes, plus a small top-level index over the
+  // partitions.  Only the top-level index is kept in memory (or in
+  // block_cache, see cache_index_and_filter_blocks) while the table is
+  // open; the partitions are read through block_cache as they are
+  // needed.  Useful with a large max_file_size, whose tables would
+  // otherwise have index blocks of several megabytes.
+  //
+  // Default: 0
+  size_t index_partition_size;
+
+  // If true, each data block ends with a small hash index that maps user
+  // keys to the restart interval holding them (see
+  // block_restart_interval).  Point lookups use it in place of a binary
+  // search over the restart points, and skip the block right away if it
+  // does not hold the key.  Costs about one byte per distinct key.
+  //
+  // The hash index finds keys by their bytes, so it is only built and
+  // used if comparator is BytewiseComparator(); with other comparators,
+  // different keys may compare equal.  Tables keep using the hash indexes
+  // of their blocks only while this option is set.
+  //
+  // Default: false
+  bool data_block_hash_index;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -125,6 +178,85 @@ struct LEVELDB_EXPORT Options {
   // Default: 2MB
   size_t max_file_size;
 
+  // Maximum number of compactions that may run concurrently in the
+  // background.  Compactions that read and write disjoint sets of files
+  // and key ranges are executed in parallel, which helps keep up with
+  // heavy write loads on machines with many cores and fast storage.
+  // The Env is asked to provide at least this many background threads.
+  //
+  // Default: 1
+  int max_background_compactions;
+
+  // Maximum number of threads a single compaction is split across.  The
+  // key range of a large compaction is divided into up to this many
+  // disjoint parts of similar size, each of which is merged on its own
+  // thread and written to its own output files.
+  //
+  // Default: 1
+  int max_subcompactions;
+
+  // The ReadOptions::prefetch_blocks used by compactions to read their
+  // input files.
+  //
+  // Default: 0
+  int compaction_prefetch_blocks;
+
+  // If true, the table files read by Get(), MultiGet() and iterators are
+  // opened with Env::NewDirectRandomAccessFile(), so their reads bypass
+  // the page cache.  Only worthwhile with a block_cache large enough to
+  // take the place of the page cache.
+  //
+  // Default: false
+  bool use_direct_reads;
+
+  // If true, compactions read their input files with
+  // Env::NewDirectRandomAccessFile().  Compaction inputs are read once and
+  // deleted soon after, so caching them only evicts more useful pages.
+  // Consider setting compaction_prefetch_blocks as well.
+  //
+  // Default: false
+  bool use_direct_compaction_reads;
+
+  // If true, the table files written by memtable flushes and compactions
+  // are created with Env::NewDirectWritableFile().
+  //
+  // Default: false
+  bool use_direct_io_for_flush_and_compaction;
+
+  // Once compactions fall behind (too many level-0 files, or more than
+  // soft_pending_compaction_bytes_limit bytes waiting to be compacted),
+  // writes are let through at no more than this many bytes per second.
+  // The rate is lowered further while compactions keep falling behind,
+  // and raised again as they catch up.  Spreading the delay over all
+  // writes avoids long stalls once level-0 reaches its hard limit.
+  //
+  // Default: 16MB
+  size_t delayed_write_rate;
+
+  // Writes are delayed once the estimated number of bytes that
+  // compactions still have to process exceeds this limit.
+  //
+  // Default: 64GB
+  uint64_t soft_pending_compaction_bytes_limit;
+
+  // If true, a group of writes may be appended to the log while the
+  // previous group is still being applied to the memtable, so that the
+  // memtable insert is no longer on the critical path of the next log
+  // write and sync.  Writes still become visible to readers in order.
+  // Mostly helps workloads with many concurrent sync writes.
+  //
+  // Default: false
+  bool enable_pipelined_write;
+
+  // If true, each write in a group of concurrent writes is applied to the
+  // memtable by its own thread, in parallel with the others, after the
+  // group has been appended to the log.  Otherwise the thread that
+  // writes the log applies the whole group.  Helps when many threads
+  // write at the same time.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -154,6 +286,27 @@ struct LEVELDB_EXPORT Options {
   // Default: nullptr
   const FilterPolicy* filter_policy;
 
+  // If true, each table stores a single filter built from all of its
+  // keys instead of one filter per 2KB of data blocks.  A lookup then
+  // checks the filter before it searches the index block, and no space
+  // is spent on many small filters and their offsets.  Tables written
+  // with either setting remain readable.  Ignored if filter_policy is
+  // null.
+  //
+  // Default: false
+  bool full_file_filter;
+
+  // If non-null, the filters built with filter_policy also hold the
+  // prefix that this transform extracts from each user key.  Iterators
+  // created with ReadOptions::prefix_same_as_start then use them to skip
+  // the tables and blocks that hold no key with the prefix of a Seek()
+  // target.  Tables written without the transform (or with a different
+  // one) are read without their filters until compactions rewrite them.
+  // Ignored if filter_policy is null.
+  //
+  // Default: nullptr
+  const SliceTransform* prefix_extractor;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -177,10 +330,55 @@ struct LEVELDB_EXPORT ReadOptions {
   // Default: nullptr
   const Snapshot* snapshot;
 
+  // If true and the DB has a prefix_extractor, an iterator positioned by
+  // Seek(target) only yields keys with the same prefix as "target" and
+  // becomes invalid after the last of them.  Tables and blocks whose
+  // filters hold no key with that prefix are skipped without being read.
+  // Only forward iteration is supported after such a Seek(): Prev() makes
+  // the iterator invalid with a NotSupported status.  Targets outside
+  // the domain of the prefix_extractor, SeekToFirst() and SeekToLast()
+  // are not affected.
+  // Default: false
+  bool prefix_same_as_start;
+
+  // Iterators read the data blocks of a table file ahead of their position
+  // once they have read a few blocks in a row.  They start by reading 8KB
+  // ahead and double that with each read up to 256KB.  If
+  // "readahead_size" is non-zero, they read that many bytes ahead on
+  // every read from the file instead.  Memory-mapped files are never read
+  // ahead.
+  // Default: 0
+  size_t readahead_size;
+
+  // If positive, iterators read the next "prefetch_blocks" data blocks of
+  // a table file in the background (on the Env::IO thread pool) once they
+  // have read two blocks in a row, so that reading a block overlaps with
+  // processing the ones before it.  Replaces the readahead described
+  // above.  Memory-mapped files are never prefetched.
+  // Default: 0
+  int prefetch_blocks;
+
+  // If non-null, an iterator only yields keys at or after
+  // "*iterate_lower_bound" and, if "iterate_upper_bound" is non-null,
+  // before "*iterate_upper_bound".  Seeks are clamped to the range, and
+  // the iterator becomes invalid at its ends without looking at the keys,
+  // deletions, table files or data blocks outside it.  The bounds are
+  // copied by DB::NewIterator(), so they need not outlive the call.
+  // For iterators over a Table, the bounds are keys of the table and are
+  // only used to avoid reading data blocks outside the range.
+  // Default: nullptr
+  const Slice* iterate_lower_bound;
+  const Slice* iterate_upper_bound;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(nullptr) {
+        snapshot(nullptr),
+        prefix_same_as_start(false),
+        readahead_size(0),
+        prefetch_blocks(0),
+        iterate_lower_bound(nullptr),
+        iterate_upper_bound(nullptr) {
   }
 };
 
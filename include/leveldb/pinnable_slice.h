@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnableSlice is a Slice that may keep the memory it refers to alive
+// itself.  DB::Get() can return a value in one without copying it out of
+// the block cache or the memtable: the slice then holds a reference to
+// the block or memtable the value lives in, which is dropped when the
+// slice is Reset() or destroyed.  Callers should do that soon, since a
+// pinned block cannot be evicted from the block cache and a pinned
+// memtable is not freed.
+//
+// Multiple threads can invoke const methods on a PinnableSlice without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same PinnableSlice must use
+// external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <string>
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT PinnableSlice : public Slice {
+ public:
+  // Create an empty slice.
+  PinnableSlice();
+
+  PinnableSlice(const PinnableSlice&) = delete;
+  PinnableSlice& operator=(const PinnableSlice&) = delete;
+
+  ~PinnableSlice();
+
+  // Make this slice refer to "s", whose memory stays valid until
+  // (*function)(arg1, arg2) is called by Reset().  Releases any memory
+  // pinned before.
+  typedef void (*CleanupFunction)(void* arg1, void* arg2);
+  void PinSlice(const Slice& s, CleanupFunction function,
+                void* arg1, void* arg2);
+
+  // Make this slice refer to a copy of "s" held by the slice itself.
+  // Releases any memory pinned before.
+  void PinSelf(const Slice& s);
+
+  // Also call (*function)(arg1, arg2) when the slice is Reset().
+  // REQUIRES: IsPinned()
+  void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
+
+  // Release the memory pinned by this slice and make it empty.
+  void Reset();
+
+  // Return true iff the slice refers to memory that it keeps alive
+  // through a cleanup function, rather than to its own copy.
+  bool IsPinned() const { return cleanup_.function != nullptr; }
+
+ private:
+  struct Cleanup {
+    CleanupFunction function;
+    void* arg1;
+    void* arg2;
+    Cleanup* next;
+  };
+  Cleanup cleanup_;
+  std::string buf_;  // Holds the copy made by PinSelf()
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
@@ -0,0 +1,50 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a SliceTransform that maps each key
+// to a prefix, e.g. the tenant or user id at the start of the key.  The
+// prefixes are added to the filters of the database (see
+// Options::prefix_extractor), so that a scan over all keys with a given
+// prefix can skip the tables and blocks that hold no such key.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  The name is stored with the
+  // filters built using the transform, so it must be changed whenever
+  // the transform maps some key to a different prefix.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".  The result must be a prefix of "key"
+  // and all keys with the same prefix must be adjacent in the order of
+  // the comparator of the database.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true if "key" has a prefix.  Keys that do not are never
+  // skipped by prefix-scoped reads.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix of a key is its first "prefix_len"
+// bytes.  Keys shorter than that have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -15,7 +15,9 @@ class Block;
 class BlockHandle;
 class Footer;
 struct Options;
+class PinnableSlice;
 class RandomAccessFile;
+struct ReadaheadStats;
 struct ReadOptions;
 class TableCache;
 
@@ -51,6 +53,10 @@ class LEVELDB_EXPORT Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the entries added to the table with
+  // TableBuilder::AddRangeDeletion().  The result is initially invalid.
+  Iterator* NewRangeDeletionIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -59,6 +65,14 @@ class LEVELDB_EXPORT Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns false if the filters of the table show that none of its
+  // entries at or after "key" matches "prefix_key", i.e. that
+  // FilterPolicy::KeyMayMatch(prefix_key, ...) is false for each of
+  // them.  The entries that match "prefix_key" must be adjacent in the
+  // table.  Only the filter and index blocks are consulted, so no data
+  // block is read.  Returns true if the table has no filter.
+  bool PrefixMayMatch(const Slice& key, const Slice& prefix_key) const;
+
  private:
   struct Rep;
   Rep* rep_;
@@ -66,18 +80,39 @@ class LEVELDB_EXPORT Table {
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Like NewIterator(options), but adds the bytes that the iterator reads
+  // ahead, and of those the bytes it uses, to *readahead_stats.
+  Iterator* NewIterator(const ReadOptions& options,
+                        ReadaheadStats* readahead_stats) const;
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key).  May not make such a call if filter policy or the hash
+  // index of the data block says that key is not present.  If
+  // "pinned_value" is non-null and such a call is made, the value passed
+  // to it is also pinned in *pinned_value, which then keeps its data block
+  // alive.
   friend class TableCache;
   Status InternalGet(
       const ReadOptions&, const Slice& key,
       void* arg,
+      void (*handle_result)(void* arg, const Slice& k, const Slice& v),
+      PinnableSlice* pinned_value = nullptr);
+
+  // Like calling InternalGet(options, keys[i], args[i], handle_result)
+  // for every i in [0,n-1], but keys that fall into the same data block
+  // share a single read of that block.
+  // REQUIRES: keys[0,n-1] are sorted in increasing order.
+  Status InternalMultiGet(
+      const ReadOptions&, int n, const Slice* keys,
+      void* const* args,
       void (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
-
-  void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  // Errors reading the filter or the range deletions are not returned;
+  // the filter is then skipped and the range deletions fail when they
+  // are asked for.
+  Status ReadMeta(const Footer& footer);
+  void ReadFilter(const Slice& filter_handle_value, bool full_filter);
+  void ReadRangeDeletions(const Slice& handle_value);
 };
 
 }  // namespace leveldb
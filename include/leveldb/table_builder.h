@@ -50,6 +50,14 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add key,value to the range deletion meta block of the table.  These
+  // entries are not part of the table contents returned by iterators;
+  // Table::NewRangeDeletionIterator() returns them instead.
+  // REQUIRES: key is after any previously added range deletion key
+  //           according to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeDeletion(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -74,6 +82,9 @@ class LEVELDB_EXPORT TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
+  // Number of calls to AddRangeDeletion() so far.
+  uint64_t NumRangeDeletions() const;
+
   // Size of the file generated so far.  If invoked after a successful
   // Finish() call, returns the size of the final generated file.
   uint64_t FileSize() const;
@@ -81,6 +92,7 @@ class LEVELDB_EXPORT TableBuilder {
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void WriteBlock(const Slice& raw, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
   struct Rep;
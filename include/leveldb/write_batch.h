@@ -45,6 +45,11 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase the mappings for all keys in the range ["begin","end"), i.e.
+  // "begin" is included and "end" is not.  Does nothing if "begin" is
+  // not before "end" in the database's key order.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -60,6 +65,8 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementation ignores range deletions.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
   };
   Status Iterate(Handler* handler) const;
 
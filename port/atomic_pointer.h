@@ -153,6 +153,15 @@ class AtomicPointer {
     MemoryBarrier();
     rep_ = v;
   }
+  // If the current value is "expected", replace it by "v" and return
+  // true; otherwise return false.  Acts as a full memory barrier.
+  inline bool CompareAndSwap(void* expected, void* v) {
+#if defined(OS_WIN) && defined(COMPILER_MSVC)
+    return InterlockedCompareExchangePointer(&rep_, v, expected) == expected;
+#else
+    return __sync_bool_compare_and_swap(&rep_, expected, v);
+#endif
+  }
 };
 
 // AtomicPointer based on C++11 <atomic>.
@@ -175,6 +184,11 @@ class AtomicPointer {
   inline void NoBarrier_Store(void* v) {
     rep_.store(v, std::memory_order_relaxed);
   }
+  // If the current value is "expected", replace it by "v" and return
+  // true; otherwise return false.  Acts as a full memory barrier.
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return rep_.compare_exchange_strong(expected, v);
+  }
 };
 
 #endif
@@ -17,22 +17,40 @@ namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return (DecodeFixed32(data_ + size_ - sizeof(uint32_t)) &
+          ~kBlockHashIndexFlag);
 }
 
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      hash_index_(nullptr),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
   } else {
-    size_t max_restarts_allowed = (size_-sizeof(uint32_t)) / sizeof(uint32_t);
+    // End of the restart array, which the hash index follows if the block
+    // has one
+    size_t restarts_end = size_ - sizeof(uint32_t);
+    if (DecodeFixed32(data_ + restarts_end) & kBlockHashIndexFlag) {
+      if (restarts_end >= sizeof(uint32_t)) {
+        restarts_end -= sizeof(uint32_t);
+        num_buckets_ = DecodeFixed32(data_ + restarts_end);
+      }
+      if (num_buckets_ == 0 || num_buckets_ > restarts_end) {
+        size_ = 0;
+        return;
+      }
+      restarts_end -= num_buckets_;
+      hash_index_ = data_ + restarts_end;
+    }
+    size_t max_restarts_allowed = restarts_end / sizeof(uint32_t);
     if (NumRestarts() > max_restarts_allowed) {
       // The size is too small for NumRestarts()
       size_ = 0;
     } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      restart_offset_ = restarts_end - NumRestarts() * sizeof(uint32_t);
     }
   }
 }
@@ -79,6 +97,8 @@ class Block::Iter : public Iterator {
   const char* const data_;      // underlying block contents
   uint32_t const restarts_;     // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_; // Number of uint32_t entries in restart array
+  const char* const hash_index_;  // Used by Seek() if non-null
+  uint32_t const num_buckets_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -115,11 +135,15 @@ class Block::Iter : public Iterator {
   Iter(const Comparator* comparator,
        const char* data,
        uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts,
+       const char* hash_index,
+       uint32_t num_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        hash_index_(hash_index),
+        num_buckets_(num_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -163,6 +187,27 @@ class Block::Iter : public Iterator {
   }
 
   virtual void Seek(const Slice& target) {
+    if (hash_index_ != nullptr && target.size() >= 8) {
+      const uint8_t bucket = static_cast<uint8_t>(
+          hash_index_[BlockHashIndexHash(target) % num_buckets_]);
+      if (bucket == kHashIndexNoEntry) {
+        // No entry has the user key of target
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        return;
+      }
+      if (bucket < num_restarts_) {
+        // Linear search from the restart interval of the first entry with
+        // the user key of target, since all earlier entries come before it
+        SeekToRestartPoint(bucket);
+        while (ParseNextKey() && Compare(key_, target) < 0) {
+          // Keep skipping
+        }
+        return;
+      }
+      // Collision: fall back to binary search
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -254,14 +299,25 @@ class Block::Iter : public Iterator {
 };
 
 Iterator* Block::NewIterator(const Comparator* cmp) {
+  return NewIterator(cmp, false);
+}
+
+Iterator* Block::NewPointLookupIterator(const Comparator* cmp) {
+  return NewIterator(cmp, true);
+}
+
+Iterator* Block::NewIterator(const Comparator* cmp, bool point_lookup) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
   const uint32_t num_restarts = NumRestarts();
   if (num_restarts == 0) {
     return NewEmptyIterator();
+  } else if (point_lookup) {
+    return new Iter(cmp, data_, restart_offset_, num_restarts,
+                    hash_index_, num_buckets_);
   } else {
-    return new Iter(cmp, data_, restart_offset_, num_restarts);
+    return new Iter(cmp, data_, restart_offset_, num_restarts, nullptr, 0);
   }
 }
 
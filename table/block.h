@@ -24,12 +24,20 @@ class Block {
   size_t size() const { return size_; }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Returns an iterator for point lookups in a block of internal keys.
+  // Its Seek() uses the hash index of the block, if it has one, and may
+  // leave the iterator not valid when the block has no entry with the
+  // user key of the target, even if it has entries after the target.
+  Iterator* NewPointLookupIterator(const Comparator* comparator);
+
  private:
   uint32_t NumRestarts() const;
 
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;     // Offset in data_ of restart array
+  const char* hash_index_;      // Buckets of the hash index, or nullptr
+  uint32_t num_buckets_;
   bool owned_;                  // Block owns data_[]
 
   // No copying allowed
@@ -37,6 +45,8 @@ class Block {
   void operator=(const Block&);
 
   class Iter;
+
+  Iterator* NewIterator(const Comparator* comparator, bool point_lookup);
 };
 
 }  // namespace leveldb
@@ -25,6 +25,19 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// Data blocks of tables built with Options::data_block_hash_index instead
+// end with:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// where bucket h % num_buckets holds the restart interval of the first
+// entry whose user key has hash h (see BlockHashIndexHash()),
+// kHashIndexNoEntry if there is none, or kHashIndexCollision if the user
+// keys with hashes in that bucket start in more than one interval.  The
+// hash index is left out of blocks with more restart points than fit
+// in a bucket.
 
 #include "table/block_builder.h"
 
@@ -32,15 +45,18 @@
 #include <assert.h>
 #include "leveldb/comparator.h"
 #include "leveldb/table_builder.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
+BlockBuilder::BlockBuilder(const Options* options, bool hash_index)
     : options_(options),
       restarts_(),
       counter_(0),
-      finished_(false) {
+      finished_(false),
+      hash_index_(hash_index && options->data_block_hash_index),
+      hash_index_usable_(true) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);       // First restart point is at offset 0
 }
@@ -52,12 +68,19 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hash_index_usable_ = true;
+  hash_entries_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                        // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +   // Restart array
-          sizeof(uint32_t));                      // Restart array length
+  size_t estimate = (buffer_.size() +                  // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) +  // Restart array
+                     sizeof(uint32_t));                  // Restart array length
+  if (hash_index_) {
+    estimate += hash_entries_.size() * 4 / 3 + 1 +  // Buckets
+                sizeof(uint32_t);                    // Number of buckets
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -65,7 +88,26 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  if (hash_index_ && hash_index_usable_ && !hash_entries_.empty() &&
+      restarts_.size() < kHashIndexCollision) {
+    // Aim for a load factor of 0.75
+    const uint32_t num_buckets = hash_entries_.size() * 4 / 3 + 1;
+    std::string buckets(num_buckets, static_cast<char>(kHashIndexNoEntry));
+    for (size_t i = 0; i < hash_entries_.size(); i++) {
+      char* bucket = &buckets[hash_entries_[i].first % num_buckets];
+      const uint8_t restart = static_cast<uint8_t>(hash_entries_[i].second);
+      if (static_cast<uint8_t>(*bucket) == kHashIndexNoEntry) {
+        *bucket = static_cast<char>(restart);
+      } else if (static_cast<uint8_t>(*bucket) != restart) {
+        *bucket = static_cast<char>(kHashIndexCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    PutFixed32(&buffer_, restarts_.size() | kBlockHashIndexFlag);
+  } else {
+    PutFixed32(&buffer_, restarts_.size());
+  }
   finished_ = true;
   return Slice(buffer_);
 }
@@ -90,6 +132,17 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   }
   const size_t non_shared = key.size() - shared;
 
+  if (hash_index_ && hash_index_usable_) {
+    if (key.size() < 8) {
+      hash_index_usable_ = false;  // Not an internal key
+    } else if (buffer_.empty() ||
+               Slice(key.data(), key.size() - 8) !=
+               Slice(last_key_.data(), last_key_.size() - 8)) {
+      hash_entries_.push_back(std::make_pair(BlockHashIndexHash(key),
+                                             restarts_.size() - 1));
+    }
+  }
+
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
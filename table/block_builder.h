@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
+#include <utility>
 #include <vector>
 
 #include <stdint.h>
@@ -16,7 +17,10 @@ struct Options;
 
 class BlockBuilder {
  public:
-  explicit BlockBuilder(const Options* options);
+  // If "hash_index" is true and options->data_block_hash_index is set,
+  // the block ends with a hash index over the user keys of its entries,
+  // whose keys must then be the internal keys of a DB.
+  BlockBuilder(const Options* options, bool hash_index = false);
 
   // Reset the contents as if the BlockBuilder was just constructed.
   void Reset();
@@ -46,6 +50,11 @@ class BlockBuilder {
   int                   counter_;     // Number of entries emitted since restart
   bool                  finished_;    // Has Finish() been called?
   std::string           last_key_;
+  const bool            hash_index_;  // Build a hash index?
+  bool                  hash_index_usable_;  // No key too short for it
+  // Hash of the user key and restart interval of the first entry of each
+  // user key, if hash_index_
+  std::vector<std::pair<uint32_t, uint32_t> > hash_entries_;
 
   // No copying allowed
   BlockBuilder(const BlockBuilder&);
@@ -49,6 +49,29 @@ class FilterBlockBuilder {
   void operator=(const FilterBlockBuilder&);
 };
 
+// A FullFilterBlockBuilder constructs a single filter for all of the
+// keys of a Table (see Options::full_file_filter).
+//
+// The sequence of calls to FullFilterBlockBuilder must match the regexp:
+//      AddKey* Finish
+class FullFilterBlockBuilder {
+ public:
+  explicit FullFilterBlockBuilder(const FilterPolicy*);
+
+  void AddKey(const Slice& key);
+  Slice Finish();
+
+ private:
+  const FilterPolicy* policy_;
+  std::string keys_;              // Flattened key contents
+  std::vector<size_t> start_;     // Starting index in keys_ of each key
+  std::string result_;            // Filter data computed by Finish()
+
+  // No copying allowed
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&);
+  void operator=(const FullFilterBlockBuilder&);
+};
+
 class FilterBlockReader {
  public:
  // REQUIRES: "contents" and *policy must stay live while *this is live.
@@ -63,6 +86,17 @@ class FilterBlockReader {
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
 };
 
+class FullFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  bool KeyMayMatch(const Slice& key);
+
+ private:
+  const FilterPolicy* policy_;
+  Slice contents_;
+};
+
 }
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
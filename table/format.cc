@@ -4,14 +4,21 @@
 
 #include "table/format.h"
 
+#include <vector>
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
+uint32_t BlockHashIndexHash(const Slice& key) {
+  assert(key.size() >= 8);
+  return Hash(key.data(), key.size() - 8, 0x7a3c9f13);
+}
+
 void BlockHandle::EncodeTo(std::string* dst) const {
   // Sanity check that all fields have been set
   assert(offset_ != ~static_cast<uint64_t>(0));
@@ -62,24 +69,12 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file,
-                 const ReadOptions& options,
-                 const BlockHandle& handle,
-                 BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
-  size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    delete[] buf;
-    return s;
-  }
+// Check and uncompress the "n" block bytes plus trailer that were read
+// into "contents", using "buf", which this takes ownership of, as the
+// read's scratch buffer.
+static Status DecodeBlock(const ReadOptions& options, size_t n,
+                          const Slice& contents, char* buf,
+                          BlockContents* result) {
   if (contents.size() != n + kBlockTrailerSize) {
     delete[] buf;
     return Status::Corruption("truncated block read");
@@ -92,8 +87,7 @@ Status ReadBlock(RandomAccessFile* file,
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
-      return s;
+      return Status::Corruption("block checksum mismatch");
     }
   }
 
@@ -141,4 +135,54 @@ Status ReadBlock(RandomAccessFile* file,
   return Status::OK();
 }
 
+
+Status ReadBlock(RandomAccessFile* file,
+                 const ReadOptions& options,
+                 const BlockHandle& handle,
+                 BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size());
+  char* buf = new char[n + kBlockTrailerSize];
+  Slice contents;
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  return DecodeBlock(options, n, contents, buf, result);
+}
+
+Status ReadBlocks(RandomAccessFile* file,
+                  const ReadOptions& options,
+                  int n,
+                  const BlockHandle* handles,
+                  BlockContents* results,
+                  Status* statuses) {
+  std::vector<RandomAccessFile::ReadRequest> reqs(n);
+  for (int i = 0; i < n; i++) {
+    results[i].data = Slice();
+    results[i].cachable = false;
+    results[i].heap_allocated = false;
+    reqs[i].offset = handles[i].offset();
+    reqs[i].n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+    reqs[i].scratch = new char[reqs[i].n];
+  }
+  Status s = file->MultiRead(reqs.data(), reqs.size());
+  for (int i = 0; i < n; i++) {
+    if (!s.ok() || !reqs[i].status.ok()) {
+      delete[] reqs[i].scratch;
+      statuses[i] = s.ok() ? reqs[i].status : s;
+    } else {
+      statuses[i] = DecodeBlock(options, static_cast<size_t>(handles[i].size()),
+                                reqs[i].result, reqs[i].scratch, &results[i]);
+    }
+  }
+  return s;
+}
+
 }  // namespace leveldb
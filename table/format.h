@@ -83,6 +83,20 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// A data block may end with a hash index that maps the user key of each
+// of its entries, i.e. the key without the 8 bytes of sequence number and
+// type that a DB appends to it, to the restart interval of the first
+// entry with that user key.  Such blocks set this bit in num_restarts.
+static const uint32_t kBlockHashIndexFlag = 0x80000000u;
+
+// Values of the buckets of a hash index besides restart interval numbers
+static const uint8_t kHashIndexNoEntry = 255;
+static const uint8_t kHashIndexCollision = 254;
+
+// Returns the hash of the user key of "key" used by hash indexes.
+// REQUIRES: key.size() >= 8
+uint32_t BlockHashIndexHash(const Slice& key);
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -96,6 +110,17 @@ Status ReadBlock(RandomAccessFile* file,
                  const BlockHandle& handle,
                  BlockContents* result);
 
+// Read the "n" blocks identified by "handles" from "file" with a single
+// RandomAccessFile::MultiRead(), storing the outcome of block i in
+// results[i] and statuses[i] as ReadBlock() would.  Returns non-OK if
+// the reads could not be issued at all.
+Status ReadBlocks(RandomAccessFile* file,
+                  const ReadOptions& options,
+                  int n,
+                  const BlockHandle* handles,
+                  BlockContents* results,
+                  Status* statuses);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
@@ -4,6 +4,8 @@
 
 #include "table/merger.h"
 
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -22,6 +24,7 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    heap_.reserve(n);
   }
 
   virtual ~MergingIterator() {
@@ -36,24 +39,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    InitHeap();
   }
 
   virtual void SeekToLast() {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    InitHeap();
   }
 
   virtual void Seek(const Slice& target) {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    InitHeap();
   }
 
   virtual void Next() {
@@ -76,10 +79,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      InitHeap();
+    } else {
+      current_->Next();
+      UpdateTop();
     }
-
-    current_->Next();
-    FindSmallest();
   }
 
   virtual void Prev() {
@@ -105,10 +110,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      InitHeap();
+    } else {
+      current_->Prev();
+      UpdateTop();
     }
-
-    current_->Prev();
-    FindLargest();
   }
 
   virtual Slice key() const {
@@ -133,16 +140,31 @@ class MergingIterator : public Iterator {
   }
 
  private:
-  void FindSmallest();
-  void FindLargest();
+  // Returns true iff child "a" must be visited before child "b" when
+  // moving in the current direction.  Ties between equal keys go to the
+  // earlier child when moving forward and to the later one in reverse.
+  bool Before(const IteratorWrapper* a, const IteratorWrapper* b) const {
+    const int r = comparator_->Compare(a->key(), b->key());
+    if (direction_ == kForward) {
+      return r < 0 || (r == 0 && a < b);
+    } else {
+      return r > 0 || (r == 0 && a > b);
+    }
+  }
+
+  void InitHeap();
+  void UpdateTop();
+  void SiftDown(size_t pos);
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
+  // The valid children are kept in a binary heap ordered by Before(), so
+  // that moving to the next entry takes O(log n) comparisons instead of
+  // a scan over all children.  This matters when there are many level-0
+  // files.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
-  IteratorWrapper* current_;
+  std::vector<IteratorWrapper*> heap_;
+  IteratorWrapper* current_;  // heap_[0], or nullptr if heap_ is empty
 
   // Which direction is the iterator moving?
   enum Direction {
@@ -152,34 +174,50 @@ class MergingIterator : public Iterator {
   Direction direction_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
+// Rebuild heap_ from scratch after all children have been repositioned.
+void MergingIterator::InitHeap() {
+  heap_.clear();
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+    if (children_[i].Valid()) {
+      heap_.push_back(&children_[i]);
     }
   }
-  current_ = smallest;
+  for (size_t i = heap_.size() / 2; i > 0; i--) {
+    SiftDown(i - 1);
+  }
+  current_ = heap_.empty() ? nullptr : heap_[0];
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_-1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+// Restore the heap order after only current_ has been moved.
+void MergingIterator::UpdateTop() {
+  if (!heap_[0]->Valid()) {
+    heap_[0] = heap_.back();
+    heap_.pop_back();
+  }
+  if (!heap_.empty()) {
+    SiftDown(0);
+  }
+  current_ = heap_.empty() ? nullptr : heap_[0];
+}
+
+void MergingIterator::SiftDown(size_t pos) {
+  const size_t size = heap_.size();
+  IteratorWrapper* item = heap_[pos];
+  while (true) {
+    size_t child = 2 * pos + 1;
+    if (child >= size) {
+      break;
+    }
+    if (child + 1 < size && Before(heap_[child + 1], heap_[child])) {
+      child++;
+    }
+    if (!Before(heap_[child], item)) {
+      break;
     }
+    heap_[pos] = heap_[child];
+    pos = child;
   }
-  current_ = largest;
+  heap_[pos] = item;
 }
 }  // namespace
 
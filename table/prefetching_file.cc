@@ -0,0 +1,195 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/prefetching_file.h"
+
+#include <string.h>
+#include <vector>
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+struct PrefetchingFile::Request {
+  enum State { kQueued, kRunning, kDone, kCancelled };
+
+  uint64_t offset;
+  size_t n;
+
+  port::Mutex mu;
+  port::CondVar cv;
+  State state GUARDED_BY(mu);
+  int refs GUARDED_BY(mu);  // One for the reader, one for the thread pool
+                            // once submitted
+  char* buf;
+  Slice result;   // Set once state is kDone
+  Status status;  // Set once state is kDone
+
+  Request(uint64_t off, size_t len)
+      : offset(off), n(len), cv(&mu), state(kQueued), refs(1),
+        buf(new char[len]) { }
+  ~Request() { delete[] buf; }
+};
+
+// The requests of one Submit(), read by one job of the thread pool
+struct PrefetchingFile::Batch {
+  RandomAccessFile* file;
+  std::vector<Request*> requests;
+};
+
+PrefetchingFile::PrefetchingFile(RandomAccessFile* file, Env* env)
+    : file_(file), env_(env), zero_copy_(false), unsubmitted_(0) {
+}
+
+PrefetchingFile::~PrefetchingFile() {
+  Clear();
+}
+
+void PrefetchingFile::RunBatch(void* arg) {
+  Batch* b = reinterpret_cast<Batch*>(arg);
+  // Read the requests the reader has not cancelled in the meantime
+  std::vector<Request*> running;
+  std::vector<RandomAccessFile::ReadRequest> reads;
+  for (size_t i = 0; i < b->requests.size(); i++) {
+    Request* r = b->requests[i];
+    MutexLock l(&r->mu);
+    if (r->state == Request::kQueued) {
+      r->state = Request::kRunning;
+      running.push_back(r);
+      RandomAccessFile::ReadRequest read;
+      read.offset = r->offset;
+      read.n = r->n;
+      read.scratch = r->buf;
+      reads.push_back(read);
+    }
+  }
+  Status s;
+  if (!reads.empty()) {
+    s = b->file->MultiRead(&reads[0], reads.size());
+  }
+
+  size_t next = 0;  // Index into running and reads
+  for (size_t i = 0; i < b->requests.size(); i++) {
+    Request* r = b->requests[i];
+    r->mu.Lock();
+    if (next < running.size() && running[next] == r) {
+      r->result = reads[next].result;
+      r->status = s.ok() ? reads[next].status : s;
+      r->state = Request::kDone;
+      r->cv.SignalAll();
+      next++;
+    }
+    const bool last = (--r->refs == 0);
+    r->mu.Unlock();
+    if (last) {
+      delete r;
+    }
+  }
+  delete b;
+}
+
+bool PrefetchingFile::Finish(Request* r) {
+  r->mu.Lock();
+  if (r->state == Request::kQueued) {
+    r->state = Request::kCancelled;
+  }
+  while (r->state == Request::kRunning) {
+    r->cv.Wait();
+  }
+  const bool done = (r->state == Request::kDone);
+  const bool last = (--r->refs == 0);
+  r->mu.Unlock();
+  if (last) {
+    delete r;
+  }
+  return done;
+}
+
+void PrefetchingFile::Prefetch(uint64_t offset, size_t n) {
+  if (zero_copy_) {
+    return;
+  }
+  requests_.push_back(new Request(offset, n));
+  unsubmitted_++;
+}
+
+void PrefetchingFile::Submit() {
+  if (unsubmitted_ == 0) {
+    return;
+  }
+  Batch* b = new Batch;
+  b->file = file_;
+  for (size_t i = requests_.size() - unsubmitted_; i < requests_.size(); i++) {
+    Request* r = requests_[i];
+    MutexLock l(&r->mu);
+    r->refs++;
+    b->requests.push_back(r);
+  }
+  unsubmitted_ = 0;
+  env_->Schedule(&PrefetchingFile::RunBatch, b, Env::IO);
+}
+
+void PrefetchingFile::PopFront() const {
+  if (unsubmitted_ == requests_.size()) {
+    unsubmitted_--;
+  }
+  requests_.pop_front();
+}
+
+void PrefetchingFile::Clear() const {
+  while (!requests_.empty()) {
+    Finish(requests_.front());
+    PopFront();
+  }
+}
+
+Status PrefetchingFile::Read(uint64_t offset, size_t n, Slice* result,
+                             char* scratch) const {
+  while (!requests_.empty() && requests_.front()->offset < offset) {
+    Finish(requests_.front());
+    PopFront();
+  }
+  if (!requests_.empty() && requests_.front()->offset == offset &&
+      requests_.front()->n == n) {
+    Request* r = requests_.front();
+    PopFront();
+    // Keep our reference until the data is copied out
+    r->mu.Lock();
+    if (r->state == Request::kQueued) {
+      r->state = Request::kCancelled;
+    }
+    while (r->state == Request::kRunning) {
+      r->cv.Wait();
+    }
+    const bool served = (r->state == Request::kDone);
+    r->mu.Unlock();
+    // The result of a request that is done is no longer written
+    Status s;
+    if (served) {
+      s = r->status;
+      if (s.ok()) {
+        if (r->result.data() != r->buf) {
+          // The file hands out its data without copying, so there is
+          // nothing to gain from reading it in the background.
+          zero_copy_ = true;
+          *result = r->result;
+        } else {
+          memcpy(scratch, r->result.data(), r->result.size());
+          *result = Slice(scratch, r->result.size());
+        }
+      }
+    }
+    Finish(r);
+    if (served) {
+      return s;
+    }
+  }
+  Status s = file_->Read(offset, n, result, scratch);
+  if (s.ok() && result->data() != scratch) {
+    zero_copy_ = true;
+  }
+  return s;
+}
+
+}  // namespace leveldb
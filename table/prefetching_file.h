@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PrefetchingFile lets a table iterator read the data blocks it is
+// about to need in the background, on the Env::IO thread pool, while it
+// decodes the blocks it already has.  The prefetches submitted together
+// are issued as one RandomAccessFile::MultiRead().  Reads of a range that
+// was prefetched are served from the prefetched data.
+
+#ifndef STORAGE_LEVELDB_TABLE_PREFETCHING_FILE_H_
+#define STORAGE_LEVELDB_TABLE_PREFETCHING_FILE_H_
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+class PrefetchingFile : public RandomAccessFile {
+ public:
+  // Reads from "file", which must outlive the result, using the
+  // background threads of "env".
+  PrefetchingFile(RandomAccessFile* file, Env* env);
+
+  PrefetchingFile(const PrefetchingFile&) = delete;
+  PrefetchingFile& operator=(const PrefetchingFile&) = delete;
+
+  // Waits for the prefetches that are being read.
+  virtual ~PrefetchingFile();
+
+  // Queue bytes [offset, offset + n) of the file to be read in the
+  // background by the next Submit().  Does nothing if the file turned out
+  // to return its data without copying it, e.g. because it is
+  // memory-mapped.
+  void Prefetch(uint64_t offset, size_t n);
+
+  // Start reading the prefetches queued since the last Submit() in the
+  // background, all in one batch.
+  void Submit();
+
+  // Number of prefetches not yet read or dropped
+  size_t pending() const { return requests_.size(); }
+
+  // Drop all prefetches.
+  void Clear() const;
+
+  // A read of exactly a prefetched range returns the prefetched data,
+  // waiting for it if it is being read.  A prefetch that has not started
+  // yet is read by the caller instead, so a busy thread pool never holds
+  // up the reader.  Prefetches of ranges before "offset" are dropped.
+  //
+  // Not safe for concurrent use: the prefetches belong to a single reader.
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const;
+
+ private:
+  struct Request;
+  struct Batch;
+  static void RunBatch(void* arg);
+
+  // Wait for "r" if it is being read and drop our reference to it.
+  // Returns true if it had been read.
+  static bool Finish(Request* r);
+
+  // Remove the first of requests_, which must have been finished
+  void PopFront() const;
+
+  RandomAccessFile* const file_;
+  Env* const env_;
+  mutable bool zero_copy_;  // file_ does not use the scratch buffer
+  mutable std::deque<Request*> requests_;  // In increasing offset order
+  mutable size_t unsubmitted_;  // Number of requests_ at the back that
+                                // Submit() has not scheduled yet
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_PREFETCHING_FILE_H_
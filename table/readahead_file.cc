@@ -0,0 +1,101 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/readahead_file.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace leveldb {
+
+const size_t ReadaheadFile::kInitialReadaheadSize;
+const size_t ReadaheadFile::kMaxReadaheadSize;
+const int ReadaheadFile::kReadsBeforeReadahead;
+
+ReadaheadFile::ReadaheadFile(RandomAccessFile* file, uint64_t file_size,
+                             size_t readahead_size, ReadaheadStats* stats)
+    : file_(file),
+      file_size_(file_size),
+      fixed_size_(readahead_size > 0),
+      stats_(stats),
+      readahead_size_(readahead_size > 0 ? readahead_size
+                                         : kInitialReadaheadSize),
+      sequential_reads_(0),
+      next_offset_(0),
+      zero_copy_(false),
+      buf_(nullptr),
+      buf_capacity_(0),
+      buf_offset_(0),
+      buf_size_(0) {
+}
+
+ReadaheadFile::~ReadaheadFile() {
+  delete[] buf_;
+}
+
+Status ReadaheadFile::Read(uint64_t offset, size_t n, Slice* result,
+                           char* scratch) const {
+  if (offset >= buf_offset_ && offset + n <= buf_offset_ + buf_size_) {
+    memcpy(scratch, buf_ + (offset - buf_offset_), n);
+    *result = Slice(scratch, n);
+    next_offset_ = offset + n;
+    if (stats_ != nullptr) {
+      stats_->bytes_used.fetch_add(n, std::memory_order_relaxed);
+    }
+    return Status::OK();
+  }
+
+  if (offset == next_offset_) {
+    sequential_reads_++;
+  } else {
+    sequential_reads_ = 0;
+    if (!fixed_size_) {
+      readahead_size_ = kInitialReadaheadSize;
+    }
+  }
+  next_offset_ = offset + n;
+  if (zero_copy_ || offset + n >= file_size_ ||
+      (!fixed_size_ && sequential_reads_ < kReadsBeforeReadahead)) {
+    return file_->Read(offset, n, result, scratch);
+  }
+
+  // Some files fail reads that go past their end
+  const size_t len = static_cast<size_t>(
+      std::min<uint64_t>(n + readahead_size_, file_size_ - offset));
+  if (buf_capacity_ < len) {
+    delete[] buf_;
+    buf_ = new char[len];
+    buf_capacity_ = len;
+  }
+  buf_size_ = 0;
+  Slice data;
+  Status s = file_->Read(offset, len, &data, buf_);
+  if (!s.ok()) {
+    return s;
+  }
+  if (data.data() != buf_) {
+    // Copying out of such a file is all that reading ahead would add
+    zero_copy_ = true;
+    delete[] buf_;
+    buf_ = nullptr;
+    buf_capacity_ = 0;
+    *result = Slice(data.data(), std::min(n, data.size()));
+    return s;
+  }
+
+  buf_offset_ = offset;
+  buf_size_ = data.size();
+  const size_t k = std::min(n, buf_size_);
+  memcpy(scratch, buf_, k);
+  *result = Slice(scratch, k);
+  if (stats_ != nullptr && buf_size_ > n) {
+    stats_->bytes_read.fetch_add(buf_size_ - n, std::memory_order_relaxed);
+  }
+  if (!fixed_size_) {
+    readahead_size_ = std::min(2 * readahead_size_, kMaxReadaheadSize);
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A ReadaheadFile turns the block-sized reads of a table iterator that
+// scans a file sequentially into fewer, larger reads.  Once a few reads
+// in a row have each started where the previous one ended, every read
+// that misses the buffer also fetches the bytes that follow it, starting
+// with kInitialReadaheadSize and doubling up to kMaxReadaheadSize.
+
+#ifndef STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
+#define STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+// Totals over all the ReadaheadFiles that share it
+struct ReadaheadStats {
+  std::atomic<uint64_t> bytes_read;  // Bytes read beyond what was asked for
+  std::atomic<uint64_t> bytes_used;  // Of those, bytes later asked for
+
+  ReadaheadStats() : bytes_read(0), bytes_used(0) { }
+};
+
+class ReadaheadFile : public RandomAccessFile {
+ public:
+  static const size_t kInitialReadaheadSize = 8 << 10;
+  static const size_t kMaxReadaheadSize = 256 << 10;
+
+  // Sequential reads that are not read ahead
+  static const int kReadsBeforeReadahead = 2;
+
+  // Reads from "file", which must outlive the result and hold
+  // "file_size" bytes.  If "readahead_size" is non-zero, every read that
+  // misses the buffer reads that many bytes ahead, sequential or not.
+  // "stats" may be nullptr.
+  //
+  // Files that return their data without copying it into the caller's
+  // buffer, like memory-mapped ones, are not read ahead.
+  ReadaheadFile(RandomAccessFile* file, uint64_t file_size,
+                size_t readahead_size, ReadaheadStats* stats);
+
+  ReadaheadFile(const ReadaheadFile&) = delete;
+  ReadaheadFile& operator=(const ReadaheadFile&) = delete;
+
+  virtual ~ReadaheadFile();
+
+  // Not safe for concurrent use: the buffer belongs to a single reader.
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const;
+
+ private:
+  RandomAccessFile* const file_;
+  const uint64_t file_size_;
+  const bool fixed_size_;          // Whether readahead_size was given
+  ReadaheadStats* const stats_;
+  mutable size_t readahead_size_;  // Bytes to read ahead on the next miss
+  mutable int sequential_reads_;   // Reads in a row at next_offset_
+  mutable uint64_t next_offset_;   // End of the last read
+  mutable bool zero_copy_;         // file_ does not use the scratch buffer
+
+  // Holds bytes [buf_offset_, buf_offset_ + buf_size_) of file_
+  mutable char* buf_;
+  mutable size_t buf_capacity_;
+  mutable uint64_t buf_offset_;
+  mutable size_t buf_size_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
@@ -4,37 +4,320 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/prefetching_file.h"
+#include "table/readahead_file.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
+// The filter of a table and the memory it reads from
+struct TableFilter {
+  TableFilter() : filter(nullptr), full_filter(nullptr), data(nullptr) { }
+  ~TableFilter() {
+    delete filter;
+    delete full_filter;
+    delete [] data;
+  }
+
+  FilterBlockReader* filter;
+  FullFilterBlockReader* full_filter;  // Set instead of filter if the table
+                                       // has a single filter for all keys
+  const char* data;                    // Heap memory read by the filter
+};
+
+// Data blocks that InternalMultiGet() reads, and holds, at once.  The
+// same as the depth of the io_uring of the posix Env, so that each chunk
+// is a single submission there.
+static const size_t kMultiGetBlocks = 64;
+
+static void DeleteBlock(void* arg, void* ignored) {
+  delete reinterpret_cast<Block*>(arg);
+}
+
+static void DeleteCachedBlock(const Slice& key, void* value) {
+  Block* block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  TableFilter* filter = reinterpret_cast<TableFilter*>(value);
+  delete filter;
+}
+
+static void DeleteIterator(void* arg, void* ignored) {
+  delete reinterpret_cast<Iterator*>(arg);
+}
+
+static void ReleaseBlock(void* arg, void* h) {
+  Cache* cache = reinterpret_cast<Cache*>(arg);
+  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
+  cache->Release(handle);
+}
+
 struct Table::Rep {
   ~Rep() {
-    delete filter;
-    delete [] filter_data;
-    delete index_block;
+    if (filter_cache_handle != nullptr) {
+      options.block_cache->Release(filter_cache_handle);
+    } else {
+      delete filter;
+    }
+    if (index_cache_handle != nullptr) {
+      options.block_cache->Release(index_cache_handle);
+    } else {
+      delete index_block;
+    }
+    delete range_del_block;
+  }
+
+  // Whether the index and filter blocks are held by the block cache
+  bool CacheIndexAndFilter() const {
+    return options.cache_index_and_filter_blocks &&
+           options.block_cache != nullptr;
+  }
+
+  // Returns the block cache key of the block at "offset", which is
+  // stored in "buf".
+  Slice CacheKey(uint64_t offset, char (&buf)[16]) const {
+    EncodeFixed64(buf, cache_id);
+    EncodeFixed64(buf + 8, offset);
+    return Slice(buf, sizeof(buf));
+  }
+
+  // Returns an iterator over the index block, or over the partitions of
+  // a partitioned index
+  Iterator* NewIndexIterator(const ReadOptions& read_options);
+
+  // Returns an iterator over the block found at "index_value" of the
+  // index, which is read through the block cache with "priority".  If
+  // "point_lookup" is true and options.data_block_hash_index is set,
+  // returns Block::NewPointLookupIterator().
+  // The block is read from "source" if that is non-null, else from file.
+  Iterator* NewBlockIterator(const ReadOptions& read_options,
+                             const Slice& index_value,
+                             Cache::Priority priority,
+                             bool point_lookup = false,
+                             RandomAccessFile* source = nullptr);
+
+  // A data block read by ReadDataBlocks()
+  struct DataBlock {
+    Block* block;                 // nullptr if the block could not be read
+    Cache::Handle* cache_handle;  // nullptr if block is not in the cache
+    Status status;
+  };
+
+  // Reads the data blocks of "handles" through the block cache like
+  // NewBlockIterator(), but reads all the blocks missing from the cache
+  // with a single ReadBlocks().  The blocks must be passed to
+  // ReleaseDataBlock().
+  void ReadDataBlocks(const ReadOptions& read_options,
+                      const std::vector<BlockHandle>& handles,
+                      std::vector<DataBlock>* blocks);
+  void ReleaseDataBlock(const DataBlock& b) {
+    if (b.cache_handle != nullptr) {
+      options.block_cache->Release(b.cache_handle);
+    } else {
+      delete b.block;
+    }
+  }
+
+  // The data block reads of one table iterator
+  struct BlockReaderState;
+
+  // Converts an entry of the top-level index of a partitioned index into
+  // an iterator over the partition.  "arg" is the Rep of the table.
+  static Iterator* IndexPartitionReader(void* arg,
+                                        const ReadOptions& read_options,
+                                        const Slice& index_value) {
+    return reinterpret_cast<Rep*>(arg)->NewBlockIterator(
+        read_options, index_value, Cache::kHighPriority);
+  }
+
+  // Reads the filter block.  Returns nullptr if it cannot be read.
+  TableFilter* ReadFilter() const;
+
+  // Sets *result to the filter of the table, or to nullptr if the table
+  // has none.  Returns the handle of the block cache entry that holds
+  // *result, which must be passed to ReleaseFilter(), or nullptr.
+  Cache::Handle* GetFilter(const TableFilter** result);
+  void ReleaseFilter(Cache::Handle* handle) {
+    if (handle != nullptr) {
+      options.block_cache->Release(handle);
+    }
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
+  uint64_t file_size;
   uint64_t cache_id;
-  FilterBlockReader* filter;
-  const char* filter_data;
+  bool has_filter;
+  bool full_filter;          // Whether filter_handle is a full-file filter
+  BlockHandle filter_handle;
+  TableFilter* filter;       // nullptr if only the block cache holds it
+  Cache::Handle* filter_cache_handle;  // Pins filter in the block cache
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
+  BlockHandle index_handle;
+  bool partitioned_index;        // Whether index_handle is a top-level index
+  Block* index_block;            // nullptr if only the block cache holds it
+  Cache::Handle* index_cache_handle;   // Pins index_block in the block cache
+  Block* range_del_block;        // nullptr if the table has no range deletions
+  Status range_del_status;       // Error hit while reading the range deletions
 };
 
+Iterator* Table::Rep::NewIndexIterator(const ReadOptions& read_options) {
+  Iterator* iter;
+  if (index_block != nullptr) {
+    iter = index_block->NewIterator(options.comparator);
+  } else {
+    Cache* block_cache = options.block_cache;
+    char cache_key_buffer[16];
+    Slice key = CacheKey(index_handle.offset(), cache_key_buffer);
+    Cache::Handle* cache_handle = block_cache->Lookup(key);
+    if (cache_handle == nullptr) {
+      BlockContents contents;
+      Status s = ReadBlock(file, read_options, index_handle, &contents);
+      if (!s.ok()) {
+        return NewErrorIterator(s);
+      }
+      Block* block = new Block(contents);
+      cache_handle = block_cache->InsertWithPriority(
+          key, block, block->size(), &DeleteCachedBlock,
+          Cache::kHighPriority);
+    }
+    Block* block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+    iter = block->NewIterator(options.comparator);
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  }
+  if (partitioned_index) {
+    iter = NewTwoLevelIterator(iter, &Rep::IndexPartitionReader, this,
+                               read_options);
+  }
+  return iter;
+}
+
+Iterator* Table::Rep::NewBlockIterator(const ReadOptions& read_options,
+                                       const Slice& index_value,
+                                       Cache::Priority priority,
+                                       bool point_lookup,
+                                       RandomAccessFile* source) {
+  Cache* block_cache = options.block_cache;
+  if (source == nullptr) {
+    source = file;
+  }
+  Block* block = nullptr;
+  Cache::Handle* cache_handle = nullptr;
+
+  BlockHandle handle;
+  Slice input = index_value;
+  Status s = handle.DecodeFrom(&input);
+  // We intentionally allow extra stuff in index_value so that we
+  // can add more features in the future.
+
+  if (s.ok()) {
+    BlockContents contents;
+    if (block_cache != nullptr) {
+      char cache_key_buffer[16];
+      Slice key = CacheKey(handle.offset(), cache_key_buffer);
+      cache_handle = block_cache->Lookup(key);
+      if (cache_handle != nullptr) {
+        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+      } else {
+        s = ReadBlock(source, read_options, handle, &contents);
+        if (s.ok()) {
+          block = new Block(contents);
+          if (contents.cachable && read_options.fill_cache) {
+            cache_handle = block_cache->InsertWithPriority(
+                key, block, block->size(), &DeleteCachedBlock, priority);
+          }
+        }
+      }
+    } else {
+      s = ReadBlock(source, read_options, handle, &contents);
+      if (s.ok()) {
+        block = new Block(contents);
+      }
+    }
+  }
+
+  Iterator* iter;
+  if (block != nullptr) {
+    iter = (point_lookup && options.data_block_hash_index)
+               ? block->NewPointLookupIterator(options.comparator)
+               : block->NewIterator(options.comparator);
+    if (cache_handle == nullptr) {
+      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+    } else {
+      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+    }
+  } else {
+    iter = NewErrorIterator(s);
+  }
+  return iter;
+}
+
+TableFilter* Table::Rep::ReadFilter() const {
+  // We might want to unify with ReadBlock() if we start
+  // requiring checksum verification in Table::Open.
+  ReadOptions opt;
+  if (options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(file, opt, filter_handle, &block).ok()) {
+    return nullptr;
+  }
+  TableFilter* result = new TableFilter;
+  if (block.heap_allocated) {
+    result->data = block.data.data();     // Will need to delete later
+  }
+  if (full_filter) {
+    result->full_filter =
+        new FullFilterBlockReader(options.filter_policy, block.data);
+  } else {
+    result->filter = new FilterBlockReader(options.filter_policy, block.data);
+  }
+  return result;
+}
+
+Cache::Handle* Table::Rep::GetFilter(const TableFilter** result) {
+  *result = filter;
+  if (filter != nullptr || !has_filter) {
+    return nullptr;
+  }
+
+  Cache* block_cache = options.block_cache;
+  char cache_key_buffer[16];
+  Slice key = CacheKey(filter_handle.offset(), cache_key_buffer);
+  Cache::Handle* cache_handle = block_cache->Lookup(key);
+  if (cache_handle == nullptr) {
+    TableFilter* f = ReadFilter();
+    if (f == nullptr) {
+      // Do without the filter, like a table whose filter could not be
+      // read when it was opened
+      return nullptr;
+    }
+    cache_handle = block_cache->InsertWithPriority(
+        key, f, filter_handle.size(), &DeleteCachedFilter,
+        Cache::kHighPriority);
+  }
+  *result = reinterpret_cast<TableFilter*>(block_cache->Value(cache_handle));
+  return cache_handle;
+}
+
 Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
@@ -71,23 +354,43 @@ Status Table::Open(const Options& options,
     Rep* rep = new Table::Rep;
     rep->options = options;
     rep->file = file;
+    rep->file_size = size;
     rep->metaindex_handle = footer.metaindex_handle();
+    rep->index_handle = footer.index_handle();
+    rep->partitioned_index = false;
     rep->index_block = index_block;
+    rep->index_cache_handle = nullptr;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
-    rep->filter_data = nullptr;
+    rep->has_filter = false;
+    rep->full_filter = false;
     rep->filter = nullptr;
+    rep->filter_cache_handle = nullptr;
+    rep->range_del_block = nullptr;
+    if (rep->CacheIndexAndFilter()) {
+      char cache_key_buffer[16];
+      Cache::Handle* cache_handle = options.block_cache->InsertWithPriority(
+          rep->CacheKey(rep->index_handle.offset(), cache_key_buffer),
+          index_block, index_block->size(), &DeleteCachedBlock,
+          Cache::kHighPriority);
+      if (options.pin_l0_filter_and_index_blocks_in_cache) {
+        rep->index_cache_handle = cache_handle;
+      } else {
+        options.block_cache->Release(cache_handle);
+        rep->index_block = nullptr;
+      }
+    }
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = nullptr;
+    }
   }
 
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
-  }
-
+Status Table::ReadMeta(const Footer& footer) {
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -95,164 +398,497 @@ void Table::ReadMeta(const Footer& footer) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
-    return;
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+  if (!s.ok()) {
+    // Only the metaindex tells whether the index is partitioned, so the
+    // table cannot be read without it.
+    return s;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    // A table has at most one of the two kinds of filters
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value(), false);
+    } else {
+      key = "fullfilter.";
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value(), true);
+      }
+    }
+  }
+  iter->Seek("leveldb.index.partitioned");
+  if (iter->Valid() && iter->key() == Slice("leveldb.index.partitioned")) {
+    rep_->partitioned_index = true;
+  }
+  iter->Seek("leveldb.range_del");
+  if (iter->Valid() && iter->key() == Slice("leveldb.range_del")) {
+    ReadRangeDeletions(iter->value());
   }
   delete iter;
   delete meta;
+  return Status::OK();
+}
+
+void Table::ReadRangeDeletions(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  Status s = handle.DecodeFrom(&v);
+  BlockContents contents;
+  if (s.ok()) {
+    ReadOptions opt;
+    if (rep_->options.paranoid_checks) {
+      opt.verify_checksums = true;
+    }
+    s = ReadBlock(rep_->file, opt, handle, &contents);
+  }
+  if (s.ok()) {
+    rep_->range_del_block = new Block(contents);
+  } else {
+    rep_->range_del_status = s;
+  }
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, bool full_filter) {
   Slice v = filter_handle_value;
-  BlockHandle filter_handle;
-  if (!filter_handle.DecodeFrom(&v).ok()) {
+  if (!rep_->filter_handle.DecodeFrom(&v).ok()) {
     return;
   }
+  rep_->full_filter = full_filter;
 
-  // We might want to unify with ReadBlock() if we start
-  // requiring checksum verification in Table::Open.
-  ReadOptions opt;
-  if (rep_->options.paranoid_checks) {
-    opt.verify_checksums = true;
-  }
-  BlockContents block;
-  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+  TableFilter* filter = rep_->ReadFilter();
+  if (filter == nullptr) {
     return;
   }
-  if (block.heap_allocated) {
-    rep_->filter_data = block.data.data();     // Will need to delete later
+  rep_->has_filter = true;
+  rep_->filter = filter;
+  if (rep_->CacheIndexAndFilter()) {
+    Cache* block_cache = rep_->options.block_cache;
+    char cache_key_buffer[16];
+    Cache::Handle* cache_handle = block_cache->InsertWithPriority(
+        rep_->CacheKey(rep_->filter_handle.offset(), cache_key_buffer),
+        filter, rep_->filter_handle.size(), &DeleteCachedFilter,
+        Cache::kHighPriority);
+    if (rep_->options.pin_l0_filter_and_index_blocks_in_cache) {
+      rep_->filter_cache_handle = cache_handle;
+    } else {
+      block_cache->Release(cache_handle);
+      rep_->filter = nullptr;
+    }
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
 Table::~Table() {
   delete rep_;
 }
 
-static void DeleteBlock(void* arg, void* ignored) {
-  delete reinterpret_cast<Block*>(arg);
-}
+struct Table::Rep::BlockReaderState {
+  Rep* const rep;
+  ReadaheadFile file;
+  PrefetchingFile* prefetcher;  // Reads blocks if prefetch_blocks > 0
+  Iterator* ahead;              // Index entry of the last block prefetched
+  uint64_t ahead_offset;        // Offset of that block, ~0 at the end, or
+                                // 0 once the reads stop being sequential
+  uint64_t next_offset;         // End of the last block read
+  int sequential_reads;         // Reads in a row at next_offset
 
-static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
-}
+  BlockReaderState(Rep* r, const ReadOptions& options,
+                   ReadaheadStats* stats)
+      : rep(r),
+        file(r->file, r->file_size, options.readahead_size, stats),
+        prefetcher(nullptr),
+        ahead(nullptr),
+        ahead_offset(0),
+        next_offset(~static_cast<uint64_t>(0)),
+        sequential_reads(0) {
+    if (options.prefetch_blocks > 0) {
+      prefetcher = new PrefetchingFile(r->file, r->options.env);
+    }
+  }
 
-static void ReleaseBlock(void* arg, void* h) {
-  Cache* cache = reinterpret_cast<Cache*>(arg);
-  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
-  cache->Release(handle);
-}
+  ~BlockReaderState() {
+    delete prefetcher;
+    delete ahead;
+  }
 
-// Convert an index iterator value (i.e., an encoded BlockHandle)
-// into an iterator over the contents of the corresponding block.
-Iterator* Table::BlockReader(void* arg,
-                             const ReadOptions& options,
-                             const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = nullptr;
-  Cache::Handle* cache_handle = nullptr;
+  static void Delete(void* arg, void* ignored) {
+    delete reinterpret_cast<BlockReaderState*>(arg);
+  }
+
+  Iterator* NewBlockIterator(const ReadOptions& options,
+                             const Slice& index_value);
+
+  // Prefetches the blocks after the one at "handle", whose contents
+  // "block_iter" iterates over, so that prefetch_blocks of them are
+  // pending.  Moves "block_iter".
+  void PrefetchAfter(const ReadOptions& options, const BlockHandle& handle,
+                     Iterator* block_iter);
+};
+
+Iterator* Table::Rep::BlockReaderState::NewBlockIterator(
+    const ReadOptions& options, const Slice& index_value) {
+  if (prefetcher == nullptr) {
+    return rep->NewBlockIterator(options, index_value, Cache::kLowPriority,
+                                 false, &file);
+  }
 
   BlockHandle handle;
   Slice input = index_value;
-  Status s = handle.DecodeFrom(&input);
-  // We intentionally allow extra stuff in index_value so that we
-  // can add more features in the future.
+  if (handle.DecodeFrom(&input).ok()) {
+    if (handle.offset() == next_offset) {
+      sequential_reads++;
+    } else {
+      // Whatever was prefetched, or is about to be, no longer follows
+      // the reads
+      sequential_reads = 0;
+      prefetcher->Clear();
+      ahead_offset = 0;
+    }
+    next_offset = handle.offset() + handle.size() + kBlockTrailerSize;
+  }
+  Iterator* iter = rep->NewBlockIterator(options, index_value,
+                                         Cache::kLowPriority, false,
+                                         prefetcher);
+  if (sequential_reads > 0 && iter->status().ok()) {
+    PrefetchAfter(options, handle, iter);
+  }
+  return iter;
+}
 
-  if (s.ok()) {
-    BlockContents contents;
+void Table::Rep::BlockReaderState::PrefetchAfter(
+    const ReadOptions& options, const BlockHandle& handle,
+    Iterator* block_iter) {
+  if (ahead == nullptr || ahead_offset <= handle.offset()) {
+    // The last key of the block leads to its index entry
+    block_iter->SeekToLast();
+    if (!block_iter->Valid()) {
+      return;
+    }
+    if (ahead == nullptr) {
+      ahead = rep->NewIndexIterator(options);
+    }
+    ahead->Seek(block_iter->key());
+    BlockHandle found;
+    Slice input = ahead->Valid() ? ahead->value() : Slice();
+    if (!found.DecodeFrom(&input).ok() ||
+        found.offset() != handle.offset()) {
+      return;
+    }
+    ahead_offset = handle.offset();
+  }
+
+  // Blocks that are in the block cache are skipped, but still count
+  // against the steps taken through the index.
+  const size_t limit = options.prefetch_blocks;
+  Cache* block_cache = options.fill_cache ? rep->options.block_cache
+                                          : nullptr;
+  for (size_t step = 0; step < limit && prefetcher->pending() < limit;
+       step++) {
+    if (!ahead->Valid() ||
+        (options.iterate_upper_bound != nullptr &&
+         rep->options.comparator->Compare(
+             ahead->key(), *options.iterate_upper_bound) >= 0)) {
+      // The blocks that follow are past the end of the table or range
+      break;
+    }
+    ahead->Next();
+    BlockHandle next;
+    Slice input = ahead->Valid() ? ahead->value() : Slice();
+    if (!next.DecodeFrom(&input).ok()) {
+      ahead_offset = ~static_cast<uint64_t>(0);
+      break;
+    }
+    ahead_offset = next.offset();
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer+8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
+      Cache::Handle* cache_handle = block_cache->Lookup(
+          rep->CacheKey(next.offset(), cache_key_buffer));
       if (cache_handle != nullptr) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
-      } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
-        if (s.ok()) {
-          block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
-          }
-        }
-      }
-    } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
-      if (s.ok()) {
-        block = new Block(contents);
+        block_cache->Release(cache_handle);
+        continue;
       }
     }
+    prefetcher->Prefetch(next.offset(), next.size() + kBlockTrailerSize);
   }
+  prefetcher->Submit();
+}
 
-  Iterator* iter;
-  if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
-    if (cache_handle == nullptr) {
-      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
-    } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
-    }
-  } else {
-    iter = NewErrorIterator(s);
-  }
-  return iter;
+// Convert an index iterator value (i.e., an encoded BlockHandle)
+// into an iterator over the contents of the corresponding block.
+// "arg" is a Rep::BlockReaderState.
+Iterator* Table::BlockReader(void* arg,
+                             const ReadOptions& options,
+                             const Slice& index_value) {
+  return reinterpret_cast<Rep::BlockReaderState*>(arg)->NewBlockIterator(
+      options, index_value);
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  return NewIterator(options, nullptr);
+}
+
+Iterator* Table::NewIterator(const ReadOptions& options,
+                             ReadaheadStats* readahead_stats) const {
+  // Each iterator reads ahead on its own, as it finds its reads sequential
+  Rep::BlockReaderState* state =
+      new Rep::BlockReaderState(rep_, options, readahead_stats);
+  Iterator* iter = NewTwoLevelIterator(
+      rep_->NewIndexIterator(options), &Table::BlockReader, state, options,
+      rep_->options.comparator);
+  iter->RegisterCleanup(&Rep::BlockReaderState::Delete, state, nullptr);
+  return iter;
+}
+
+Iterator* Table::NewRangeDeletionIterator() const {
+  if (!rep_->range_del_status.ok()) {
+    return NewErrorIterator(rep_->range_del_status);
+  }
+  if (rep_->range_del_block == nullptr) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
-                          void (*saver)(void*, const Slice&, const Slice&)) {
+                          void (*saver)(void*, const Slice&, const Slice&),
+                          PinnableSlice* pinned_value) {
+  const TableFilter* filter;
+  Cache::Handle* filter_cache_handle = rep_->GetFilter(&filter);
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (filter != nullptr && filter->full_filter != nullptr &&
+      !filter->full_filter->KeyMayMatch(k)) {
+    // Not found, without touching the index
+    rep_->ReleaseFilter(filter_cache_handle);
+    return s;
+  }
+  Iterator* iiter = rep_->NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != nullptr &&
+    if (filter != nullptr && filter->filter != nullptr &&
         handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+        !filter->filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
+      Iterator* block_iter = rep_->NewBlockIterator(
+          options, iiter->value(), Cache::kLowPriority, true);
       block_iter->Seek(k);
       if (block_iter->Valid()) {
         (*saver)(arg, block_iter->key(), block_iter->value());
       }
       s = block_iter->status();
-      delete block_iter;
+      if (pinned_value != nullptr && block_iter->Valid() && s.ok()) {
+        // The block iterator holds the data block, so keep it until the
+        // value is released.
+        pinned_value->PinSlice(block_iter->value(), &DeleteIterator,
+                               block_iter, nullptr);
+      } else {
+        delete block_iter;
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  rep_->ReleaseFilter(filter_cache_handle);
+  return s;
+}
+
+
+void Table::Rep::ReadDataBlocks(const ReadOptions& read_options,
+                                const std::vector<BlockHandle>& handles,
+                                std::vector<DataBlock>* blocks) {
+  Cache* block_cache = options.block_cache;
+  blocks->resize(handles.size());
+  std::vector<size_t> missing;
+  for (size_t i = 0; i < handles.size(); i++) {
+    DataBlock* b = &(*blocks)[i];
+    b->block = nullptr;
+    b->cache_handle = nullptr;
+    if (block_cache != nullptr) {
+      char cache_key_buffer[16];
+      b->cache_handle = block_cache->Lookup(
+          CacheKey(handles[i].offset(), cache_key_buffer));
+      if (b->cache_handle != nullptr) {
+        b->block = reinterpret_cast<Block*>(block_cache->Value(b->cache_handle));
+        continue;
+      }
+    }
+    missing.push_back(i);
+  }
+  if (missing.empty()) {
+    return;
+  }
+
+  const int n = static_cast<int>(missing.size());
+  std::vector<BlockHandle> missing_handles(n);
+  for (int j = 0; j < n; j++) {
+    missing_handles[j] = handles[missing[j]];
+  }
+  std::vector<BlockContents> contents(n);
+  std::vector<Status> statuses(n);
+  ReadBlocks(file, read_options, n, &missing_handles[0], &contents[0],
+             &statuses[0]);
+  for (int j = 0; j < n; j++) {
+    DataBlock* b = &(*blocks)[missing[j]];
+    b->status = statuses[j];
+    if (!b->status.ok()) {
+      continue;
+    }
+    b->block = new Block(contents[j]);
+    if (block_cache != nullptr && contents[j].cachable &&
+        read_options.fill_cache) {
+      char cache_key_buffer[16];
+      b->cache_handle = block_cache->Insert(
+          CacheKey(missing_handles[j].offset(), cache_key_buffer), b->block,
+          b->block->size(), &DeleteCachedBlock);
     }
   }
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options, int n,
+                               const Slice* keys, void* const* args,
+                               void (*saver)(void*, const Slice&,
+                                             const Slice&)) {
+  Status s;
+  const Comparator* cmp = rep_->options.comparator;
+  const TableFilter* filter;
+  Cache::Handle* filter_cache_handle = rep_->GetFilter(&filter);
+
+  // Find the data block of every key the filters do not rule out, so
+  // that all the blocks can be read at once.
+  std::vector<int> key_block(n, -1);  // Index into handles, or -1
+  std::vector<BlockHandle> handles;
+  Iterator* iiter = rep_->NewIndexIterator(options);
+  for (int i = 0; i < n; i++) {
+    const Slice& k = keys[i];
+    if (filter != nullptr && filter->full_filter != nullptr &&
+        !filter->full_filter->KeyMayMatch(k)) {
+      // Not found
+      continue;
+    }
+    // The index entry found for the previous key is still the first one
+    // at or after "k" if "k" does not go past it.
+    if (i == 0 || !iiter->Valid() || cmp->Compare(k, iiter->key()) > 0) {
+      iiter->Seek(k);
+    }
+    if (!iiter->Valid()) {
+      // This and all later keys are past the end of the table
+      break;
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    s = handle.DecodeFrom(&handle_value);
+    if (!s.ok()) {
+      break;
+    }
+    if (filter != nullptr && filter->filter != nullptr &&
+        !filter->filter->KeyMayMatch(handle.offset(), k)) {
+      // Not found
+      continue;
+    }
+    // Keys are sorted, so keys in the same block are adjacent
+    if (handles.empty() || handles.back().offset() != handle.offset()) {
+      handles.push_back(handle);
+    }
+    key_block[i] = static_cast<int>(handles.size()) - 1;
+  }
   if (s.ok()) {
     s = iiter->status();
   }
   delete iiter;
+
+  // The blocks are read and held kMultiGetBlocks at a time, so that a
+  // large batch does not hold all its blocks in memory at once.
+  int i = 0;  // Next key to look up
+  for (size_t first = 0; s.ok() && first < handles.size();
+       first += kMultiGetBlocks) {
+    const size_t end = std::min(handles.size(), first + kMultiGetBlocks);
+    std::vector<BlockHandle> chunk(handles.begin() + first,
+                                   handles.begin() + end);
+    std::vector<Rep::DataBlock> blocks;
+    rep_->ReadDataBlocks(options, chunk, &blocks);
+    Iterator* block_iter = nullptr;
+    int block_index = -1;  // Index of the block of block_iter
+    for (; i < n && s.ok(); i++) {
+      if (key_block[i] < 0) {
+        continue;
+      }
+      if (static_cast<size_t>(key_block[i]) >= end) {
+        break;  // In a later chunk
+      }
+      const Rep::DataBlock& b = blocks[key_block[i] - first];
+      if (b.block == nullptr) {
+        s = b.status;
+        break;
+      }
+      if (key_block[i] != block_index) {
+        delete block_iter;
+        block_iter = rep_->options.data_block_hash_index
+                         ? b.block->NewPointLookupIterator(cmp)
+                         : b.block->NewIterator(cmp);
+        block_index = key_block[i];
+      }
+      block_iter->Seek(keys[i]);
+      if (block_iter->Valid()) {
+        (*saver)(args[i], block_iter->key(), block_iter->value());
+      }
+      s = block_iter->status();
+    }
+    delete block_iter;
+    for (size_t j = 0; j < blocks.size(); j++) {
+      rep_->ReleaseDataBlock(blocks[j]);
+    }
+  }
+  rep_->ReleaseFilter(filter_cache_handle);
   return s;
 }
 
+bool Table::PrefixMayMatch(const Slice& key, const Slice& prefix_key) const {
+  const TableFilter* filter;
+  Cache::Handle* filter_cache_handle = rep_->GetFilter(&filter);
+  bool may_match = true;
+  if (filter == nullptr) {
+    // No filter to consult
+  } else if (filter->full_filter != nullptr) {
+    may_match = filter->full_filter->KeyMayMatch(prefix_key);
+  } else {
+    // Since matching entries are adjacent, there is one at or after "key"
+    // only if the first entry at or after "key" matches.  That entry is
+    // in the block found by the index, or in the next one if all entries
+    // of the found block come before "key".
+    Iterator* iiter = rep_->NewIndexIterator(ReadOptions());
+    iiter->Seek(key);
+    may_match = false;
+    for (int i = 0; i < 2 && iiter->Valid() && !may_match; i++) {
+      Slice handle_value = iiter->value();
+      BlockHandle handle;
+      if (!handle.DecodeFrom(&handle_value).ok() ||
+          filter->filter->KeyMayMatch(handle.offset(), prefix_key)) {
+        may_match = true;
+      }
+      iiter->Next();
+    }
+    if (!iiter->status().ok()) {
+      may_match = true;
+    }
+    delete iiter;
+  }
+  rep_->ReleaseFilter(filter_cache_handle);
+  return may_match;
+}
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = rep_->NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
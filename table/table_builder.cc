@@ -5,6 +5,8 @@
 #include "leveldb/table_builder.h"
 
 #include <assert.h>
+#include <string>
+#include <vector>
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
@@ -25,10 +27,13 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
   int64_t num_entries;
+  int64_t num_range_deletions;
   bool closed;          // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  FullFilterBlockBuilder* full_filter_block;  // If options.full_file_filter
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -42,6 +47,12 @@ struct TableBuilder::Rep {
   bool pending_index_entry;
   BlockHandle pending_handle;  // Handle to add to index block
 
+  // If options.index_partition_size is non-zero, the contents of the full
+  // partitions of the index and the last key of each.  index_block holds
+  // the entries of the partition being filled.
+  std::vector<std::string> index_partitions;
+  std::vector<std::string> index_partition_keys;
+
   std::string compressed_output;
 
   Rep(const Options& opt, WritableFile* f)
@@ -49,12 +60,18 @@ struct TableBuilder::Rep {
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
+        data_block(&options, true),
         index_block(&index_block_options),
+        range_del_block(&options),
         num_entries(0),
+        num_range_deletions(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr ? nullptr
+        filter_block(opt.filter_policy == nullptr || opt.full_file_filter
+                     ? nullptr
                      : new FilterBlockBuilder(opt.filter_policy)),
+        full_filter_block(opt.filter_policy == nullptr || !opt.full_file_filter
+                          ? nullptr
+                          : new FullFilterBlockBuilder(opt.filter_policy)),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -70,6 +87,7 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
   delete rep_;
 }
 
@@ -104,10 +122,19 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->options.index_partition_size > 0 &&
+        r->index_block.CurrentSizeEstimate() >=
+            r->options.index_partition_size) {
+      r->index_partitions.push_back(r->index_block.Finish().ToString());
+      r->index_partition_keys.push_back(r->last_key);
+      r->index_block.Reset();
+    }
   }
 
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
+  } else if (r->full_filter_block != nullptr) {
+    r->full_filter_block->AddKey(key);
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -120,6 +147,14 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeDeletion(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->num_range_deletions++;
+  r->range_del_block.Add(key, value);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -141,10 +176,13 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
+  WriteBlock(block->Finish(), handle);
+  block->Reset();
+}
+
+void TableBuilder::WriteBlock(const Slice& raw, BlockHandle* handle) {
   assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
-
   Slice block_contents;
   CompressionType type = r->options.compression;
   // TODO(postrelease): Support more compression options: zlib?
@@ -169,7 +207,6 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -201,13 +238,24 @@ Status TableBuilder::Finish() {
   Flush();
   assert(!r->closed);
   r->closed = true;
+  const bool partitioned_index = r->options.index_partition_size > 0 ||
+                                 !r->index_partitions.empty();
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, range_del_block_handle,
+      metaindex_block_handle, index_block_handle;
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+  } else if (ok() && r->full_filter_block != nullptr) {
+    WriteRawBlock(r->full_filter_block->Finish(), kNoCompression,
+                  &filter_block_handle);
+  }
+
+  // Write range deletion block
+  if (ok() && r->num_range_deletions > 0) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
   }
 
   // Write metaindex block
@@ -220,6 +268,23 @@ Status TableBuilder::Finish() {
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
+    } else if (r->full_filter_block != nullptr) {
+      // Add mapping from "fullfilter.Name" to location of filter data
+      std::string key = "fullfilter.";
+      key.append(r->options.filter_policy->Name());
+      std::string handle_encoding;
+      filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (partitioned_index) {
+      // The index block is the top-level index of a partitioned index
+      meta_index_block.Add("leveldb.index.partitioned", Slice());
+    }
+    if (r->num_range_deletions > 0) {
+      // Add mapping from "leveldb.range_del" to the range deletions
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("leveldb.range_del", handle_encoding);
     }
 
     // TODO(postrelease): Add stats and other meta blocks
@@ -235,7 +300,29 @@ Status TableBuilder::Finish() {
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+    if (partitioned_index) {
+      if (!r->index_block.empty()) {
+        r->index_partitions.push_back(r->index_block.Finish().ToString());
+        r->index_partition_keys.push_back(r->last_key);
+        r->index_block.Reset();
+      }
+      // Write the partitions, then a top-level index that maps from the
+      // last key of each partition to its location
+      BlockBuilder top_level_index(&r->index_block_options);
+      for (size_t i = 0; i < r->index_partitions.size() && ok(); i++) {
+        BlockHandle partition_handle;
+        WriteBlock(r->index_partitions[i], &partition_handle);
+        std::string handle_encoding;
+        partition_handle.EncodeTo(&handle_encoding);
+        top_level_index.Add(r->index_partition_keys[i], handle_encoding);
+      }
+      r->index_partitions.clear();
+      if (ok()) {
+        WriteBlock(&top_level_index, &index_block_handle);
+      }
+    } else {
+      WriteBlock(&r->index_block, &index_block_handle);
+    }
   }
 
   // Write footer
@@ -263,6 +350,10 @@ uint64_t TableBuilder::NumEntries() const {
   return rep_->num_entries;
 }
 
+uint64_t TableBuilder::NumRangeDeletions() const {
+  return rep_->num_range_deletions;
+}
+
 uint64_t TableBuilder::FileSize() const {
   return rep_->offset;
 }
@@ -4,18 +4,23 @@
 
 #include "leveldb/table.h"
 
+#include <atomic>
 #include <map>
+#include <set>
 #include <string>
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
 #include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -110,15 +115,19 @@ class StringSink: public WritableFile {
 class StringSource: public RandomAccessFile {
  public:
   StringSource(const Slice& contents)
-      : contents_(contents.data(), contents.size()) {
+      : contents_(contents.data(), contents.size()), reads_(0) {
   }
 
   virtual ~StringSource() { }
 
   uint64_t Size() const { return contents_.size(); }
 
+  // Number of calls to Read() so far
+  int reads() const { return reads_; }
+
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                        char* scratch) const {
+    reads_++;
     if (offset > contents_.size()) {
       return Status::InvalidArgument("invalid Read offset");
     }
@@ -132,6 +141,7 @@ class StringSource: public RandomAccessFile {
 
  private:
   std::string contents_;
+  mutable std::atomic<int> reads_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -407,30 +417,35 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  size_t index_partition_size;
 };
 
 static const TestArgs kTestArgList[] = {
-  { TABLE_TEST, false, 16 },
-  { TABLE_TEST, false, 1 },
-  { TABLE_TEST, false, 1024 },
-  { TABLE_TEST, true, 16 },
-  { TABLE_TEST, true, 1 },
-  { TABLE_TEST, true, 1024 },
-
-  { BLOCK_TEST, false, 16 },
-  { BLOCK_TEST, false, 1 },
-  { BLOCK_TEST, false, 1024 },
-  { BLOCK_TEST, true, 16 },
-  { BLOCK_TEST, true, 1 },
-  { BLOCK_TEST, true, 1024 },
+  { TABLE_TEST, false, 16, 0 },
+  { TABLE_TEST, false, 1, 0 },
+  { TABLE_TEST, false, 1024, 0 },
+  { TABLE_TEST, true, 16, 0 },
+  { TABLE_TEST, true, 1, 0 },
+  { TABLE_TEST, true, 1024, 0 },
+
+  // Tables whose index is split into partitions of a few entries
+  { TABLE_TEST, false, 16, 64 },
+  { TABLE_TEST, true, 1, 64 },
+
+  { BLOCK_TEST, false, 16, 0 },
+  { BLOCK_TEST, false, 1, 0 },
+  { BLOCK_TEST, false, 1024, 0 },
+  { BLOCK_TEST, true, 16, 0 },
+  { BLOCK_TEST, true, 1, 0 },
+  { BLOCK_TEST, true, 1024, 0 },
 
   // Restart interval does not matter for memtables
-  { MEMTABLE_TEST, false, 16 },
-  { MEMTABLE_TEST, true, 16 },
+  { MEMTABLE_TEST, false, 16, 0 },
+  { MEMTABLE_TEST, true, 16, 0 },
 
   // Do not bother with restart interval variations for DB
-  { DB_TEST, false, 16 },
-  { DB_TEST, true, 16 },
+  { DB_TEST, false, 16, 0 },
+  { DB_TEST, true, 16, 0 },
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -447,6 +462,7 @@ class Harness {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    options_.index_partition_size = args.index_partition_size;
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -735,7 +751,7 @@ TEST(Harness, Randomized) {
 
 TEST(Harness, RandomizedLongDB) {
   Random rnd(test::RandomSeed());
-  TestArgs args = { DB_TEST, false, 16 };
+  TestArgs args = { DB_TEST, false, 16, 0 };
   Init(args);
   int num_entries = 100000;
   for (int e = 0; e < num_entries; e++) {
@@ -784,6 +800,94 @@ TEST(MemTableTest, Simple) {
   memtable->Unref();
 }
 
+class MergerTest { };
+
+TEST(MergerTest, RandomizedAgainstModel) {
+  // Spread random keys over many children, as with many level-0 files,
+  // and check a random walk with direction changes against a model.
+  Random rnd(test::RandomSeed());
+  const int kNumChildren = 18;
+  for (int run = 0; run < 20; run++) {
+    std::vector<BlockConstructor*> constructors;
+    KVMap model;
+    for (int i = 0; i < kNumChildren; i++) {
+      constructors.push_back(new BlockConstructor(BytewiseComparator()));
+    }
+    const int num_entries = rnd.Uniform(500);
+    for (int e = 0; e < num_entries; e++) {
+      std::string key = test::RandomKey(&rnd, rnd.Skewed(4) + 1);
+      if (model.count(key) == 0) {
+        std::string value;
+        test::RandomString(&rnd, rnd.Skewed(5), &value);
+        model[key] = value;
+        // Leave some children empty
+        constructors[rnd.Uniform(kNumChildren - 2)]->Add(key, value);
+      }
+    }
+
+    Options options;
+    options.block_restart_interval = 1 + rnd.Uniform(4);
+    std::vector<Iterator*> children;
+    for (int i = 0; i < kNumChildren; i++) {
+      std::vector<std::string> keys;
+      KVMap kvmap;
+      constructors[i]->Finish(options, &keys, &kvmap);
+      children.push_back(constructors[i]->NewIterator());
+    }
+    Iterator* iter = NewMergingIterator(BytewiseComparator(), &children[0],
+                                        kNumChildren);
+
+    KVMap::const_iterator model_iter = model.end();
+    for (int step = 0; step < 500; step++) {
+      switch (rnd.Uniform(5)) {
+        case 0:
+          iter->SeekToFirst();
+          model_iter = model.begin();
+          break;
+        case 1:
+          iter->SeekToLast();
+          model_iter = model.empty() ? model.end() : --model.end();
+          break;
+        case 2: {
+          std::string target = test::RandomKey(&rnd, rnd.Skewed(4) + 1);
+          iter->Seek(target);
+          model_iter = model.lower_bound(target);
+          break;
+        }
+        case 3:
+          if (iter->Valid()) {
+            iter->Next();
+            ++model_iter;
+          }
+          break;
+        case 4:
+          if (iter->Valid()) {
+            iter->Prev();
+            if (model_iter == model.begin()) {
+              model_iter = model.end();
+            } else {
+              --model_iter;
+            }
+          }
+          break;
+      }
+      if (model_iter == model.end()) {
+        ASSERT_TRUE(!iter->Valid());
+      } else {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(model_iter->first, iter->key().ToString());
+        ASSERT_EQ(model_iter->second, iter->value().ToString());
+      }
+    }
+    ASSERT_OK(iter->status());
+
+    delete iter;
+    for (int i = 0; i < kNumChildren; i++) {
+      delete constructors[i];
+    }
+  }
+}
+
 static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   bool result = (val >= low) && (val <= high);
   if (!result) {
@@ -827,12 +931,338 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
 
 }
 
+// Builds a table of "n" keys into "sink" with per-block filters
+static void BuildFilteredTable(int n, StringSink* sink,
+                               size_t index_partition_size = 0) {
+  Options options;
+  options.block_size = 256;
+  options.index_partition_size = index_partition_size;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  TableBuilder builder(options, sink);
+  char key[20];
+  for (int i = 0; i < n; i++) {
+    snprintf(key, sizeof(key), "k%06d", i);
+    builder.Add(key, "value");
+  }
+  ASSERT_OK(builder.Finish());
+  delete options.filter_policy;
+}
+
+static int CountEntries(const Table* table,
+                        const ReadOptions& options = ReadOptions()) {
+  Iterator* iter = table->NewIterator(options);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+  return count;
+}
+
+TEST(TableTest, CacheIndexAndFilterBlocks) {
+  StringSink sink;
+  BuildFilteredTable(1000, &sink);
+  StringSource source(sink.contents());
+
+  for (int pin = 0; pin < 2; pin++) {
+    Options options;
+    options.block_cache = NewLRUCache(1 << 20, 0.5);
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.cache_index_and_filter_blocks = true;
+    options.pin_l0_filter_and_index_blocks_in_cache = (pin == 1);
+    Table* table;
+    ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table));
+
+    // The index and filter blocks are charged to the cache
+    const size_t meta_charge = options.block_cache->TotalCharge();
+    ASSERT_GT(meta_charge, 0);
+    ASSERT_EQ(1000, CountEntries(table));
+
+    // They are read again once evicted, unless they are pinned
+    options.block_cache->Prune();
+    if (pin) {
+      ASSERT_EQ(meta_charge, options.block_cache->TotalCharge());
+    } else {
+      ASSERT_EQ(0, options.block_cache->TotalCharge());
+    }
+    ASSERT_EQ(1000, CountEntries(table));
+    ASSERT_EQ(table->ApproximateOffsetOf("k000000"), 0);
+
+    delete table;
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+}
+
+TEST(TableTest, PartitionedIndex) {
+  StringSink flat_sink, partitioned_sink;
+  BuildFilteredTable(1000, &flat_sink);
+  BuildFilteredTable(1000, &partitioned_sink, 128);
+  // The partitions and the top-level index take more space than one index
+  ASSERT_GT(partitioned_sink.contents().size(), flat_sink.contents().size());
+  StringSource flat_source(flat_sink.contents());
+  StringSource partitioned_source(partitioned_sink.contents());
+
+  Options options;
+  options.block_cache = NewLRUCache(1 << 20);
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Table* flat;
+  Table* partitioned;
+  ASSERT_OK(Table::Open(options, &flat_source, flat_sink.contents().size(),
+                        &flat));
+  ASSERT_OK(Table::Open(options, &partitioned_source,
+                        partitioned_sink.contents().size(), &partitioned));
+  ASSERT_EQ(1000, CountEntries(partitioned));
+
+  // The data blocks are laid out the same way in both tables
+  char key[20];
+  for (int i = 0; i < 1000; i += 7) {
+    snprintf(key, sizeof(key), "k%06d", i);
+    ASSERT_EQ(flat->ApproximateOffsetOf(key),
+              partitioned->ApproximateOffsetOf(key));
+  }
+  ASSERT_TRUE(partitioned->ApproximateOffsetOf("z") >
+              partitioned->ApproximateOffsetOf("k000999"));
+
+  delete flat;
+  delete partitioned;
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+// A StringSource whose reads at "fail_offset" fail
+class FailingSource : public StringSource {
+ public:
+  FailingSource(const Slice& contents, uint64_t fail_offset)
+      : StringSource(contents), fail_offset_(fail_offset) { }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    if (offset == fail_offset_) {
+      return Status::IOError("injected read error");
+    }
+    return StringSource::Read(offset, n, result, scratch);
+  }
+
+ private:
+  const uint64_t fail_offset_;
+};
+
+TEST(TableTest, PartitionedIndexUnreadableMetaindex) {
+  StringSink sink;
+  BuildFilteredTable(1000, &sink, 128);
+  const std::string& contents = sink.contents();
+  Footer footer;
+  Slice footer_input(contents.data() + contents.size() -
+                         Footer::kEncodedLength,
+                     Footer::kEncodedLength);
+  ASSERT_OK(footer.DecodeFrom(&footer_input));
+
+  // Without the metaindex the top-level index would be taken for the
+  // index of the data blocks
+  FailingSource source(contents, footer.metaindex_handle().offset());
+  Options options;
+  Table* table;
+  Status s = Table::Open(options, &source, contents.size(), &table);
+  ASSERT_TRUE(s.IsIOError()) << s.ToString();
+  ASSERT_TRUE(table == nullptr);
+}
+
+TEST(TableTest, DataBlockHashIndex) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  Options options;
+  options.comparator = &cmp;
+  options.block_restart_interval = 4;
+  options.data_block_hash_index = true;
+  BlockBuilder builder(&options, true);
+
+  // Even user keys with one to three versions each
+  std::vector<std::string> keys;
+  for (int i = 0; i < 200; i += 2) {
+    char user_key[20];
+    snprintf(user_key, sizeof(user_key), "key%04d", i);
+    for (int seq = 100 + i % 3; seq >= 100; seq--) {
+      InternalKey key(user_key, seq, kTypeValue);
+      keys.push_back(key.Encode().ToString());
+      builder.Add(keys.back(), user_key);
+    }
+  }
+  BlockContents contents;
+  contents.data = builder.Finish();
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  Iterator* iter = block.NewIterator(&cmp);
+  Iterator* lookup_iter = block.NewPointLookupIterator(&cmp);
+  int skipped = 0;
+  for (int i = 0; i < 200; i++) {
+    char user_key[20];
+    snprintf(user_key, sizeof(user_key), "key%04d", i);
+    for (SequenceNumber snapshot = 99; snapshot <= 103; snapshot++) {
+      InternalKey target(user_key, snapshot, kValueTypeForSeek);
+      iter->Seek(target.Encode());
+      lookup_iter->Seek(target.Encode());
+      ASSERT_OK(lookup_iter->status());
+      if (i % 2 == 0) {
+        // Present user keys are found at the same entry as with Seek()
+        ASSERT_EQ(iter->Valid(), lookup_iter->Valid());
+        if (iter->Valid()) {
+          ASSERT_EQ(iter->key().ToString(), lookup_iter->key().ToString());
+          ASSERT_EQ(iter->value().ToString(), lookup_iter->value().ToString());
+        }
+      } else if (!lookup_iter->Valid()) {
+        skipped++;
+      } else {
+        ASSERT_NE(user_key, ExtractUserKey(lookup_iter->key()).ToString());
+      }
+    }
+  }
+  // Many absent user keys are ruled out by the hash index alone
+  ASSERT_GT(skipped, 100);
+
+  // Regular iterators do not use the hash index
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(!keys.empty());
+    ASSERT_EQ(keys.front(), iter->key().ToString());
+    keys.erase(keys.begin());
+  }
+  ASSERT_TRUE(keys.empty());
+  delete iter;
+  delete lookup_iter;
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
   return port::Snappy_Compress(in.data(), in.size(), &out);
 }
 
+TEST(TableTest, Readahead) {
+  StringSink sink;
+  BuildFilteredTable(10000, &sink);
+  StringSource source(sink.contents());
+  Options options;
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table));
+  const int blocks = sink.contents().size() / 256;
+
+  // A scan reads all blocks but the first few ahead, in growing chunks
+  int before = source.reads();
+  ASSERT_EQ(10000, CountEntries(table));
+  const int scan_reads = source.reads() - before;
+  ASSERT_GT(blocks, 300);
+  ASSERT_LT(scan_reads, 10);
+
+  // A fixed readahead_size reads the same amount every time
+  ReadOptions read_options;
+  read_options.readahead_size = 16 << 10;
+  before = source.reads();
+  ASSERT_EQ(10000, CountEntries(table, read_options));
+  ASSERT_GT(source.reads() - before, scan_reads);
+  ASSERT_LE(source.reads() - before, sink.contents().size() / (16 << 10) + 1);
+
+  // Seeks that jump around read one block each
+  Iterator* iter = table->NewIterator(ReadOptions());
+  before = source.reads();
+  char key[20];
+  for (int i = 9; i >= 0; i--) {
+    snprintf(key, sizeof(key), "k%06d", i * 1000);
+    iter->Seek(key);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(key, iter->key().ToString());
+  }
+  ASSERT_EQ(10, source.reads() - before);
+  delete iter;
+  delete table;
+}
+
+// Runs the prefetches of table iterators at once, on the calling thread
+class InlinePrefetchEnv : public EnvWrapper {
+ public:
+  InlinePrefetchEnv() : EnvWrapper(Env::Default()), prefetch_jobs_(0) { }
+
+  int prefetch_jobs() const { return prefetch_jobs_; }
+
+  virtual void Schedule(void (*function)(void*), void* arg, Priority pri) {
+    if (pri == IO) {
+      prefetch_jobs_++;
+      (*function)(arg);
+    } else {
+      EnvWrapper::Schedule(function, arg, pri);
+    }
+  }
+
+ private:
+  int prefetch_jobs_;
+};
+
+TEST(TableTest, PrefetchBlocks) {
+  StringSink sink;
+  BuildFilteredTable(10000, &sink);
+  StringSource source(sink.contents());
+  InlinePrefetchEnv env;
+  Options options;
+  options.env = &env;
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table));
+
+  // Each data block starts at a different offset
+  std::set<uint64_t> block_offsets;
+  char key[20];
+  for (int i = 0; i < 10000; i++) {
+    snprintf(key, sizeof(key), "k%06d", i);
+    block_offsets.insert(table->ApproximateOffsetOf(key));
+  }
+
+  // A scan reads every block exactly once, most of them in the background
+  ReadOptions read_options;
+  read_options.prefetch_blocks = 4;
+  int before = source.reads();
+  Iterator* iter = table->NewIterator(read_options);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    snprintf(key, sizeof(key), "k%06d", count);
+    ASSERT_EQ(key, iter->key().ToString());
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(10000, count);
+  ASSERT_EQ(block_offsets.size(), source.reads() - before);
+
+  // Seeks that jump around drop what was prefetched
+  for (int i = 9; i >= 0; i--) {
+    snprintf(key, sizeof(key), "k%06d", i * 1000);
+    iter->Seek(key);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(key, iter->key().ToString());
+    iter->Next();
+    iter->Prev();
+    ASSERT_EQ(key, iter->key().ToString());
+  }
+
+  // Scans that start after seeking backward are prefetched again
+  for (int start = 5000; start >= 0; start -= 5000) {
+    snprintf(key, sizeof(key), "k%06d", start);
+    std::set<uint64_t> scanned_offsets(
+        block_offsets.lower_bound(table->ApproximateOffsetOf(key)),
+        block_offsets.end());
+    before = source.reads();
+    const int jobs_before = env.prefetch_jobs();
+    count = 0;
+    for (iter->Seek(key); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_EQ(10000 - start, count);
+    ASSERT_EQ(scanned_offsets.size(), source.reads() - before);
+    ASSERT_GT(env.prefetch_jobs(), jobs_before);
+  }
+  delete iter;
+  delete table;
+}
+
 TEST(TableTest, ApproximateOffsetOfCompressed) {
   if (!SnappyCompressionSupported()) {
     fprintf(stderr, "skipping compression tests\n");
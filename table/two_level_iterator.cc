@@ -4,6 +4,7 @@
 
 #include "table/two_level_iterator.h"
 
+#include "leveldb/comparator.h"
 #include "leveldb/table.h"
 #include "table/block.h"
 #include "table/format.h"
@@ -21,7 +22,8 @@ class TwoLevelIterator: public Iterator {
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    const Comparator* comparator);
 
   virtual ~TwoLevelIterator();
 
@@ -57,14 +59,36 @@ class TwoLevelIterator: public Iterator {
   void SaveError(const Status& s) {
     if (status_.ok() && !s.ok()) status_ = s;
   }
-  void SkipEmptyDataBlocksForward();
-  void SkipEmptyDataBlocksBackward();
+  // With "at_bounds" set, stop at the bounds of options_ instead of
+  // reading blocks entirely outside them.  Only done when moving with
+  // Next() and Prev(): after a seek the iterator must be invalid only if
+  // there are no entries at all in the direction of the seek, since
+  // MergingIterator relies on that when it changes direction.
+  void SkipEmptyDataBlocksForward(bool at_bounds);
+  void SkipEmptyDataBlocksBackward(bool at_bounds);
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
 
+  // Whether the blocks after the one at index_iter_ only hold keys at or
+  // after options_.iterate_upper_bound
+  bool AfterUpperBound() const {
+    return comparator_ != nullptr && options_.iterate_upper_bound != nullptr &&
+           comparator_->Compare(index_iter_.key(),
+                                *options_.iterate_upper_bound) >= 0;
+  }
+
+  // Whether the block at index_iter_ only holds keys before
+  // options_.iterate_lower_bound
+  bool BeforeLowerBound() const {
+    return comparator_ != nullptr && options_.iterate_lower_bound != nullptr &&
+           comparator_->Compare(index_iter_.key(),
+                                *options_.iterate_lower_bound) < 0;
+  }
+
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  const Comparator* const comparator_;
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_; // May be nullptr
@@ -77,10 +101,12 @@ TwoLevelIterator::TwoLevelIterator(
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options)
+    const ReadOptions& options,
+    const Comparator* comparator)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
+      comparator_(comparator),
       index_iter_(index_iter),
       data_iter_(nullptr) {
 }
@@ -92,40 +118,40 @@ void TwoLevelIterator::Seek(const Slice& target) {
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
-  SkipEmptyDataBlocksForward();
+  SkipEmptyDataBlocksForward(false);
 }
 
 void TwoLevelIterator::SeekToFirst() {
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
-  SkipEmptyDataBlocksForward();
+  SkipEmptyDataBlocksForward(false);
 }
 
 void TwoLevelIterator::SeekToLast() {
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
-  SkipEmptyDataBlocksBackward();
+  SkipEmptyDataBlocksBackward(false);
 }
 
 void TwoLevelIterator::Next() {
   assert(Valid());
   data_iter_.Next();
-  SkipEmptyDataBlocksForward();
+  SkipEmptyDataBlocksForward(true);
 }
 
 void TwoLevelIterator::Prev() {
   assert(Valid());
   data_iter_.Prev();
-  SkipEmptyDataBlocksBackward();
+  SkipEmptyDataBlocksBackward(true);
 }
 
 
-void TwoLevelIterator::SkipEmptyDataBlocksForward() {
+void TwoLevelIterator::SkipEmptyDataBlocksForward(bool at_bounds) {
   while (data_iter_.iter() == nullptr || !data_iter_.Valid()) {
     // Move to next block
-    if (!index_iter_.Valid()) {
+    if (!index_iter_.Valid() || (at_bounds && AfterUpperBound())) {
       SetDataIterator(nullptr);
       return;
     }
@@ -135,7 +161,7 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
   }
 }
 
-void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
+void TwoLevelIterator::SkipEmptyDataBlocksBackward(bool at_bounds) {
   while (data_iter_.iter() == nullptr || !data_iter_.Valid()) {
     // Move to next block
     if (!index_iter_.Valid()) {
@@ -143,6 +169,10 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
       return;
     }
     index_iter_.Prev();
+    if (at_bounds && index_iter_.Valid() && BeforeLowerBound()) {
+      SetDataIterator(nullptr);
+      return;
+    }
     InitDataBlock();
     if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
   }
@@ -175,8 +205,10 @@ Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+    const ReadOptions& options,
+    const Comparator* comparator) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              comparator);
 }
 
 }  // namespace leveldb
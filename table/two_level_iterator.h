@@ -9,6 +9,7 @@
 
 namespace leveldb {
 
+class Comparator;
 struct ReadOptions;
 
 // Return a new two level iterator.  A two-level iterator contains an
@@ -20,6 +21,11 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If "comparator" is non-null, the keys of index_iter are compared with
+// it to options.iterate_lower_bound and options.iterate_upper_bound:
+// Next() and Prev() do not move into blocks that only hold keys outside
+// the bounds, but leave the iterator invalid instead.
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(
@@ -27,7 +33,8 @@ Iterator* NewTwoLevelIterator(
         const ReadOptions& options,
         const Slice& index_value),
     void* arg,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    const Comparator* comparator = nullptr);
 
 }  // namespace leveldb
 
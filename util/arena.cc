@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 #include <assert.h>
+#include <atomic>
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -57,12 +59,59 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+// Returns the shard of the calling thread.  Threads are spread over the
+// shards in the order in which they first allocate.
+static int ThreadShard(int num_shards) {
+  static std::atomic<unsigned int> next_shard(0);
+  static thread_local unsigned int shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed);
+  return shard % num_shards;
+}
+
+char* Arena::AllocateFromShard(size_t bytes, bool aligned) {
+  assert(bytes > 0);
+  if (bytes > kBlockSize / 4) {
+    // Like AllocateFallback(), give large objects a block of their own
+    char* result = new char[bytes];
+    MutexLock l(&mu_);
+    AddBlock(result, bytes);
+    return result;
+  }
+
+  Shard* shard = &shards_[ThreadShard(kNumShards)];
+  MutexLock l(&shard->mu);
+  size_t slop = 0;
+  if (aligned) {
+    const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+    size_t current_mod =
+        reinterpret_cast<uintptr_t>(shard->alloc_ptr) & (align-1);
+    slop = (current_mod == 0 ? 0 : align - current_mod);
+  }
+  if (bytes + slop > shard->alloc_bytes_remaining) {
+    // We waste the remaining space in the current block of the shard.
+    // Blocks from new[] are always aligned.
+    shard->alloc_ptr = new char[kBlockSize];
+    shard->alloc_bytes_remaining = kBlockSize;
+    slop = 0;
+    MutexLock block_lock(&mu_);
+    AddBlock(shard->alloc_ptr, kBlockSize);
+  }
+  char* result = shard->alloc_ptr + slop;
+  shard->alloc_ptr += bytes + slop;
+  shard->alloc_bytes_remaining -= bytes + slop;
+  return result;
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
-  blocks_.push_back(result);
+  AddBlock(result, block_bytes);
+  return result;
+}
+
+void Arena::AddBlock(char* block, size_t block_bytes) {
+  blocks_.push_back(block);
   memory_usage_.NoBarrier_Store(
       reinterpret_cast<void*>(MemoryUsage() + block_bytes + sizeof(char*)));
-  return result;
 }
 
 }  // namespace leveldb
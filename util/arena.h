@@ -24,6 +24,17 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc
   char* AllocateAligned(size_t bytes);
 
+  // Thread-safe variants of Allocate() and AllocateAligned().  They may
+  // be called by several threads at once, but not at the same time as
+  // the variants above.  Each thread allocates from one of several
+  // shards, so that threads seldom wait for each other.
+  char* AllocateConcurrently(size_t bytes) {
+    return AllocateFromShard(bytes, false);
+  }
+  char* AllocateAlignedConcurrently(size_t bytes) {
+    return AllocateFromShard(bytes, true);
+  }
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -33,6 +44,11 @@ class Arena {
  private:
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateFromShard(size_t bytes, bool aligned);
+
+  // Takes ownership of "block", a new[] allocated array of "block_bytes"
+  // bytes.
+  void AddBlock(char* block, size_t block_bytes);
 
   // Allocation state
   char* alloc_ptr_;
@@ -44,6 +60,22 @@ class Arena {
   // Total memory usage of the arena.
   port::AtomicPointer memory_usage_;
 
+  // Allocation state of the thread-safe methods.  A shard bump-allocates
+  // from a block of its own, and only takes mu_ to add a new block.
+  enum { kNumShards = 8 };
+  struct Shard {
+    port::Mutex mu;
+    char* alloc_ptr;
+    size_t alloc_bytes_remaining;
+    char padding[64];  // Keeps neighbouring shards off each other's cache line
+
+    Shard() : alloc_ptr(nullptr), alloc_bytes_remaining(0) { }
+  };
+  Shard shards_[kNumShards];
+
+  // Guards blocks_ and memory_usage_ in the thread-safe methods
+  port::Mutex mu_;
+
   // No copying allowed
   Arena(const Arena&);
   void operator=(const Arena&);
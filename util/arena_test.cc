@@ -4,6 +4,9 @@
 
 #include "util/arena.h"
 
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -61,6 +64,84 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+namespace {
+
+struct ConcurrentState {
+  Arena arena;
+  port::Mutex mu;
+  port::CondVar cv;
+  int done;
+  std::vector<std::pair<size_t, char*> > allocated[4];
+
+  ConcurrentState() : cv(&mu), done(0) { }
+};
+
+struct ConcurrentArg {
+  ConcurrentState* state;
+  int id;
+};
+
+void AllocateAndFill(void* arg) {
+  ConcurrentArg* a = reinterpret_cast<ConcurrentArg*>(arg);
+  std::vector<std::pair<size_t, char*> >* allocated =
+      &a->state->allocated[a->id];
+  Random rnd(301 + a->id);
+  for (int i = 0; i < 20000; i++) {
+    size_t s = rnd.OneIn(1000) ? rnd.Uniform(6000) :
+        (rnd.OneIn(10) ? rnd.Uniform(100) : rnd.Uniform(20));
+    if (s == 0) {
+      s = 1;
+    }
+    char* r;
+    if (rnd.OneIn(2)) {
+      r = a->state->arena.AllocateAlignedConcurrently(s);
+      ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r) & (sizeof(void*) - 1));
+    } else {
+      r = a->state->arena.AllocateConcurrently(s);
+    }
+    for (size_t b = 0; b < s; b++) {
+      r[b] = (a->id + i) % 256;
+    }
+    allocated->push_back(std::make_pair(s, r));
+  }
+  MutexLock l(&a->state->mu);
+  a->state->done++;
+  a->state->cv.SignalAll();
+}
+
+}  // anonymous namespace
+
+TEST(ArenaTest, Concurrent) {
+  ConcurrentState state;
+  ConcurrentArg args[4];
+  for (int i = 0; i < 4; i++) {
+    args[i].state = &state;
+    args[i].id = i;
+    Env::Default()->StartThread(&AllocateAndFill, &args[i]);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.done < 4) {
+      state.cv.Wait();
+    }
+  }
+
+  // No allocation overlaps one made by another thread
+  size_t bytes = 0;
+  for (int id = 0; id < 4; id++) {
+    for (size_t i = 0; i < state.allocated[id].size(); i++) {
+      size_t num_bytes = state.allocated[id][i].first;
+      const char* p = state.allocated[id][i].second;
+      for (size_t b = 0; b < num_bytes; b++) {
+        ASSERT_EQ(int(p[b]) & 0xff, (id + i) % 256);
+      }
+      bytes += num_bytes;
+    }
+  }
+  ASSERT_GE(state.arena.MemoryUsage(), bytes);
+  ASSERT_LE(state.arena.MemoryUsage(), bytes * 1.25);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -18,16 +18,16 @@ static Slice Key(int i, char* buffer) {
   return Slice(buffer, sizeof(uint32_t));
 }
 
-class BloomTest {
+class FilterTest {
  private:
   const FilterPolicy* policy_;
   std::string filter_;
   std::vector<std::string> keys_;
 
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) { }
+  explicit FilterTest(const FilterPolicy* policy) : policy_(policy) { }
 
-  ~BloomTest() {
+  ~FilterTest() {
     delete policy_;
   }
 
@@ -84,6 +84,33 @@ class BloomTest {
     }
     return result / 10000.0;
   }
+
+  // Build filters for a range of key counts and check that each matches
+  // its keys, takes at most "overhead" bytes beyond 10 bits per key and
+  // has a false positive rate of at most "max_rate", and one of at most
+  // "good_rate" for most of them.
+  void CheckVaryingLengths(size_t overhead, double max_rate,
+                           double good_rate);
+
+  // Build a filter of "length" keys, larger than most L2 caches for a
+  // million keys, and check that it takes at most "overhead" bytes beyond
+  // 10 bits per key and has a false positive rate of at most "max_rate".
+  void CheckLargeFilter(int length, size_t overhead, double max_rate);
+};
+
+class BloomTest : public FilterTest {
+ public:
+  BloomTest() : FilterTest(NewBloomFilterPolicy(10)) { }
+};
+
+class BlockedBloomTest : public FilterTest {
+ public:
+  BlockedBloomTest() : FilterTest(NewBlockedBloomFilterPolicy(10)) { }
+};
+
+class RibbonTest : public FilterTest {
+ public:
+  RibbonTest() : FilterTest(NewRibbonFilterPolicy(10)) { }
 };
 
 TEST(BloomTest, EmptyFilter) {
@@ -113,7 +140,8 @@ static int NextLength(int length) {
   return length;
 }
 
-TEST(BloomTest, VaryingLengths) {
+void FilterTest::CheckVaryingLengths(size_t overhead, double max_rate,
+                                     double good_rate) {
   char buffer[sizeof(int)];
 
   // Count number of filters that significantly exceed the false positive rate
@@ -127,7 +155,7 @@ TEST(BloomTest, VaryingLengths) {
     }
     Build();
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + overhead))
         << length;
 
     // All added keys must match
@@ -142,8 +170,8 @@ TEST(BloomTest, VaryingLengths) {
       fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
               rate*100.0, length, static_cast<int>(FilterSize()));
     }
-    ASSERT_LE(rate, 0.02);   // Must not be over 2%
-    if (rate > 0.0125) mediocre_filters++;  // Allowed, but not too often
+    ASSERT_LE(rate, max_rate);
+    if (rate > good_rate) mediocre_filters++;  // Allowed, but not too often
     else good_filters++;
   }
   if (kVerbose >= 1) {
@@ -153,6 +181,96 @@ TEST(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters/5);
 }
 
+void FilterTest::CheckLargeFilter(int length, size_t overhead,
+                                  double max_rate) {
+  char buffer[sizeof(int)];
+  Reset();
+  for (int i = 0; i < length; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+  ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + overhead));
+  const double rate = FalsePositiveRate();
+  if (kVerbose >= 1) {
+    fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+            rate*100.0, length, static_cast<int>(FilterSize()));
+  }
+  ASSERT_LE(rate, max_rate);
+}
+
+TEST(BloomTest, VaryingLengths) {
+  CheckVaryingLengths(40, 0.02, 0.0125);
+}
+
+TEST(BloomTest, LargeFilter) {
+  CheckLargeFilter(1 << 20, 40, 0.02);
+}
+
+TEST(BlockedBloomTest, BlockedEmptyFilter) {
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
+
+TEST(BlockedBloomTest, BlockedSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
+
+TEST(BlockedBloomTest, BlockedVaryingLengths) {
+  // Filters are a whole number of 64-byte lines
+  CheckVaryingLengths(65, 0.02, 0.0125);
+}
+
+TEST(BlockedBloomTest, BlockedLargeFilter) {
+  // Confining the probes of a key to one cache line costs little
+  // accuracy with 10 bits per key
+  CheckLargeFilter(1 << 20, 65, 0.0125);
+}
+
+TEST(RibbonTest, RibbonEmptyFilter) {
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
+
+TEST(RibbonTest, RibbonSmall) {
+  Add("hello");
+  Add("world");
+  Add("hello");  // Duplicates are allowed
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
+
+TEST(RibbonTest, RibbonVaryingLengths) {
+  // Small filters have at least two blocks of 64 slots
+  CheckVaryingLengths(130, 0.02, 0.0125);
+}
+
+TEST(RibbonTest, RibbonSpace) {
+  // For large sets of keys a ribbon filter takes at most 80% of the
+  // space of a bloom filter with the same false positive rate.
+  char buffer[sizeof(int)];
+  const int kLength = 100000;
+  for (int i = 0; i < kLength; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+  ASSERT_LE(FilterSize(), kLength * 10 / 8 * 8 / 10);
+  ASSERT_LE(FalsePositiveRate(), 0.0125);
+}
+
+TEST(RibbonTest, RibbonLargeFilter) {
+  // The space saving of RibbonSpace holds for filters larger than caches
+  const int kLength = 1 << 20;
+  CheckLargeFilter(kLength, 0, 0.0125);
+  ASSERT_LE(FilterSize(), kLength * 10 / 8 * 8 / 10);
+}
+
 // Different bits-per-byte
 
 }  // namespace leveldb
@@ -37,6 +37,12 @@ namespace {
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
+//
+// If the cache has a high-priority pool, items inserted with
+// kHighPriority that are not referenced by clients are kept in a third
+// list, high-pri LRU, instead of LRU.  Items are only evicted from it once
+// LRU is empty.  Whenever the items on it are charged more than the pool
+// capacity, its oldest items move to LRU as its newest ones.
 
 // An entry is a variable length heap-allocated structure.  Entries
 // are kept in a circular doubly linked list ordered by access time.
@@ -49,6 +55,8 @@ struct LRUHandle {
   size_t charge;      // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;      // Whether entry is in the cache.
+  bool high_pri;      // Whether entry was inserted with kHighPriority.
+  bool in_high_pri_pool;  // Whether entry is on the high-pri LRU list.
   uint32_t refs;      // References, including cache reference, if present.
   uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
   char key_data[1];   // Beginning of key
@@ -155,12 +163,16 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, double high_pri_pool_ratio) {
+    capacity_ = capacity;
+    high_pri_capacity_ = static_cast<size_t>(capacity * high_pri_pool_ratio);
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash,
                         void* value, size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -173,22 +185,29 @@ class LRUCache {
  private:
   void LRU_Remove(LRUHandle* e);
   void LRU_Append(LRUHandle*list, LRUHandle* e);
+  void MakeEvictable(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  size_t high_pri_usage_ GUARDED_BY(mutex_);  // Charge of high_pri_lru_
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of high-pri LRU list, ordered like lru_.
+  // Entries have refs==1, in_cache==true and high_pri==true.
+  LRUHandle high_pri_lru_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
@@ -197,10 +216,15 @@ class LRUCache {
 };
 
 LRUCache::LRUCache()
-    : usage_(0) {
+    : capacity_(0),
+      high_pri_capacity_(0),
+      usage_(0),
+      high_pri_usage_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  high_pri_lru_.next = &high_pri_lru_;
+  high_pri_lru_.prev = &high_pri_lru_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
@@ -215,10 +239,18 @@ LRUCache::~LRUCache() {
     Unref(e);
     e = next;
   }
+  for (LRUHandle* e = high_pri_lru_.next; e != &high_pri_lru_; ) {
+    LRUHandle* next = e->next;
+    assert(e->in_cache);
+    e->in_cache = false;
+    assert(e->refs == 1);  // Invariant of high_pri_lru_ list.
+    Unref(e);
+    e = next;
+  }
 }
 
 void LRUCache::Ref(LRUHandle* e) {
-  if (e->refs == 1 && e->in_cache) {  // If on lru_ list, move to in_use_ list.
+  if (e->refs == 1 && e->in_cache) {  // If on an LRU list, move to in_use_.
     LRU_Remove(e);
     LRU_Append(&in_use_, e);
   }
@@ -233,15 +265,35 @@ void LRUCache::Unref(LRUHandle* e) {
     (*e->deleter)(e->key(), e->value);
     free(e);
   } else if (e->in_cache && e->refs == 1) {
-    // No longer in use; move to lru_ list.
+    // No longer in use; move to an LRU list.
     LRU_Remove(e);
+    MakeEvictable(e);
+  }
+}
+
+void LRUCache::MakeEvictable(LRUHandle* e) {
+  if (!e->high_pri || high_pri_capacity_ == 0) {
     LRU_Append(&lru_, e);
+    return;
+  }
+  LRU_Append(&high_pri_lru_, e);
+  e->in_high_pri_pool = true;
+  high_pri_usage_ += e->charge;
+  while (high_pri_usage_ > high_pri_capacity_) {
+    // Overflow the oldest high priority entries into lru_
+    LRUHandle* old = high_pri_lru_.next;
+    LRU_Remove(old);
+    LRU_Append(&lru_, old);
   }
 }
 
 void LRUCache::LRU_Remove(LRUHandle* e) {
   e->next->prev = e->prev;
   e->prev->next = e->next;
+  if (e->in_high_pri_pool) {
+    e->in_high_pri_pool = false;
+    high_pri_usage_ -= e->charge;
+  }
 }
 
 void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
@@ -268,7 +320,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(
     const Slice& key, uint32_t hash, void* value, size_t charge,
-    void (*deleter)(const Slice& key, void* value)) {
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
   MutexLock l(&mutex_);
 
   LRUHandle* e = reinterpret_cast<LRUHandle*>(
@@ -279,6 +332,8 @@ Cache::Handle* LRUCache::Insert(
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->high_pri = (priority == Cache::kHighPriority);
+  e->in_high_pri_pool = false;
   e->refs = 1;  // for the returned handle.
   memcpy(e->key_data, key.data(), key.size());
 
@@ -292,8 +347,11 @@ Cache::Handle* LRUCache::Insert(
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
   }
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  while (usage_ > capacity_ &&
+         (lru_.next != &lru_ || high_pri_lru_.next != &high_pri_lru_)) {
+    // High priority entries are only evicted once lru_ is empty
+    LRUHandle* old =
+        (lru_.next != &lru_) ? lru_.next : high_pri_lru_.next;
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -324,8 +382,8 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
+  while (lru_.next != &lru_ || high_pri_lru_.next != &high_pri_lru_) {
+    LRUHandle* e = (lru_.next != &lru_) ? lru_.next : high_pri_lru_.next;
     assert(e->refs == 1);
     bool erased = FinishErase(table_.Remove(e->key(), e->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -352,18 +410,28 @@ class ShardedLRUCache : public Cache {
   }
 
  public:
-  explicit ShardedLRUCache(size_t capacity)
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio)
       : last_id_(0) {
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
     for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard, high_pri_pool_ratio);
     }
   }
   virtual ~ShardedLRUCache() { }
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      kLowPriority);
+  }
+  virtual Handle* InsertWithPriority(const Slice& key, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value),
+                                     Priority priority) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   virtual Handle* Lookup(const Slice& key) {
     const uint32_t hash = HashSlice(key);
@@ -401,7 +469,11 @@ class ShardedLRUCache : public Cache {
 }  // end anonymous namespace
 
 Cache* NewLRUCache(size_t capacity) {
-  return new ShardedLRUCache(capacity);
+  return new ShardedLRUCache(capacity, 0.0);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio);
 }
 
 }  // namespace leveldb
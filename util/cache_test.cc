@@ -59,6 +59,13 @@ class CacheTest {
                                    &CacheTest::Deleter));
   }
 
+  void InsertHighPriority(int key, int value, int charge = 1) {
+    cache_->Release(cache_->InsertWithPriority(EncodeKey(key),
+                                               EncodeValue(value), charge,
+                                               &CacheTest::Deleter,
+                                               Cache::kHighPriority));
+  }
+
   Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
     return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
                           &CacheTest::Deleter);
@@ -219,6 +226,32 @@ TEST(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
+TEST(CacheTest, HighPriorityPool) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5);
+
+  // High priority entries outlive any number of others
+  for (int i = 0; i < 100; i++) {
+    InsertHighPriority(i, 100+i);
+  }
+  for (int i = 0; i < 2*kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(100+i, Lookup(i));
+  }
+
+  // ...unless there are more of them than fit into the pool
+  for (int i = 0; i < 2*kCacheSize; i++) {
+    InsertHighPriority(1000+i, 3000+i);
+  }
+  int cached = 0;
+  for (int i = 0; i < 100; i++) {
+    if (Lookup(i) >= 0) cached++;
+  }
+  ASSERT_EQ(0, cached);
+}
+
 TEST(CacheTest, ZeroSizeCache) {
   delete cache_;
   cache_ = NewLRUCache(0);
@@ -13,12 +13,37 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
+void Env::Schedule(void (*function)(void*), void* arg, Priority pri) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int number, Priority pri) {
+}
+
 SequentialFile::~SequentialFile() {
 }
 
 RandomAccessFile::~RandomAccessFile() {
 }
 
+Status RandomAccessFile::MultiRead(ReadRequest* reqs, size_t n) const {
+  for (size_t i = 0; i < n; i++) {
+    reqs[i].status = Read(reqs[i].offset, reqs[i].n, &reqs[i].result,
+                          reqs[i].scratch);
+  }
+  return Status::OK();
+}
+
 WritableFile::~WritableFile() {
 }
 
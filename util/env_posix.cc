@@ -14,11 +14,15 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <deque>
 #include <limits>
 #include <set>
+#include <vector>
 #include "leveldb/env.h"
 #include "leveldb/slice.h"
 #include "port/port.h"
@@ -27,6 +31,12 @@
 #include "util/mutexlock.h"
 #include "util/posix_logger.h"
 #include "util/env_posix_test_helper.h"
+#include "util/thread_local.h"
+
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif  // HAVE_IO_URING
 
 // HAVE_FDATASYNC is defined in the auto-generated port_config.h, which is
 // included by port_stdcxx.h.
@@ -34,6 +44,11 @@
 #define fdatasync fsync
 #endif  // !HAVE_FDATASYNC
 
+#if !defined(O_DIRECT)
+// Direct files then still go through the page cache.
+#define O_DIRECT 0
+#endif  // !defined(O_DIRECT)
+
 namespace leveldb {
 
 namespace {
@@ -43,6 +58,19 @@ static int mmap_limit = -1;
 
 static const size_t kBufSize = 65536;
 
+// Alignment of the file offsets, lengths and buffers of O_DIRECT reads
+// and writes.  Covers the logical block size of all common devices.
+static const size_t kDirectIOAlignment = 4096;
+
+// Size of the buffer of a PosixDirectWritableFile; a multiple of
+// kDirectIOAlignment
+static const size_t kDirectBufSize = 1 << 20;
+
+static uint64_t RoundUpToAlignment(uint64_t n) {
+  return (n + kDirectIOAlignment - 1) & ~static_cast<uint64_t>(
+      kDirectIOAlignment - 1);
+}
+
 static Status PosixError(const std::string& context, int err_number) {
   if (err_number == ENOENT) {
     return Status::NotFound(context, strerror(err_number));
@@ -101,6 +129,205 @@ class Limiter {
   void operator=(const Limiter&);
 };
 
+#if HAVE_IO_URING
+// A minimal io_uring, driven through the raw system calls, used to issue
+// the reads of a MultiRead() together.  Each thread has its own, so no
+// locking is needed.
+class IoUring {
+ public:
+  // Returns nullptr if the kernel refuses to create one.
+  static IoUring* Create() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, kEntries, &p);
+    if (fd < 0) {
+      return nullptr;
+    }
+    IoUring* ring = new IoUring(fd, p);
+    if (ring->sq_ptr_ == MAP_FAILED || ring->cq_ptr_ == MAP_FAILED ||
+        ring->sqes_ == MAP_FAILED) {
+      delete ring;
+      return nullptr;
+    }
+    return ring;
+  }
+
+  ~IoUring() {
+    if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_size_);
+    if (cq_ptr_ != MAP_FAILED) munmap(cq_ptr_, cq_size_);
+    if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+    close(fd_);
+  }
+
+  // Read the "n" requests of "reqs" from "fd".  Returns false if the
+  // ring failed; the requests must then be read some other way.  Either
+  // way, the kernel no longer uses the buffers of "reqs" on return.
+  bool Read(int fd, const std::string& filename,
+            RandomAccessFile::ReadRequest* reqs, size_t n) {
+    while (n > 0) {
+      const size_t batch = std::min<size_t>(n, entries_);
+      if (!ReadBatch(fd, filename, reqs, batch)) {
+        return false;
+      }
+      reqs += batch;
+      n -= batch;
+    }
+    return true;
+  }
+
+ private:
+  static const unsigned kEntries = 64;
+
+  IoUring(int fd, const struct io_uring_params& p)
+      : fd_(fd),
+        entries_(p.sq_entries),
+        sq_size_(p.sq_off.array + p.sq_entries * sizeof(unsigned)),
+        cq_size_(p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe)),
+        sqes_size_(p.sq_entries * sizeof(struct io_uring_sqe)),
+        iovecs_(p.sq_entries) {
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sq_ptr_ != MAP_FAILED) {
+      char* sq = reinterpret_cast<char*>(sq_ptr_);
+      sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+      sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+      sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+      sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    }
+    if (cq_ptr_ != MAP_FAILED) {
+      char* cq = reinterpret_cast<char*>(cq_ptr_);
+      cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+      cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+      cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+      cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+    }
+  }
+
+  // Requires n <= entries_
+  bool ReadBatch(int fd, const std::string& filename,
+                 RandomAccessFile::ReadRequest* reqs, size_t n) {
+    struct io_uring_sqe* sqes = reinterpret_cast<struct io_uring_sqe*>(sqes_);
+    const unsigned sq_head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sq_tail_;
+    for (size_t i = 0; i < n; i++) {
+      iovecs_[i].iov_base = reqs[i].scratch;
+      iovecs_[i].iov_len = reqs[i].n;
+      const unsigned index = tail & sq_mask_;
+      struct io_uring_sqe* sqe = &sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(&iovecs_[i]);
+      sqe->len = 1;
+      sqe->off = reqs[i].offset;
+      sqe->user_data = i;
+      sq_array_[index] = index;
+      tail++;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    unsigned to_submit = n;
+    size_t expected = n;  // Completions to wait for
+    size_t completed = 0;
+    bool failed = false;
+    while (completed < expected) {
+      int r = syscall(__NR_io_uring_enter, fd_, to_submit,
+                      expected - completed, IORING_ENTER_GETEVENTS, nullptr,
+                      0);
+      if (r < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY || failed) {
+          // Retry.  Once the ring has failed, the reads the kernel took
+          // may still write into their buffers, so they must be waited
+          // for before the buffers are handed back.
+          continue;
+        }
+        failed = true;
+        to_submit = 0;
+        expected = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) - sq_head;
+        continue;
+      }
+      to_submit -= std::min<unsigned>(to_submit, r);
+
+      unsigned head = *cq_head_;
+      const unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      while (head != cq_tail) {
+        const struct io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+        RandomAccessFile::ReadRequest* req = &reqs[cqe->user_data];
+        if (cqe->res < 0) {
+          req->result = Slice(req->scratch, 0);
+          req->status = PosixError(filename, -cqe->res);
+        } else {
+          req->result = Slice(req->scratch, cqe->res);
+          req->status = Status::OK();
+        }
+        head++;
+        completed++;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return !failed;
+  }
+
+  const int fd_;
+  const unsigned entries_;
+  const size_t sq_size_;
+  const size_t cq_size_;
+  const size_t sqes_size_;
+  void* sq_ptr_;
+  void* cq_ptr_;
+  void* sqes_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe* cqes_;
+  std::vector<struct iovec> iovecs_;  // One per submission queue entry
+};
+
+static void DeleteIoUring(void* ring) {
+  delete reinterpret_cast<IoUring*>(ring);
+}
+
+// Set once the kernel has refused to create an io_uring
+static std::atomic<bool> io_uring_unavailable(false);
+
+// The io_uring of each thread that has used one.  Leaked like the
+// default Env, so that it outlives every thread.
+static ThreadLocalPtr* ThreadIoUrings() {
+  static ThreadLocalPtr* rings = new ThreadLocalPtr(&DeleteIoUring);
+  return rings;
+}
+
+// Returns the io_uring of the calling thread, or nullptr if there is none.
+static IoUring* ThreadIoUring() {
+  IoUring* ring = reinterpret_cast<IoUring*>(ThreadIoUrings()->Get());
+  if (ring == nullptr &&
+      !io_uring_unavailable.load(std::memory_order_relaxed)) {
+    ring = IoUring::Create();
+    if (ring == nullptr) {
+      io_uring_unavailable.store(true, std::memory_order_relaxed);
+    } else {
+      ThreadIoUrings()->Reset(ring);
+    }
+  }
+  return ring;
+}
+
+// Drop the io_uring of the calling thread after it failed, since it may
+// still hold entries that were never submitted.  The next call creates a
+// new one.
+static void DiscardThreadIoUring() {
+  DeleteIoUring(ThreadIoUrings()->Swap(nullptr));
+}
+#endif  // HAVE_IO_URING
+
 class PosixSequentialFile: public SequentialFile {
  private:
   std::string filename_;
@@ -136,17 +363,20 @@ class PosixSequentialFile: public SequentialFile {
   }
 };
 
-// pread() based random-access
+// pread() based random-access, optionally bypassing the page cache with
+// O_DIRECT
 class PosixRandomAccessFile: public RandomAccessFile {
  private:
   std::string filename_;
   bool temporary_fd_;  // If true, fd_ is -1 and we open on every read.
   int fd_;
   Limiter* limiter_;
+  const bool direct_;  // Whether the file is opened with O_DIRECT
 
  public:
-  PosixRandomAccessFile(const std::string& fname, int fd, Limiter* limiter)
-      : filename_(fname), fd_(fd), limiter_(limiter) {
+  PosixRandomAccessFile(const std::string& fname, int fd, Limiter* limiter,
+                        bool direct = false)
+      : filename_(fname), fd_(fd), limiter_(limiter), direct_(direct) {
     temporary_fd_ = !limiter->Acquire();
     if (temporary_fd_) {
       // Open file on every access.
@@ -164,20 +394,65 @@ class PosixRandomAccessFile: public RandomAccessFile {
 
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const {
+    ReadRequest req;
+    req.offset = offset;
+    req.n = n;
+    req.scratch = scratch;
+    Status s = MultiRead(&req, 1);
+    if (s.ok()) {
+      s = req.status;
+    }
+    *result = req.result;
+    return s;
+  }
+
+  virtual Status MultiRead(ReadRequest* reqs, size_t n) const {
     int fd = fd_;
     if (temporary_fd_) {
-      fd = open(filename_.c_str(), O_RDONLY);
+      fd = open(filename_.c_str(), direct_ ? O_RDONLY | O_DIRECT : O_RDONLY);
       if (fd < 0) {
         return PosixError(filename_, errno);
       }
     }
 
     Status s;
-    ssize_t r = pread(fd, scratch, n, static_cast<off_t>(offset));
-    *result = Slice(scratch, (r < 0) ? 0 : r);
-    if (r < 0) {
-      // An error: return a non-ok status
-      s = PosixError(filename_, errno);
+    if (!direct_) {
+      ReadAll(fd, reqs, n);
+    } else {
+      // O_DIRECT requires the offset, length and buffer of every read to
+      // be aligned, so read the aligned ranges around the requested ones
+      // into an aligned buffer and copy the requested bytes out of it.
+      std::vector<ReadRequest> aligned(n);
+      size_t total = 0;
+      for (size_t i = 0; i < n; i++) {
+        aligned[i].offset = reqs[i].offset & ~(kDirectIOAlignment - 1);
+        aligned[i].n = RoundUpToAlignment(reqs[i].offset + reqs[i].n) -
+                       aligned[i].offset;
+        total += aligned[i].n;
+      }
+      void* buf = nullptr;
+      if (posix_memalign(&buf, kDirectIOAlignment, total) != 0) {
+        s = Status::IOError(filename_, "cannot allocate read buffer");
+      } else {
+        char* p = reinterpret_cast<char*>(buf);
+        for (size_t i = 0; i < n; i++) {
+          aligned[i].scratch = p;
+          p += aligned[i].n;
+        }
+        ReadAll(fd, &aligned[0], n);
+        for (size_t i = 0; i < n; i++) {
+          reqs[i].status = aligned[i].status;
+          reqs[i].result = Slice(reqs[i].scratch, 0);
+          const size_t skip = reqs[i].offset - aligned[i].offset;
+          if (aligned[i].status.ok() && aligned[i].result.size() > skip) {
+            const size_t k =
+                std::min(reqs[i].n, aligned[i].result.size() - skip);
+            memcpy(reqs[i].scratch, aligned[i].result.data() + skip, k);
+            reqs[i].result = Slice(reqs[i].scratch, k);
+          }
+        }
+        free(buf);
+      }
     }
     if (temporary_fd_) {
       // Close the temporary file descriptor opened earlier.
@@ -185,6 +460,29 @@ class PosixRandomAccessFile: public RandomAccessFile {
     }
     return s;
   }
+
+ private:
+  // Performs the reads of "reqs" on "fd", together if possible
+  void ReadAll(int fd, ReadRequest* reqs, size_t n) const {
+    bool done = false;
+#if HAVE_IO_URING
+    if (n > 1) {
+      IoUring* ring = ThreadIoUring();
+      if (ring != nullptr) {
+        done = ring->Read(fd, filename_, reqs, n);
+        if (!done) {
+          DiscardThreadIoUring();
+        }
+      }
+    }
+#endif  // HAVE_IO_URING
+    for (size_t i = 0; !done && i < n; i++) {
+      ssize_t r = pread(fd, reqs[i].scratch, reqs[i].n,
+                        static_cast<off_t>(reqs[i].offset));
+      reqs[i].result = Slice(reqs[i].scratch, (r < 0) ? 0 : r);
+      reqs[i].status = (r < 0) ? PosixError(filename_, errno) : Status::OK();
+    }
+  }
 };
 
 // mmap() based random-access
@@ -348,6 +646,113 @@ class PosixWritableFile : public WritableFile {
   }
 };
 
+// O_DIRECT based writing.  Data is collected in an aligned buffer and
+// written a whole buffer at a time.  Since O_DIRECT writes must cover
+// whole aligned blocks, Sync() and Close() write a partial last block
+// padded with zeros and then truncate the file to its real length; the
+// block is written again once more data follows it.  Flush() writes
+// nothing, as the data only reaches the operating system in whole blocks.
+class PosixDirectWritableFile : public WritableFile {
+ private:
+  std::string filename_;
+  int fd_;
+  char* buf_;             // kDirectBufSize bytes, aligned
+  size_t pos_;            // buf_[0, pos_-1] is not yet written for good
+  uint64_t buf_offset_;   // File offset of buf_[0]; aligned
+
+ public:
+  // "buf" must hold kDirectBufSize bytes aligned to kDirectIOAlignment;
+  // it is freed by the file.
+  PosixDirectWritableFile(const std::string& fname, int fd, char* buf)
+      : filename_(fname), fd_(fd), buf_(buf), pos_(0), buf_offset_(0) { }
+
+  ~PosixDirectWritableFile() {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    free(buf_);
+  }
+
+  virtual Status Append(const Slice& data) {
+    const char* p = data.data();
+    size_t n = data.size();
+    while (n > 0) {
+      const size_t copy = std::min(n, kDirectBufSize - pos_);
+      memcpy(buf_ + pos_, p, copy);
+      p += copy;
+      n -= copy;
+      pos_ += copy;
+      if (pos_ == kDirectBufSize) {
+        Status s = WriteRaw(kDirectBufSize);
+        if (!s.ok()) {
+          return s;
+        }
+        buf_offset_ += kDirectBufSize;
+        pos_ = 0;
+      }
+    }
+    return Status::OK();
+  }
+
+  virtual Status Close() {
+    Status result = WriteTail();
+    const int r = close(fd_);
+    if (r < 0 && result.ok()) {
+      result = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return result;
+  }
+
+  virtual Status Flush() {
+    return Status::OK();
+  }
+
+  virtual Status Sync() {
+    Status s = WriteTail();
+    if (s.ok()) {
+      if (fdatasync(fd_) != 0) {
+        s = PosixError(filename_, errno);
+      }
+    }
+    return s;
+  }
+
+ private:
+  // Write buf_[0, pos_-1] padded to whole blocks and cut the file back
+  // to its real length.
+  Status WriteTail() {
+    if (pos_ == 0) {
+      return Status::OK();
+    }
+    const size_t padded = RoundUpToAlignment(pos_);
+    memset(buf_ + pos_, 0, padded - pos_);
+    Status s = WriteRaw(padded);
+    if (s.ok() && ftruncate(fd_, buf_offset_ + pos_) != 0) {
+      s = PosixError(filename_, errno);
+    }
+    return s;
+  }
+
+  // Write buf_[0, n-1] at buf_offset_.  "n" must be aligned.
+  Status WriteRaw(size_t n) {
+    size_t done = 0;
+    while (done < n) {
+      ssize_t r = pwrite(fd_, buf_ + done, n - done,
+                         static_cast<off_t>(buf_offset_ + done));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      done += r;
+    }
+    return Status::OK();
+  }
+};
+
 static int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct flock f;
@@ -432,6 +837,48 @@ class PosixEnv : public Env {
     return s;
   }
 
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result) {
+    *result = nullptr;
+    int fd = open(fname.c_str(), O_RDONLY | O_DIRECT);
+    if (fd >= 0) {
+      *result = new PosixRandomAccessFile(fname, fd, &fd_limit_, true);
+      return Status::OK();
+    }
+    if (errno != EINVAL) {
+      return PosixError(fname, errno);
+    }
+    // The file system does not support O_DIRECT
+    fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return PosixError(fname, errno);
+    }
+    *result = new PosixRandomAccessFile(fname, fd, &fd_limit_);
+    return Status::OK();
+  }
+
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result) {
+    *result = nullptr;
+    int fd = open(fname.c_str(), O_TRUNC | O_WRONLY | O_CREAT | O_DIRECT,
+                  0644);
+    if (fd < 0) {
+      if (errno != EINVAL) {
+        return PosixError(fname, errno);
+      }
+      // The file system does not support O_DIRECT
+      return NewWritableFile(fname, result);
+    }
+    void* buf = nullptr;
+    if (posix_memalign(&buf, kDirectIOAlignment, kDirectBufSize) != 0) {
+      close(fd);
+      return Status::IOError(fname, "cannot allocate write buffer");
+    }
+    *result = new PosixDirectWritableFile(fname, fd,
+                                          reinterpret_cast<char*>(buf));
+    return Status::OK();
+  }
+
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) {
     Status s;
@@ -557,6 +1004,10 @@ class PosixEnv : public Env {
 
   virtual void Schedule(void (*function)(void*), void* arg);
 
+  virtual void Schedule(void (*function)(void*), void* arg, Priority pri);
+
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
   virtual Status GetTestDirectory(std::string* result) {
@@ -609,22 +1060,33 @@ class PosixEnv : public Env {
     }
   }
 
-  // BGThread() is the body of the background thread
-  void BGThread();
+  // BGThread() is the body of the background threads of pool "pri"
+  void BGThread(Priority pri);
+  struct BGThreadArg { PosixEnv* env; Priority pri; };
   static void* BGThreadWrapper(void* arg) {
-    reinterpret_cast<PosixEnv*>(arg)->BGThread();
+    BGThreadArg* a = reinterpret_cast<BGThreadArg*>(arg);
+    PosixEnv* env = a->env;
+    Priority pri = a->pri;
+    delete a;
+    env->BGThread(pri);
     return nullptr;
   }
 
-  pthread_mutex_t mu_;
-  pthread_cond_t bgsignal_;
-  pthread_t bgthread_;
-  bool started_bgthread_;
-
   // Entry per Schedule() call
   struct BGItem { void* arg; void (*function)(void*); };
   typedef std::deque<BGItem> BGQueue;
-  BGQueue queue_;
+
+  // One pool of background threads per priority.  All pools share mu_.
+  struct BGPool {
+    pthread_cond_t signal;
+    std::vector<pthread_t> threads;  // Background threads started so far
+    int max_threads;                 // Limit on threads.size()
+    int idle_threads;                // Threads waiting for queue items
+    BGQueue queue;
+  };
+
+  pthread_mutex_t mu_;
+  BGPool pools_[kNumPriorities];
 
   PosixLockTable locks_;
   Limiter mmap_limit_;
@@ -660,49 +1122,73 @@ static intptr_t MaxOpenFiles() {
 }
 
 PosixEnv::PosixEnv()
-    : started_bgthread_(false),
-      mmap_limit_(MaxMmaps()),
+    : mmap_limit_(MaxMmaps()),
       fd_limit_(MaxOpenFiles()) {
   PthreadCall("mutex_init", pthread_mutex_init(&mu_, nullptr));
-  PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, nullptr));
+  for (int i = 0; i < kNumPriorities; i++) {
+    PthreadCall("cvar_init", pthread_cond_init(&pools_[i].signal, nullptr));
+    pools_[i].max_threads = 1;
+    pools_[i].idle_threads = 0;
+  }
 }
 
 void PosixEnv::Schedule(void (*function)(void*), void* arg) {
-  PthreadCall("lock", pthread_mutex_lock(&mu_));
+  Schedule(function, arg, LOW);
+}
 
-  // Start background thread if necessary
-  if (!started_bgthread_) {
-    started_bgthread_ = true;
+void PosixEnv::Schedule(void (*function)(void*), void* arg, Priority pri) {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
+  BGPool* pool = &pools_[pri];
+
+  // Start another background thread if every existing one already has
+  // work to do and the pool has not reached its limit.  Threads are
+  // started lazily, so an Env that never has more than one item pending
+  // at a time only ever pays for a single thread.
+  if (pool->queue.size() >= static_cast<size_t>(pool->idle_threads) &&
+      pool->threads.size() < static_cast<size_t>(pool->max_threads)) {
+    BGThreadArg* thread_arg = new BGThreadArg;
+    thread_arg->env = this;
+    thread_arg->pri = pri;
+    pthread_t t;
     PthreadCall(
         "create thread",
-        pthread_create(&bgthread_, nullptr,  &PosixEnv::BGThreadWrapper, this));
+        pthread_create(&t, nullptr,  &PosixEnv::BGThreadWrapper, thread_arg));
+    pool->threads.push_back(t);
   }
 
-  // If the queue is currently empty, the background thread may currently be
-  // waiting.
-  if (queue_.empty()) {
-    PthreadCall("signal", pthread_cond_signal(&bgsignal_));
-  }
+  // Wake up one of the background threads that may be waiting for work.
+  PthreadCall("signal", pthread_cond_signal(&pool->signal));
 
   // Add to priority queue
-  queue_.push_back(BGItem());
-  queue_.back().function = function;
-  queue_.back().arg = arg;
+  pool->queue.push_back(BGItem());
+  pool->queue.back().function = function;
+  pool->queue.back().arg = arg;
 
   PthreadCall("unlock", pthread_mutex_unlock(&mu_));
 }
 
-void PosixEnv::BGThread() {
+void PosixEnv::SetBackgroundThreads(int number, Priority pri) {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
+  if (number > pools_[pri].max_threads) {
+    pools_[pri].max_threads = number;
+  }
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+}
+
+void PosixEnv::BGThread(Priority pri) {
+  BGPool* pool = &pools_[pri];
   while (true) {
     // Wait until there is an item that is ready to run
     PthreadCall("lock", pthread_mutex_lock(&mu_));
-    while (queue_.empty()) {
-      PthreadCall("wait", pthread_cond_wait(&bgsignal_, &mu_));
+    pool->idle_threads++;
+    while (pool->queue.empty()) {
+      PthreadCall("wait", pthread_cond_wait(&pool->signal, &mu_));
     }
+    pool->idle_threads--;
 
-    void (*function)(void*) = queue_.front().function;
-    void* arg = queue_.front().arg;
-    queue_.pop_front();
+    void (*function)(void*) = pool->queue.front().function;
+    void* arg = pool->queue.front().arg;
+    pool->queue.pop_front();
 
     PthreadCall("unlock", pthread_mutex_unlock(&mu_));
     (*function)(arg);
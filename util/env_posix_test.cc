@@ -4,6 +4,7 @@
 
 #include "leveldb/env.h"
 
+#include <vector>
 #include "port/port.h"
 #include "util/testharness.h"
 #include "util/env_posix_test_helper.h"
@@ -56,6 +57,106 @@ TEST(EnvPosixTest, TestOpenOnRead) {
   ASSERT_OK(env_->DeleteFile(test_file));
 }
 
+TEST(EnvPosixTest, MultiRead) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/multi_read.txt";
+  std::string data;
+  for (int i = 0; i < 100000; i++) {
+    data.push_back(static_cast<char>('a' + i % 26));
+  }
+  ASSERT_OK(WriteStringToFile(env_, data, test_file));
+
+  // The files past the mmap limit use pread(), the last ones opening the
+  // file on every read.  Unlike mmap() based files, they allow reads that
+  // go past the end of the file.
+  const int kNumFiles = kMMapLimit + kReadOnlyFileLimit + 2;
+  RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+  // Reads in no particular order, including ones that go past the end
+  const uint64_t kOffsets[] = { 4096, 0, 99990, 50000, 100000, 123, 70000 };
+  const size_t kSizes[] = { 4096, 10, 20, 1, 8, 65536, 30000 };
+  const int kNumReads = sizeof(kOffsets) / sizeof(kOffsets[0]);
+  for (int i = kMMapLimit; i < kNumFiles; i++) {
+    for (int count = 1; count <= kNumReads; count++) {
+      std::vector<RandomAccessFile::ReadRequest> reqs(count);
+      std::vector<std::string> scratch(count);
+      for (int j = 0; j < count; j++) {
+        scratch[j].resize(kSizes[j]);
+        reqs[j].offset = kOffsets[j];
+        reqs[j].n = kSizes[j];
+        reqs[j].scratch = &scratch[j][0];
+      }
+      ASSERT_OK(files[i]->MultiRead(&reqs[0], count));
+      for (int j = 0; j < count; j++) {
+        ASSERT_OK(reqs[j].status);
+        std::string expected;
+        if (kOffsets[j] < data.size()) {
+          expected = data.substr(kOffsets[j], kSizes[j]);
+        }
+        ASSERT_EQ(expected, reqs[j].result.ToString());
+      }
+    }
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_OK(env_->DeleteFile(test_file));
+}
+
+TEST(EnvPosixTest, DirectIO) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_io.txt";
+
+  // Appends of odd sizes, with syncs that leave a partial last block
+  std::string data;
+  WritableFile* writable_file;
+  ASSERT_OK(env_->NewDirectWritableFile(test_file, &writable_file));
+  for (int i = 0; i < 300; i++) {
+    std::string piece(i * 37 % 10007 + 1, static_cast<char>('a' + i % 26));
+    ASSERT_OK(writable_file->Append(piece));
+    data += piece;
+    if (i % 50 == 7) {
+      ASSERT_OK(writable_file->Sync());
+      uint64_t size;
+      ASSERT_OK(env_->GetFileSize(test_file, &size));
+      ASSERT_EQ(data.size(), size);
+    }
+  }
+  ASSERT_OK(writable_file->Close());
+  delete writable_file;
+  uint64_t size;
+  ASSERT_OK(env_->GetFileSize(test_file, &size));
+  ASSERT_EQ(data.size(), size);
+
+  RandomAccessFile* file;
+  ASSERT_OK(env_->NewDirectRandomAccessFile(test_file, &file));
+  const uint64_t kOffsets[] = { 0, 1, 4095, 4096, 123457, data.size() - 3 };
+  const size_t kSizes[] = { 10, 8191, 2, 4096, 70001, 10 };
+  const int kNumReads = sizeof(kOffsets) / sizeof(kOffsets[0]);
+  std::vector<RandomAccessFile::ReadRequest> reqs(kNumReads);
+  std::vector<std::string> scratch(kNumReads);
+  for (int i = 0; i < kNumReads; i++) {
+    scratch[i].resize(kSizes[i]);
+    Slice result;
+    ASSERT_OK(file->Read(kOffsets[i], kSizes[i], &result, &scratch[i][0]));
+    ASSERT_EQ(data.substr(kOffsets[i], kSizes[i]), result.ToString());
+    reqs[i].offset = kOffsets[i];
+    reqs[i].n = kSizes[i];
+    reqs[i].scratch = &scratch[i][0];
+  }
+  ASSERT_OK(file->MultiRead(&reqs[0], kNumReads));
+  for (int i = 0; i < kNumReads; i++) {
+    ASSERT_OK(reqs[i].status);
+    ASSERT_EQ(data.substr(kOffsets[i], kSizes[i]), reqs[i].result.ToString());
+  }
+  delete file;
+  ASSERT_OK(env_->DeleteFile(test_file));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
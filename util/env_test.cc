@@ -115,6 +115,91 @@ TEST(EnvTest, RunMany) {
   ASSERT_EQ(4, reinterpret_cast<uintptr_t>(cur));
 }
 
+TEST(EnvTest, RunConcurrently) {
+  // Each callback waits until all of them have started, which can only
+  // happen if the Env runs them on separate threads.
+  struct CB {
+    port::Mutex* mu;
+    port::CondVar* cv;
+    int* started GUARDED_BY(mu);
+    int* finished GUARDED_BY(mu);
+
+    static void Run(void* v) {
+      CB* cb = reinterpret_cast<CB*>(v);
+      MutexLock l(cb->mu);
+      (*cb->started)++;
+      cb->cv->SignalAll();
+      while (*cb->started < 3) {
+        cb->cv->Wait();
+      }
+      (*cb->finished)++;
+      cb->cv->SignalAll();
+    }
+  };
+
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  int started = 0;
+  int finished = 0;
+  CB cb = { &mu, &cv, &started, &finished };
+
+  env_->SetBackgroundThreads(3, Env::LOW);
+  for (int i = 0; i < 3; i++) {
+    env_->Schedule(&CB::Run, &cb);
+  }
+
+  MutexLock l(&mu);
+  while (finished < 3) {
+    cv.Wait();
+  }
+  ASSERT_EQ(3, started);
+}
+
+TEST(EnvTest, HighPriorityNotBlockedByLow) {
+  // Occupy every LOW priority thread with work that only finishes once
+  // the HIGH priority item has run.
+  struct CB {
+    port::Mutex* mu;
+    port::CondVar* cv;
+    bool* high_done GUARDED_BY(mu);
+    int* low_done GUARDED_BY(mu);
+
+    static void RunLow(void* v) {
+      CB* cb = reinterpret_cast<CB*>(v);
+      MutexLock l(cb->mu);
+      while (!*cb->high_done) {
+        cb->cv->Wait();
+      }
+      (*cb->low_done)++;
+      cb->cv->SignalAll();
+    }
+
+    static void RunHigh(void* v) {
+      CB* cb = reinterpret_cast<CB*>(v);
+      MutexLock l(cb->mu);
+      *cb->high_done = true;
+      cb->cv->SignalAll();
+    }
+  };
+
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  bool high_done = false;
+  int low_done = 0;
+  CB cb = { &mu, &cv, &high_done, &low_done };
+
+  for (int i = 0; i < 3; i++) {
+    env_->Schedule(&CB::RunLow, &cb, Env::LOW);
+  }
+  env_->Schedule(&CB::RunHigh, &cb, Env::HIGH);
+
+  MutexLock l(&mu);
+  while (low_done < 3) {
+    cv.Wait();
+  }
+  ASSERT_TRUE(high_done);
+}
+
 struct State {
   port::Mutex mu;
   int val GUARDED_BY(mu);
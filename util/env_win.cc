@@ -153,6 +153,9 @@ class Win32Env : public Env {
   Status RenameFile(const std::string& src, const std::string& target) override;
   Status LockFile(const std::string& fname, FileLock** lock) override;
   Status UnlockFile(FileLock* lock) override;
+  // Work items go to the system thread pool, which is not limited to a
+  // single thread, so priorities need no special handling.
+  using Env::Schedule;
   void Schedule(void (*function)(void* arg), void* arg) override;
   void StartThread(void (*function)(void* arg), void* arg) override;
   Status GetTestDirectory(std::string* path) override;
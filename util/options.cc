@@ -19,12 +19,29 @@ Options::Options()
       write_buffer_size(4<<20),
       max_open_files(1000),
       block_cache(nullptr),
+      cache_index_and_filter_blocks(false),
+      pin_l0_filter_and_index_blocks_in_cache(false),
+      row_cache(nullptr),
       block_size(4096),
       block_restart_interval(16),
+      index_partition_size(0),
+      data_block_hash_index(false),
       max_file_size(2<<20),
+      max_background_compactions(1),
+      max_subcompactions(1),
+      compaction_prefetch_blocks(0),
+      use_direct_reads(false),
+      use_direct_compaction_reads(false),
+      use_direct_io_for_flush_and_compaction(false),
+      delayed_write_rate(16<<20),
+      soft_pending_compaction_bytes_limit(64ull<<30),
+      enable_pipelined_write(false),
+      allow_concurrent_memtable_write(false),
       compression(kSnappyCompression),
       reuse_logs(false),
-      filter_policy(nullptr) {
+      filter_policy(nullptr),
+      full_file_filter(false),
+      prefix_extractor(nullptr) {
 }
 
 }  // namespace leveldb
@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/pinnable_slice.h"
+
+namespace leveldb {
+
+PinnableSlice::PinnableSlice() {
+  cleanup_.function = nullptr;
+  cleanup_.next = nullptr;
+}
+
+PinnableSlice::~PinnableSlice() {
+  Reset();
+}
+
+void PinnableSlice::PinSlice(const Slice& s, CleanupFunction function,
+                             void* arg1, void* arg2) {
+  assert(function != nullptr);
+  Reset();
+  Slice::operator=(s);
+  cleanup_.function = function;
+  cleanup_.arg1 = arg1;
+  cleanup_.arg2 = arg2;
+}
+
+void PinnableSlice::PinSelf(const Slice& s) {
+  Reset();
+  buf_.assign(s.data(), s.size());
+  Slice::operator=(buf_);
+}
+
+void PinnableSlice::RegisterCleanup(CleanupFunction function,
+                                    void* arg1, void* arg2) {
+  assert(IsPinned());
+  assert(function != nullptr);
+  Cleanup* c = new Cleanup;
+  c->function = function;
+  c->arg1 = arg1;
+  c->arg2 = arg2;
+  c->next = cleanup_.next;
+  cleanup_.next = c;
+}
+
+void PinnableSlice::Reset() {
+  if (cleanup_.function != nullptr) {
+    (*cleanup_.function)(cleanup_.arg1, cleanup_.arg2);
+    for (Cleanup* c = cleanup_.next; c != nullptr; ) {
+      (*c->function)(c->arg1, c->arg2);
+      Cleanup* next = c->next;
+      delete c;
+      c = next;
+    }
+    cleanup_.function = nullptr;
+    cleanup_.next = nullptr;
+  }
+  buf_.clear();
+  clear();
+}
+
+}  // namespace leveldb
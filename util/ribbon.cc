@@ -0,0 +1,250 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Ribbon filter (Dillinger and Walzer, "Ribbon filter: practically
+// smaller than Bloom and Xor", 2021) stores, for a set of keys, the
+// solution Z of a linear system over GF(2).  Every key x contributes one
+// equation c(x) . Z[s(x) .. s(x)+63] = b(x), where the 64-bit
+// coefficient row c(x), the start s(x) and the r-bit fingerprint b(x)
+// are derived from the hash of x.  A lookup recomputes the left hand
+// side for its key and compares it with the fingerprint, so keys that
+// were added always match and others match with probability 2^-r.
+// Storing Z takes little more than r bits per key, while a bloom filter
+// with the same false positive rate needs about 1.44*r bits per key.
+//
+// Filter format:
+//    solution words: fixed64[num_blocks * r]  (block i holds bits
+//                    64*i .. 64*i+63 of each of the r columns of Z)
+//    num_blocks:     fixed32
+//    seed:           fixed32
+//    r:              uint8
+
+#include "leveldb/filter_policy.h"
+
+#include <vector>
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+static const size_t kTrailerSize = 4 + 4 + 1;
+
+// Number of seeds tried for a given filter size before it is grown
+static const int kSeedsPerSize = 2;
+
+static uint64_t Mix64(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// Return the high 64 bits of a * b.
+static uint64_t MulHigh64(uint64_t a, uint64_t b) {
+  const uint64_t a_lo = a & 0xffffffffu, a_hi = a >> 32;
+  const uint64_t b_lo = b & 0xffffffffu, b_hi = b >> 32;
+  const uint64_t lo_lo = a_lo * b_lo;
+  const uint64_t hi_lo = a_hi * b_lo;
+  const uint64_t lo_hi = a_lo * b_hi;
+  const uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffffu) + lo_hi;
+  return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+}
+
+static int Parity(uint64_t v) {
+#if defined(__GNUC__)
+  return __builtin_parityll(v);
+#else
+  v ^= v >> 32;
+  v ^= v >> 16;
+  v ^= v >> 8;
+  v ^= v >> 4;
+  v ^= v >> 2;
+  v ^= v >> 1;
+  return static_cast<int>(v & 1);
+#endif
+}
+
+static int CountTrailingZeros(uint64_t v) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(v);
+#else
+  int n = 0;
+  while ((v & 1) == 0) {
+    v >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static uint64_t KeyHash(const Slice& key) {
+  return (static_cast<uint64_t>(Hash(key.data(), key.size(), 0xbc9f1d34))
+          << 32) | Hash(key.data(), key.size(), 0x5bd1e995);
+}
+
+// The equation of a key for a filter with "num_slots" columns of Z
+struct Equation {
+  uint64_t start;
+  uint64_t coeff;  // Bit i applies to Z[start + i]; bit 0 is always set
+  uint32_t result;
+
+  Equation(uint64_t key_hash, uint32_t seed, uint64_t num_slots, int r) {
+    const uint64_t h = Mix64(key_hash ^ (seed * 0x9e3779b97f4a7c15ull));
+    start = MulHigh64(h, num_slots - 63);
+    coeff = Mix64(h + 1) | 1;
+    result = static_cast<uint32_t>(Mix64(h + 2) >> (64 - r));
+  }
+};
+
+class RibbonFilterPolicy : public FilterPolicy {
+ private:
+  int r_;  // Fingerprint bits
+
+  // Band the equations of "hashes" into (coeff, result) rows so that row
+  // i has its first coefficient at i.  Returns false if the system has
+  // no solution.
+  bool Band(const std::vector<uint64_t>& hashes, uint32_t seed,
+            uint64_t num_slots, std::vector<uint64_t>* coeff,
+            std::vector<uint32_t>* result) const {
+    coeff->assign(num_slots, 0);
+    result->assign(num_slots, 0);
+    for (size_t k = 0; k < hashes.size(); k++) {
+      Equation e(hashes[k], seed, num_slots, r_);
+      uint64_t i = e.start;
+      uint64_t c = e.coeff;
+      uint32_t b = e.result;
+      while (true) {
+        if ((*coeff)[i] == 0) {
+          (*coeff)[i] = c;
+          (*result)[i] = b;
+          break;
+        }
+        c ^= (*coeff)[i];
+        b ^= (*result)[i];
+        if (c == 0) {
+          if (b != 0) {
+            return false;
+          }
+          break;  // Implied by earlier equations, e.g. a duplicate key
+        }
+        const int shift = CountTrailingZeros(c);
+        c >>= shift;
+        i += shift;
+      }
+    }
+    return true;
+  }
+
+ public:
+  explicit RibbonFilterPolicy(int bits_per_key) {
+    // A bloom filter with k bits per key has a false positive rate of
+    // about 0.6185^k == 2^(-0.69*k)
+    r_ = static_cast<int>(bits_per_key * 0.69 + 0.5);
+    if (r_ < 1) r_ = 1;
+    if (r_ > 32) r_ = 32;
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.RibbonFilter";
+  }
+
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const {
+    std::vector<uint64_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = KeyHash(keys[i]);
+    }
+
+    // The headroom a random system needs to be solvable grows slowly with
+    // the number of keys, so start with 4% more slots than keys plus 0.5%
+    // for every doubling beyond 1024 keys.  That is usually enough for
+    // one of the first seeds; grow by 1/64 whenever kSeedsPerSize seeds
+    // in a row do not work out.
+    uint64_t extra = n / 25;
+    for (int m = n / 1024; m > 0; m /= 2) extra += n / 200;
+    uint64_t num_blocks = (n + extra + 63) / 64 + 1;
+    if (n == 0) {
+      num_blocks = 0;
+    }
+    uint32_t seed = 0;
+    std::vector<uint64_t> coeff;
+    std::vector<uint32_t> result;
+    while (num_blocks > 0 &&
+           !Band(hashes, seed, num_blocks * 64, &coeff, &result)) {
+      seed++;
+      if (seed % kSeedsPerSize == 0) {
+        num_blocks += num_blocks / 64 + 1;
+      }
+    }
+
+    // Back-substitute from the last row, keeping the solution bits of
+    // the 64 following rows of each column in state[j].  Rows without
+    // an equation are free and set to zero.
+    const uint64_t num_slots = num_blocks * 64;
+    std::vector<uint64_t> solution(num_blocks * r_, 0);
+    std::vector<uint64_t> state(r_, 0);
+    for (uint64_t i = num_slots; i-- > 0; ) {
+      const uint64_t c = coeff[i];
+      uint64_t* block = &solution[(i / 64) * r_];
+      for (int j = 0; j < r_; j++) {
+        uint64_t bit = 0;
+        if (c != 0) {
+          bit = ((result[i] >> j) & 1) ^ Parity(c & (state[j] << 1));
+        }
+        state[j] = (state[j] << 1) | bit;
+        block[j] |= bit << (i % 64);
+      }
+    }
+
+    for (size_t i = 0; i < solution.size(); i++) {
+      PutFixed64(dst, solution[i]);
+    }
+    PutFixed32(dst, static_cast<uint32_t>(num_blocks));
+    PutFixed32(dst, seed);
+    dst->push_back(static_cast<char>(r_));
+  }
+
+  virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const {
+    const size_t len = filter.size();
+    if (len < kTrailerSize) return false;
+
+    const char* trailer = filter.data() + len - kTrailerSize;
+    const uint64_t num_blocks = DecodeFixed32(trailer);
+    const uint32_t seed = DecodeFixed32(trailer + 4);
+    const int r = static_cast<unsigned char>(trailer[8]);
+    if (r < 1 || r > 32 || len - kTrailerSize != num_blocks * r * 8) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+    if (num_blocks == 0) {
+      return false;  // No keys
+    }
+
+    const Equation e(KeyHash(key), seed, num_blocks * 64, r);
+    const uint64_t block = e.start / 64;
+    const int offset = e.start % 64;
+    const char* words = filter.data() + block * r * 8;
+    uint32_t value = 0;
+    for (int j = 0; j < r; j++) {
+      uint64_t window = DecodeFixed64(words + j * 8) >> offset;
+      if (offset > 0) {
+        window |= DecodeFixed64(words + (r + j) * 8) << (64 - offset);
+      }
+      value |= static_cast<uint32_t>(Parity(e.coeff & window)) << j;
+    }
+    return value == e.result;
+  }
+};
+
+}  // anonymous namespace
+
+const FilterPolicy* NewRibbonFilterPolicy(int bits_per_key) {
+  return new RibbonFilterPolicy(bits_per_key);
+}
+
+}  // namespace leveldb
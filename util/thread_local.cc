@@ -0,0 +1,199 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <deque>
+#include <set>
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// The pointers of one thread, indexed by the id of their ThreadLocalPtr.
+// Only the owning thread adds entries, and it does so with the mutex of
+// the registry held so that Scrape() never sees the deque change.
+struct ThreadData {
+  std::deque<port::AtomicPointer> entries;
+};
+
+// Keeps track of the ids in use and of all threads that have stored a
+// pointer in any ThreadLocalPtr.
+class Registry {
+ public:
+  Registry() : next_id_(0) { }
+
+  uint32_t NewId(ThreadLocalPtr::UnrefHandler handler) {
+    MutexLock l(&mu_);
+    uint32_t id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+      handlers_[id] = handler;
+    } else {
+      id = next_id_++;
+      handlers_.push_back(handler);
+    }
+    return id;
+  }
+
+  // Hand the pointers still stored under "id" to its handler and make
+  // the id available again.
+  void ReleaseId(uint32_t id) {
+    MutexLock l(&mu_);
+    ThreadLocalPtr::UnrefHandler handler = handlers_[id];
+    for (std::set<ThreadData*>::iterator it = threads_.begin();
+         it != threads_.end(); ++it) {
+      ThreadData* t = *it;
+      if (id < t->entries.size()) {
+        void* ptr = t->entries[id].Acquire_Load();
+        t->entries[id].Release_Store(nullptr);
+        if (ptr != nullptr && handler != nullptr) {
+          (*handler)(ptr);
+        }
+      }
+    }
+    handlers_[id] = nullptr;
+    free_ids_.push_back(id);
+  }
+
+  void AddThread(ThreadData* t) {
+    MutexLock l(&mu_);
+    threads_.insert(t);
+  }
+
+  void RemoveThread(ThreadData* t) {
+    MutexLock l(&mu_);
+    threads_.erase(t);
+    for (uint32_t id = 0; id < t->entries.size(); id++) {
+      void* ptr = t->entries[id].Acquire_Load();
+      if (ptr != nullptr && handlers_[id] != nullptr) {
+        (*handlers_[id])(ptr);
+      }
+    }
+  }
+
+  void Grow(ThreadData* t, uint32_t id) {
+    MutexLock l(&mu_);
+    while (t->entries.size() <= id) {
+      t->entries.emplace_back(nullptr);
+    }
+  }
+
+  void Scrape(uint32_t id, std::vector<void*>* ptrs, void* replacement) {
+    MutexLock l(&mu_);
+    for (std::set<ThreadData*>::iterator it = threads_.begin();
+         it != threads_.end(); ++it) {
+      ThreadData* t = *it;
+      if (id < t->entries.size()) {
+        void* ptr = Swap(&t->entries[id], replacement);
+        if (ptr != nullptr) {
+          ptrs->push_back(ptr);
+        }
+      }
+    }
+  }
+
+  static void* Swap(port::AtomicPointer* entry, void* ptr) {
+    void* old;
+    do {
+      old = entry->Acquire_Load();
+    } while (!entry->CompareAndSwap(old, ptr));
+    return old;
+  }
+
+ private:
+  port::Mutex mu_;
+  uint32_t next_id_ GUARDED_BY(mu_);
+  std::vector<uint32_t> free_ids_ GUARDED_BY(mu_);
+  std::vector<ThreadLocalPtr::UnrefHandler> handlers_ GUARDED_BY(mu_);
+  std::set<ThreadData*> threads_ GUARDED_BY(mu_);
+};
+
+// The registry is never deleted, so that threads that exit while the
+// process shuts down can still unregister.
+static port::OnceType once = LEVELDB_ONCE_INIT;
+static Registry* registry;
+
+static void InitRegistry() {
+  registry = new Registry;
+}
+
+static Registry* GetRegistry() {
+  port::InitOnce(&once, InitRegistry);
+  return registry;
+}
+
+// Owns the ThreadData of the calling thread and unregisters it when the
+// thread exits.
+struct ThreadDataHolder {
+  ThreadData* data;
+
+  ThreadDataHolder() : data(nullptr) { }
+  ~ThreadDataHolder() {
+    if (data != nullptr) {
+      GetRegistry()->RemoveThread(data);
+      delete data;
+    }
+  }
+};
+
+static thread_local ThreadDataHolder thread_data;
+
+// Return the entry of the calling thread for "id", or nullptr if the
+// thread has none yet and "create" is false.
+static port::AtomicPointer* GetEntry(uint32_t id, bool create) {
+  ThreadData* t = thread_data.data;
+  if (t == nullptr) {
+    if (!create) {
+      return nullptr;
+    }
+    t = new ThreadData;
+    GetRegistry()->AddThread(t);
+    thread_data.data = t;
+  }
+  if (id >= t->entries.size()) {
+    if (!create) {
+      return nullptr;
+    }
+    GetRegistry()->Grow(t, id);
+  }
+  return &t->entries[id];
+}
+
+}  // anonymous namespace
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : id_(GetRegistry()->NewId(handler)) {
+}
+
+ThreadLocalPtr::~ThreadLocalPtr() {
+  GetRegistry()->ReleaseId(id_);
+}
+
+void* ThreadLocalPtr::Get() const {
+  port::AtomicPointer* entry = GetEntry(id_, false);
+  return (entry == nullptr) ? nullptr : entry->Acquire_Load();
+}
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  GetEntry(id_, true)->Release_Store(ptr);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return Registry::Swap(GetEntry(id_, true), ptr);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* expected, void* ptr) {
+  return GetEntry(id_, true)->CompareAndSwap(expected, ptr);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  GetRegistry()->Scrape(id_, ptrs, replacement);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A ThreadLocalPtr holds one pointer per thread.  Unlike a variable
+// declared thread_local, any number of them can be created at run time,
+// e.g. one per open DB, and the owner can take away the pointers of all
+// threads at once with Scrape().  This lets threads cache state without
+// locking while the owner can still invalidate the caches.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <stdint.h>
+#include <vector>
+
+namespace leveldb {
+
+class ThreadLocalPtr {
+ public:
+  // Called for every non-null pointer a thread still holds when the
+  // thread exits or the ThreadLocalPtr is destroyed.  The handler runs
+  // with an internal lock held, so it must not call back into any
+  // ThreadLocalPtr.
+  typedef void (*UnrefHandler)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = nullptr);
+
+  ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+  ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
+
+  ~ThreadLocalPtr();
+
+  // Return the pointer of the calling thread, initially nullptr.
+  void* Get() const;
+
+  // Set the pointer of the calling thread to "ptr".
+  void Reset(void* ptr);
+
+  // Set the pointer of the calling thread to "ptr" and return its
+  // previous value.
+  void* Swap(void* ptr);
+
+  // If the pointer of the calling thread is "expected", replace it with
+  // "ptr" and return true.  Otherwise leave it unchanged and return false.
+  bool CompareAndSwap(void* expected, void* ptr);
+
+  // Replace the pointer of every thread with "replacement" and append
+  // the previous values that were not nullptr to *ptrs.
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  const uint32_t id_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
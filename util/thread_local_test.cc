@@ -0,0 +1,152 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class ThreadLocalTest { };
+
+static port::Mutex unref_mu;
+static int unref_count = 0;
+
+static void CountUnref(void* ptr) {
+  MutexLock l(&unref_mu);
+  unref_count++;
+}
+
+static int UnrefCount() {
+  MutexLock l(&unref_mu);
+  return unref_count;
+}
+
+TEST(ThreadLocalTest, Basic) {
+  ThreadLocalPtr tls;
+  ASSERT_TRUE(tls.Get() == nullptr);
+
+  int a, b;
+  tls.Reset(&a);
+  ASSERT_EQ(&a, tls.Get());
+  ASSERT_EQ(&a, tls.Swap(&b));
+  ASSERT_EQ(&b, tls.Get());
+  ASSERT_TRUE(!tls.CompareAndSwap(&a, nullptr));
+  ASSERT_EQ(&b, tls.Get());
+  ASSERT_TRUE(tls.CompareAndSwap(&b, &a));
+  ASSERT_EQ(&a, tls.Get());
+
+  // Instances do not share their pointers
+  ThreadLocalPtr other;
+  ASSERT_TRUE(other.Get() == nullptr);
+  other.Reset(&b);
+  ASSERT_EQ(&a, tls.Get());
+  ASSERT_EQ(&b, other.Get());
+}
+
+namespace {
+
+struct State {
+  ThreadLocalPtr* tls;
+  port::Mutex mu;
+  port::CondVar cv;
+  int values[3];
+  int started GUARDED_BY(mu);
+  bool release GUARDED_BY(mu);
+  int done GUARDED_BY(mu);
+
+  explicit State(ThreadLocalPtr* t)
+      : tls(t), cv(&mu), started(0), release(false), done(0) { }
+};
+
+struct ThreadArg {
+  State* state;
+  int id;
+};
+
+}  // anonymous namespace
+
+static void StoreAndWait(void* arg) {
+  ThreadArg* t = reinterpret_cast<ThreadArg*>(arg);
+  State* s = t->state;
+  ASSERT_TRUE(s->tls->Get() == nullptr);
+  s->tls->Reset(&s->values[t->id]);
+
+  MutexLock l(&s->mu);
+  s->started++;
+  s->cv.SignalAll();
+  while (!s->release) {
+    s->cv.Wait();
+  }
+  ASSERT_TRUE(s->tls->Get() == nullptr);
+  s->done++;
+  s->cv.SignalAll();
+}
+
+TEST(ThreadLocalTest, Scrape) {
+  ThreadLocalPtr tls(&CountUnref);
+  State state(&tls);
+  ThreadArg args[3];
+  for (int i = 0; i < 3; i++) {
+    args[i].state = &state;
+    args[i].id = i;
+    Env::Default()->StartThread(&StoreAndWait, &args[i]);
+  }
+
+  std::vector<void*> ptrs;
+  {
+    MutexLock l(&state.mu);
+    while (state.started < 3) {
+      state.cv.Wait();
+    }
+    tls.Scrape(&ptrs, nullptr);
+    state.release = true;
+    state.cv.SignalAll();
+    while (state.done < 3) {
+      state.cv.Wait();
+    }
+  }
+
+  ASSERT_EQ(3, ptrs.size());
+  std::sort(ptrs.begin(), ptrs.end());
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(&state.values[i], ptrs[i]);
+  }
+}
+
+static void StoreAndExit(void* arg) {
+  ThreadLocalPtr* tls = reinterpret_cast<ThreadLocalPtr*>(arg);
+  static int value;
+  tls->Reset(&value);
+}
+
+TEST(ThreadLocalTest, UnrefOnThreadExit) {
+  ThreadLocalPtr tls(&CountUnref);
+  const int before = UnrefCount();
+  Env::Default()->StartThread(&StoreAndExit, &tls);
+  while (UnrefCount() == before) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ(before + 1, UnrefCount());
+}
+
+TEST(ThreadLocalTest, UnrefOnDestruction) {
+  const int before = UnrefCount();
+  int a;
+  {
+    ThreadLocalPtr tls(&CountUnref);
+    tls.Reset(&a);
+  }
+  ASSERT_EQ(before + 1, UnrefCount());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}